@@ -0,0 +1,812 @@
+#include "band_io.hpp"
+#include "cover_cache.hpp"
+#include "instrument.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#ifdef STEG_HAVE_LIBPNG
+#include <png.h>
+#include <csetjmp>
+#endif
+
+/**
+ * \file
+ * \brief File, where row-band image I/O and file-to-file embedding are realised
+ */
+
+
+
+namespace {
+
+std::string lowerExtension(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return std::string();
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+}
+
+struct FileCloser {
+    void operator()(std::FILE* f) const { if (f) std::fclose(f); }
+};
+using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+
+// ==== PPM / PGM (binary, maxval 255) ====
+class PnmReader : public RowReader {
+public:
+    bool open(FilePtr file) {
+        file_ = std::move(file);
+        char magic[2];
+        if (std::fread(magic, 1, 2, file_.get()) != 2 || magic[0] != 'P' || (magic[1] != '6' && magic[1] != '5'))
+            return false;
+        channels_ = magic[1] == '6' ? 3 : 1;
+        long maxval = 0;
+        if (!readNumber(width_) || !readNumber(height_) || !readLong(maxval) || maxval != 255)
+            return false;
+        if (width_ <= 0 || height_ <= 0)
+            return false;
+        std::fgetc(file_.get());   // single whitespace before the raster
+        row_.resize(static_cast<size_t>(width_) * channels_);
+        return true;
+    }
+
+    bool readRows(cv::Mat& band, int rows) override {
+        band.create(rows, width_, CV_8UC3);
+        for (int y = 0; y < rows; ++y) {
+            if (std::fread(row_.data(), 1, row_.size(), file_.get()) != row_.size())
+                return false;
+            uchar* out = band.ptr<uchar>(y);
+            const uchar* in = row_.data();
+            if (channels_ == 3) {
+                for (int x = 0; x < width_; ++x, in += 3, out += 3) {
+                    out[0] = in[2];
+                    out[1] = in[1];
+                    out[2] = in[0];
+                }
+            } else {
+                for (int x = 0; x < width_; ++x, out += 3)
+                    out[0] = out[1] = out[2] = in[x];
+            }
+        }
+        return true;
+    }
+
+    uint64_t position() const override {
+        return static_cast<uint64_t>(std::max(std::ftell(file_.get()), 0L));
+    }
+
+private:
+    bool readLong(long& value) {
+        int c = std::fgetc(file_.get());
+        for (;;) {
+            if (c == '#') {
+                while (c != EOF && c != '\n')
+                    c = std::fgetc(file_.get());
+            } else if (c != EOF && std::isspace(c)) {
+                c = std::fgetc(file_.get());
+            } else {
+                break;
+            }
+        }
+        if (c == EOF || !std::isdigit(c))
+            return false;
+        value = 0;
+        while (c != EOF && std::isdigit(c)) {
+            value = value * 10 + (c - '0');
+            if (value > (1L << 30))
+                return false;
+            c = std::fgetc(file_.get());
+        }
+        std::ungetc(c, file_.get());
+        return true;
+    }
+
+    bool readNumber(int& value) {
+        long v = 0;
+        if (!readLong(v))
+            return false;
+        value = static_cast<int>(v);
+        return true;
+    }
+
+    FilePtr file_;
+    int channels_ = 3;
+    std::vector<uchar> row_;
+};
+
+
+// ==== BMP (uncompressed, 24 or 32 bits per pixel) ====
+// Rows are usually stored bottom-up, so each row is located by offset rather than read in turn
+class BmpReader : public RowReader {
+public:
+    bool open(FilePtr file) {
+        file_ = std::move(file);
+        uchar hdr[34];
+        if (std::fread(hdr, 1, sizeof(hdr), file_.get()) != sizeof(hdr) || hdr[0] != 'B' || hdr[1] != 'M')
+            return false;
+        uint32_t dataOffset = le32(hdr + 10);
+        uint32_t infoSize = le32(hdr + 14);
+        int32_t width = static_cast<int32_t>(le32(hdr + 18));
+        int32_t height = static_cast<int32_t>(le32(hdr + 22));
+        int bpp = hdr[28] | (hdr[29] << 8);
+        uint32_t compression = le32(hdr + 30);
+        if (infoSize < 40 || compression != 0 || (bpp != 24 && bpp != 32))
+            return false;
+        if (width <= 0 || height == 0 || height == INT32_MIN)
+            return false;
+        width_ = width;
+        height_ = height < 0 ? -height : height;
+        bottomUp_ = height > 0;
+        bytesPerPixel_ = bpp / 8;
+        stride_ = (static_cast<uint64_t>(width_) * bytesPerPixel_ + 3) & ~uint64_t(3);
+        dataOffset_ = dataOffset;
+        if (dataOffset_ + stride_ * height_ > static_cast<uint64_t>(LONG_MAX))
+            return false;
+        row_.resize(stride_);
+        return true;
+    }
+
+    bool readRows(cv::Mat& band, int rows) override {
+        band.create(rows, width_, CV_8UC3);
+        for (int y = 0; y < rows; ++y, ++next_) {
+            uint64_t fileRow = bottomUp_ ? static_cast<uint64_t>(height_ - 1 - next_) : static_cast<uint64_t>(next_);
+            if (std::fseek(file_.get(), static_cast<long>(dataOffset_ + fileRow * stride_), SEEK_SET) != 0 ||
+                std::fread(row_.data(), 1, row_.size(), file_.get()) != row_.size())
+                return false;
+            consumed_ += stride_;
+            uchar* out = band.ptr<uchar>(y);
+            const uchar* in = row_.data();
+            if (bytesPerPixel_ == 3) {
+                std::memcpy(out, in, static_cast<size_t>(width_) * 3);
+            } else {
+                for (int x = 0; x < width_; ++x, in += 4, out += 3) {
+                    out[0] = in[0];
+                    out[1] = in[1];
+                    out[2] = in[2];
+                }
+            }
+        }
+        return true;
+    }
+
+    uint64_t position() const override {
+        return dataOffset_ + consumed_;
+    }
+
+private:
+    static uint32_t le32(const uchar* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    FilePtr file_;
+    bool bottomUp_ = true;
+    int bytesPerPixel_ = 3;
+    int next_ = 0;               // next image row to read
+    uint64_t stride_ = 0;
+    uint64_t dataOffset_ = 0;
+    uint64_t consumed_ = 0;      // raster bytes read so far
+    std::vector<uchar> row_;
+};
+
+class PpmWriter : public RowWriter {
+public:
+    bool open(FilePtr file, int width, int height) {
+        file_ = std::move(file);
+        width_ = width;
+        row_.resize(static_cast<size_t>(width) * 3);
+        return std::fprintf(file_.get(), "P6\n%d %d\n255\n", width, height) > 0;
+    }
+
+    bool writeRows(const cv::Mat& band) override {
+        for (int y = 0; y < band.rows; ++y) {
+            const uchar* in = band.ptr<uchar>(y);
+            uchar* out = row_.data();
+            for (int x = 0; x < width_; ++x, in += 3, out += 3) {
+                out[0] = in[2];
+                out[1] = in[1];
+                out[2] = in[0];
+            }
+            if (std::fwrite(row_.data(), 1, row_.size(), file_.get()) != row_.size())
+                return false;
+        }
+        return true;
+    }
+
+    bool finish() override {
+        return std::fflush(file_.get()) == 0;
+    }
+
+private:
+    FilePtr file_;
+    int width_ = 0;
+    std::vector<uchar> row_;
+};
+
+
+#ifdef STEG_HAVE_LIBPNG
+// ==== PNG (libpng, non-interlaced) ====
+// libpng reports errors with longjmp, so every call into it sits behind a setjmp
+class PngReader : public RowReader {
+public:
+    ~PngReader() override {
+        if (png_)
+            png_destroy_read_struct(&png_, &info_, nullptr);
+    }
+
+    bool open(FilePtr file) {
+        file_ = std::move(file);
+        png_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (!png_)
+            return false;
+        info_ = png_create_info_struct(png_);
+        if (!info_)
+            return false;
+        if (setjmp(png_jmpbuf(png_)))
+            return false;
+        png_init_io(png_, file_.get());
+        png_read_info(png_, info_);
+        if (png_get_interlace_type(png_, info_) != PNG_INTERLACE_NONE)
+            return false;   // Adam7 rows only become final after the last pass
+        png_set_expand(png_);
+        png_set_strip_16(png_);
+        png_set_strip_alpha(png_);
+        png_set_gray_to_rgb(png_);
+        png_set_bgr(png_);
+        png_read_update_info(png_, info_);
+        width_ = static_cast<int>(png_get_image_width(png_, info_));
+        height_ = static_cast<int>(png_get_image_height(png_, info_));
+        return png_get_rowbytes(png_, info_) == static_cast<size_t>(width_) * 3;
+    }
+
+    bool readRows(cv::Mat& band, int rows) override {
+        band.create(rows, width_, CV_8UC3);
+        if (setjmp(png_jmpbuf(png_)))
+            return false;
+        for (int y = 0; y < rows; ++y)
+            png_read_row(png_, band.ptr<uchar>(y), nullptr);
+        return true;
+    }
+
+    uint64_t position() const override {
+        return static_cast<uint64_t>(std::max(std::ftell(file_.get()), 0L));
+    }
+
+private:
+    FilePtr file_;
+    png_structp png_ = nullptr;
+    png_infop info_ = nullptr;
+};
+
+class PngWriter : public RowWriter {
+public:
+    ~PngWriter() override {
+        if (png_)
+            png_destroy_write_struct(&png_, &info_);
+    }
+
+    bool open(FilePtr file, int width, int height, const steg::EncodeOptions& opts) {
+        file_ = std::move(file);
+        png_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (!png_)
+            return false;
+        info_ = png_create_info_struct(png_);
+        if (!info_)
+            return false;
+        if (setjmp(png_jmpbuf(png_)))
+            return false;
+        png_init_io(png_, file_.get());
+        // Unless set, the same speed-oriented level as cv::imwrite's PNG default
+        png_set_compression_level(png_, opts.pngCompression >= 0 ? std::min(opts.pngCompression, 9) : 1);
+        png_set_compression_strategy(png_, static_cast<int>(opts.pngStrategy));
+        png_set_IHDR(png_, info_, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png_, info_);
+        png_set_bgr(png_);
+        return true;
+    }
+
+    bool writeRows(const cv::Mat& band) override {
+        if (setjmp(png_jmpbuf(png_)))
+            return false;
+        for (int y = 0; y < band.rows; ++y)
+            png_write_row(png_, band.ptr<uchar>(y));
+        return true;
+    }
+
+    bool finish() override {
+        if (setjmp(png_jmpbuf(png_)))
+            return false;
+        png_write_end(png_, nullptr);
+        return std::fflush(file_.get()) == 0;
+    }
+
+private:
+    FilePtr file_;
+    png_structp png_ = nullptr;
+    png_infop info_ = nullptr;
+};
+#endif
+
+}  // namespace
+
+
+std::unique_ptr<RowReader> openRowReader(const std::string& path) {
+    FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file)
+        return nullptr;
+    unsigned char sig[8] = {};
+    size_t got = std::fread(sig, 1, sizeof(sig), file.get());
+    std::rewind(file.get());
+
+    if (got >= 2 && sig[0] == 'P' && (sig[1] == '6' || sig[1] == '5')) {
+        auto reader = std::make_unique<PnmReader>();
+        if (reader->open(std::move(file)))
+            return reader;
+        return nullptr;
+    }
+    if (got >= 2 && sig[0] == 'B' && sig[1] == 'M') {
+        auto reader = std::make_unique<BmpReader>();
+        if (reader->open(std::move(file)))
+            return reader;
+        return nullptr;
+    }
+#ifdef STEG_HAVE_LIBPNG
+    if (got == 8 && png_sig_cmp(sig, 0, 8) == 0) {
+        auto reader = std::make_unique<PngReader>();
+        if (reader->open(std::move(file)))
+            return reader;
+        return nullptr;
+    }
+#endif
+    return nullptr;
+}
+
+std::unique_ptr<RowWriter> openRowWriter(const std::string& path, int width, int height, const steg::EncodeOptions& opts) {
+    std::string ext = lowerExtension(path);
+    if (!rowWriterSupports(ext) || width <= 0 || height <= 0)
+        return nullptr;
+    FilePtr file(std::fopen(path.c_str(), "wb"));
+    if (!file)
+        return nullptr;
+    if (ext == ".ppm") {
+        auto writer = std::make_unique<PpmWriter>();
+        if (writer->open(std::move(file), width, height))
+            return writer;
+        return nullptr;
+    }
+#ifdef STEG_HAVE_LIBPNG
+    auto writer = std::make_unique<PngWriter>();
+    if (writer->open(std::move(file), width, height, opts))
+        return writer;
+#else
+    (void)opts;
+#endif
+    return nullptr;
+}
+
+bool rowWriterSupports(const std::string& ext) {
+    std::string e = lowerExtension("x" + ext);
+#ifdef STEG_HAVE_LIBPNG
+    if (e == ".png")
+        return true;
+#endif
+    return e == ".ppm";
+}
+
+
+namespace steg {
+
+int defaultBandRows(int width) {
+    const size_t bandBytes = size_t(4) << 20;
+    size_t rowBytes = static_cast<size_t>(std::max(width, 1)) * 3;
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(bandBytes / rowBytes, 1 << 16)));
+}
+
+namespace {
+
+uint64_t fileSize(const std::string& path) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<uint64_t>(size);
+}
+
+// openRowReader that also counts the file as read when statistics are collected
+std::unique_ptr<RowReader> openCounted(const std::string& path) {
+    std::unique_ptr<RowReader> reader = openRowReader(path);
+    if (reader && activeStats())
+        countBytesRead(fileSize(path));
+    return reader;
+}
+
+// ==== Header-only probes ====
+// Each gets the first bytes of the file and, for TIFF, the file itself to follow the IFD offset
+
+bool validSize(uint64_t width, uint64_t height) {
+    return width > 0 && height > 0 && width <= INT_MAX && height <= INT_MAX;
+}
+
+bool pngHeader(const uchar* p, size_t n, ImageHeader& header) {
+    static const uchar sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (n < 26 || std::memcmp(p, sig, 8) != 0 || std::memcmp(p + 12, "IHDR", 4) != 0)
+        return false;
+    auto be32 = [](const uchar* q) { return (uint32_t(q[0]) << 24) | (q[1] << 16) | (q[2] << 8) | q[3]; };
+    static const int channelsOf[7] = {1, 0, 3, 3, 2, 0, 4};   // by colour type: gray, -, RGB, palette, gray+alpha, -, RGBA
+    uint32_t width = be32(p + 16), height = be32(p + 20);
+    int colorType = p[25];
+    if (!validSize(width, height) || colorType > 6 || channelsOf[colorType] == 0)
+        return false;
+    header = {static_cast<int>(width), static_cast<int>(height), channelsOf[colorType]};
+    return true;
+}
+
+bool bmpHeader(const uchar* p, size_t n, ImageHeader& header) {
+    if (n < 26 || p[0] != 'B' || p[1] != 'M')
+        return false;
+    auto le16 = [](const uchar* q) { return static_cast<uint32_t>(q[0] | (q[1] << 8)); };
+    auto le32 = [&](const uchar* q) { return le16(q) | (le16(q + 2) << 16); };
+    uint32_t infoSize = le32(p + 14);
+    int64_t width, height;
+    uint32_t bpp;
+    if (infoSize == 12) {   // BITMAPCOREHEADER
+        width = le16(p + 18);
+        height = le16(p + 20);
+        bpp = le16(p + 24);
+    } else if (infoSize >= 40 && n >= 30) {
+        width = static_cast<int32_t>(le32(p + 18));
+        height = static_cast<int32_t>(le32(p + 22));   // negative for top-down rows
+        bpp = le16(p + 28);
+    } else {
+        return false;
+    }
+    if (height < 0)
+        height = -height;
+    if (width <= 0 || !validSize(static_cast<uint64_t>(width), static_cast<uint64_t>(height)) || bpp == 0)
+        return false;
+    header = {static_cast<int>(width), static_cast<int>(height), bpp == 32 ? 4 : 3};
+    return true;
+}
+
+// PBM/PGM/PPM in the plain or binary form: magic, width, height, whitespace and # comments between them
+bool pnmHeader(const uchar* p, size_t n, ImageHeader& header) {
+    if (n < 2 || p[0] != 'P' || p[1] < '1' || p[1] > '6')
+        return false;
+    size_t i = 2;
+    uint64_t dims[2] = {0, 0};
+    for (uint64_t& d : dims) {
+        while (i < n && (std::isspace(p[i]) || p[i] == '#')) {
+            if (p[i] == '#')
+                while (i < n && p[i] != '\n')
+                    ++i;
+            else
+                ++i;
+        }
+        if (i == n || !std::isdigit(p[i]))
+            return false;
+        for (; i < n && std::isdigit(p[i]) && d <= INT_MAX; ++i)
+            d = d * 10 + (p[i] - '0');
+    }
+    if (!validSize(dims[0], dims[1]))
+        return false;
+    header = {static_cast<int>(dims[0]), static_cast<int>(dims[1]), p[1] == '3' || p[1] == '6' ? 3 : 1};
+    return true;
+}
+
+// Classic TIFF ("II*\0" or "MM\0*") and BigTIFF (version 43); only the first IFD is read
+bool tiffHeader(std::FILE* file, const uchar* p, size_t n, ImageHeader& header) {
+    if (n < 16 || !((p[0] == 'I' && p[1] == 'I') || (p[0] == 'M' && p[1] == 'M')))
+        return false;
+    bool little = p[0] == 'I';
+    auto get = [little](const uchar* q, int bytes) {
+        uint64_t v = 0;
+        for (int k = 0; k < bytes; ++k)
+            v |= static_cast<uint64_t>(q[little ? k : bytes - 1 - k]) << (8 * k);
+        return v;
+    };
+    uint64_t version = get(p + 2, 2);
+    if (version != 42 && version != 43)
+        return false;
+    bool big = version == 43;
+    const int countBytes = big ? 8 : 2, entryBytes = big ? 20 : 12, valueBytes = big ? 8 : 4;
+    uint64_t ifd = big ? get(p + 8, 8) : get(p + 4, 4);
+    uchar buf[8];
+    if (ifd > static_cast<uint64_t>(LONG_MAX) || std::fseek(file, static_cast<long>(ifd), SEEK_SET) != 0 ||
+        std::fread(buf, 1, countBytes, file) != static_cast<size_t>(countBytes))
+        return false;
+    uint64_t entries = get(buf, countBytes);
+    if (entries == 0 || entries > 4096)
+        return false;
+    std::vector<uchar> table(entries * entryBytes);
+    if (std::fread(table.data(), 1, table.size(), file) != table.size())
+        return false;
+    uint64_t width = 0, height = 0, samples = 1;
+    for (uint64_t e = 0; e < entries; ++e) {
+        const uchar* entry = table.data() + e * entryBytes;
+        uint64_t tag = get(entry, 2), type = get(entry + 2, 2);
+        const uchar* value = entry + 4 + valueBytes;   // inline value, left-justified in the field
+        uint64_t v = type == 3 ? get(value, 2) : type == 4 ? get(value, 4) : type == 16 ? get(value, 8) : 0;
+        if (tag == 256)
+            width = v;
+        else if (tag == 257)
+            height = v;
+        else if (tag == 277)
+            samples = v;
+    }
+    if (!validSize(width, height) || samples == 0 || samples > 16)
+        return false;
+    header = {static_cast<int>(width), static_cast<int>(height), static_cast<int>(samples)};
+    return true;
+}
+
+// Calls fn(band) for consecutive bands of the reader until it returns false or the image ends.
+// With firstRows > 0 the bands start at that many rows and double up to bandRows.
+template <typename Fn>
+bool forEachBand(RowReader& reader, int bandRows, Fn&& fn, int firstRows = 0) {
+    if (bandRows <= 0)
+        bandRows = defaultBandRows(reader.width());
+    int rows = firstRows > 0 ? std::min(firstRows, bandRows) : bandRows;
+    cv::Mat band;
+    for (int y = 0; y < reader.height(); y += rows, rows = std::min(rows * 2, bandRows)) {
+        {
+            PhaseTimer timer(Phase::Decode);
+            if (!reader.readRows(band, std::min(rows, reader.height() - y)))
+                return false;
+        }
+        if (!fn(band))
+            break;
+    }
+    return true;
+}
+
+}  // namespace
+
+Status readImageHeader(const std::string& path, ImageHeader& header) {
+    FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file)
+        return Status::ImageLoadError;
+    uchar head[512];
+    size_t n = std::fread(head, 1, sizeof(head), file.get());
+    bool ok = pngHeader(head, n, header) || bmpHeader(head, n, header) || pnmHeader(head, n, header) ||
+              tiffHeader(file.get(), head, n, header);
+    return ok ? Status::Ok : Status::ImageLoadError;
+}
+
+Status readImageFile(const std::string& path, cv::Mat& image) {
+    PhaseTimer timer(Phase::Decode);
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return Status::ImageLoadError;
+    std::vector<uchar> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return decodeImage(bytes, image);
+}
+
+Status readImageFile(const std::string& path, cv::Mat& image, std::vector<uchar>& bytes) {
+    PhaseTimer timer(Phase::Decode);
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return Status::ImageLoadError;
+    std::streamoff size = in.tellg();
+    in.seekg(0);
+    bytes.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+        return Status::ImageLoadError;
+    return decodeImageInto(bytes, image);
+}
+
+Status writeImageFile(const std::string& path, const cv::Mat& image, const EncodeOptions& opts) {
+    std::vector<uchar> bytes;
+    return writeImageFile(path, image, opts, bytes);
+}
+
+Status writeImageFile(const std::string& path, const cv::Mat& image, const EncodeOptions& opts, std::vector<uchar>& bytes) {
+    Status status = encodeImage(image, lowerExtension(path), bytes, opts);
+    if (status != Status::Ok)
+        return status;
+    PhaseTimer timer(Phase::Encode);
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return out ? Status::Ok : Status::EncodeError;
+}
+
+FileEmbedResult embedFile(const std::string& coverPath, const std::string& stegoPath, const std::string& message, const EmbedOptions& opts, int bandRows) {
+    MemorySource source(message);
+    return embedFile(coverPath, stegoPath, source, opts, bandRows);
+}
+
+FileEmbedResult embedFile(const std::string& coverPath, const std::string& stegoPath, PayloadSource& source, const EmbedOptions& opts, int bandRows) {
+    FileEmbedResult res;
+    if (coverPath == stegoPath) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if (opts.scatterKey) {
+        // A scattered payload can land in any row, so the image and the message are held whole
+        cv::Mat image;
+        if ((res.status = readImageFile(coverPath, image)) != Status::Ok)
+            return res;
+        std::string message(static_cast<size_t>(source.size()), '\0');
+        if (source.read(reinterpret_cast<uint8_t*>(&message[0]), message.size()) != message.size()) {
+            res.status = Status::PayloadError;
+            return res;
+        }
+        EmbedResult emb = embed(image, message, opts);
+        res.hs = emb.hs;
+        if ((res.status = emb.status) == Status::Ok)
+            res.status = writeImageFile(stegoPath, emb.stego, opts.encode);
+        return res;
+    }
+    std::unique_ptr<RowReader> reader = openCounted(coverPath);
+    if (!reader) {
+        res.status = Status::ImageLoadError;
+        return res;
+    }
+
+    BandEmbedder embedder(source, opts);
+    CoverStats stats;
+    if (embedder.needsScan() && opts.coverCache) {
+        // Cached statistics replace the first pass, so the cover is decoded once
+        if ((res.status = cachedCoverStats(coverPath, *opts.coverCache, stats)) != Status::Ok)
+            return res;
+        embedder.setStats(stats.hist.h, stats.head.data(), stats.head.size());
+    } else if (embedder.needsScan()) {
+        bool ok = forEachBand(*reader, bandRows, [&](const cv::Mat& band) {
+            embedder.scanBand(band);
+            return true;
+        });
+        if (!ok || !(reader = openCounted(coverPath))) {
+            res.status = Status::ImageLoadError;
+            return res;
+        }
+    }
+    if ((res.status = embedder.prepare(reader->width(), reader->height())) != Status::Ok)
+        return res;
+    res.hs = embedder.hsKey();
+
+    std::unique_ptr<RowWriter> writer = openRowWriter(stegoPath, reader->width(), reader->height(), opts.encode);
+    if (!writer) {
+        res.status = Status::EncodeError;
+        return res;
+    }
+    bool written = true;
+    cv::Mat before;
+    bool read = forEachBand(*reader, bandRows, [&](cv::Mat& band) {
+        if (activeStats())
+            band.copyTo(before);
+        embedder.embedBand(band);
+        if (activeStats())
+            countPixelsChanged(changedPixels(before, band));
+        PhaseTimer timer(Phase::Encode);
+        return written = writer->writeRows(band);
+    });
+    if (!read) {
+        res.status = Status::ImageLoadError;
+    } else if (embedder.payloadFailed()) {
+        res.status = Status::PayloadError;
+    } else {
+        PhaseTimer timer(Phase::Encode);
+        if (!written || !writer->finish())
+            res.status = Status::EncodeError;
+    }
+    if (res.status != Status::Ok) {
+        writer.reset();
+        std::remove(stegoPath.c_str());
+    } else if (activeStats()) {
+        writer.reset();
+        countBytesWritten(fileSize(stegoPath));
+    }
+    return res;
+}
+
+namespace {
+
+ExtractResult extractFileTo(const std::string& stegoPath, const ExtractOptions& opts, PayloadSink* sink, int bandRows) {
+    ExtractResult res;
+    std::unique_ptr<RowReader> reader = opts.scatterKey ? nullptr : openRowReader(stegoPath);
+    if (!reader) {
+        cv::Mat stego;
+        if ((res.status = readImageFile(stegoPath, stego)) != Status::Ok)
+            return res;
+        res = extract(stego, opts);
+        if (sink && res.status == Status::Ok) {
+            if (!sink->write(reinterpret_cast<const uint8_t*>(res.message.data()), res.message.size()) || !sink->finish())
+                res.status = Status::PayloadError;
+            res.message.clear();
+        }
+        return res;
+    }
+    BandExtractor extractor(opts, reader->width(), reader->height(), sink);
+    bool read = forEachBand(*reader, bandRows, [&](const cv::Mat& band) { return extractor.extractBand(band); },
+                            bandRows > 0 ? 0 : 1);
+    // Only the part of the file up to the last decoded row has been read
+    countBytesRead(reader->position());
+    if (!read) {
+        res.status = Status::ImageLoadError;
+        return res;
+    }
+    return extractor.finish();
+}
+
+}  // namespace
+
+ExtractResult extractFile(const std::string& stegoPath, const ExtractOptions& opts, int bandRows) {
+    return extractFileTo(stegoPath, opts, nullptr, bandRows);
+}
+
+ExtractResult extractFile(const std::string& stegoPath, const ExtractOptions& opts, PayloadSink& sink, int bandRows) {
+    return extractFileTo(stegoPath, opts, &sink, bandRows);
+}
+
+CapacityResult capacityFile(const std::string& coverPath, Method method, int q, int bandRows, int bitsPerChannel) {
+    EmbedOptions opts;
+    opts.method = method;
+    opts.q = q;
+    opts.bitsPerChannel = bitsPerChannel;
+    return capacityFile(coverPath, opts, bandRows);
+}
+
+CapacityResult capacityFile(const std::string& coverPath, const EmbedOptions& opts, int bandRows) {
+    CapacityResult res;
+    if (!validEmbedOptions(opts)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if (opts.method == Method::HS && opts.coverCache) {
+        CoverStats stats;
+        if ((res.status = cachedCoverStats(coverPath, *opts.coverCache, stats)) != Status::Ok)
+            return res;
+        return capacity(stats, opts);
+    }
+    BandEmbedder embedder(std::string(), opts);
+    if (!embedder.needsScan()) {
+        ImageHeader header;
+        if (readImageHeader(coverPath, header) == Status::Ok) {
+            res.maxBytes = embedder.capacityBytes(header.width, header.height);
+            return res;
+        }
+    }
+    std::unique_ptr<RowReader> reader = openCounted(coverPath);
+    if (!reader) {
+        // Neither the header nor the rows can be read directly; fall back to the image decoder
+        cv::Mat cover;
+        if ((res.status = readImageFile(coverPath, cover)) != Status::Ok)
+            return res;
+        return capacity(cover, opts);
+    }
+    if (embedder.needsScan()) {
+        bool ok = forEachBand(*reader, bandRows, [&](const cv::Mat& band) {
+            embedder.scanBand(band);
+            return true;
+        });
+        if (!ok) {
+            res.status = Status::ImageLoadError;
+            return res;
+        }
+    }
+    res.maxBytes = embedder.capacityBytes(reader->width(), reader->height());
+    return res;
+}
+
+std::vector<CapacityResult> capacityFiles(const std::vector<std::string>& coverPaths, const EmbedOptions& opts, int threads) {
+    std::vector<CapacityResult> results(coverPaths.size());
+    if (threads <= 0)
+        threads = threadCount();
+    int workers = static_cast<int>(std::min<size_t>(std::max(threads, 1), std::max<size_t>(coverPaths.size(), 1)));
+    // Header queries are short and I/O bound, so each worker takes the next unclaimed path
+    std::atomic<size_t> next{0};
+    parallelForBands(workers, workers, [&](int, int, int) {
+        for (size_t i; (i = next.fetch_add(1)) < coverPaths.size();)
+            results[i] = capacityFile(coverPaths[i], opts);
+    });
+    return results;
+}
+
+}  // namespace steg
@@ -0,0 +1,257 @@
+#ifndef STEGO_BAND_IO_HPP
+#define STEGO_BAND_IO_HPP
+
+#include "stego_api.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file band_io.hpp
+ * \brief Row-band image file I/O and file-to-file embedding with bounded memory
+ */
+
+
+
+/**
+ * \brief Sequential reader that decodes an image file a few rows at a time
+ */
+class RowReader {
+public:
+    virtual ~RowReader() = default;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * \brief Decodes the next rows
+     * \param band Output rows (rows x width, CV_8UC3, BGR); its buffer is reused between calls
+     * \param rows Number of rows to read, at most the number of rows left
+     * \return false on a read or decode error
+     */
+    virtual bool readRows(cv::Mat& band, int rows) = 0;
+
+    /**
+     * \brief Bytes of the file consumed so far
+     */
+    virtual uint64_t position() const = 0;
+
+protected:
+    int width_ = 0;
+    int height_ = 0;
+};
+
+/**
+ * \brief Sequential writer that encodes an image file a few rows at a time
+ */
+class RowWriter {
+public:
+    virtual ~RowWriter() = default;
+
+    /**
+     * \brief Encodes the next rows
+     * \param band Rows to write (CV_8UC3, BGR) of the width given on open
+     * \return false on a write error
+     */
+    virtual bool writeRows(const cv::Mat& band) = 0;
+
+    /**
+     * \brief Completes the file after the last row
+     * \return false on a write error
+     */
+    virtual bool finish() = 0;
+};
+
+/**
+ * \brief Opens an image for row-band reading; the format is detected from the file signature
+ *
+ * Supported: binary PPM/PGM (8-bit), uncompressed 24/32-bit BMP and, when built with libpng,
+ * non-interlaced PNG.
+ * \param path Image file
+ * \return Reader, or nullptr if the file cannot be opened or its format cannot be streamed
+ */
+std::unique_ptr<RowReader> openRowReader(const std::string& path);
+
+/**
+ * \brief Creates an image for row-band writing; the format is chosen by the extension (.ppm or .png)
+ * \param path Output file
+ * \param width Image width in pixels
+ * \param height Image height in pixels
+ * \param opts PNG compression level and strategy (default level 1)
+ * \return Writer, or nullptr if the file cannot be created or the format cannot be streamed
+ */
+std::unique_ptr<RowWriter> openRowWriter(const std::string& path, int width, int height, const steg::EncodeOptions& opts = steg::EncodeOptions());
+
+/**
+ * \brief Whether openRowWriter supports an extension
+ * \param ext Extension with the leading dot, e.g. ".png"
+ */
+bool rowWriterSupports(const std::string& ext);
+
+
+namespace steg {
+
+/**
+ * \brief Reads and decodes a whole image file, like cv::imread with IMREAD_COLOR
+ * \param path Image file
+ * \param image Decoded image (CV_8UC3)
+ * \return Ok or ImageLoadError
+ */
+Status readImageFile(const std::string& path, cv::Mat& image);
+
+/**
+ * \brief Encodes an image in the format given by the file extension and writes it, like cv::imwrite
+ * \param path Output file; lossy formats such as .jpg are refused
+ * \param image Image to write
+ * \param opts Encoder settings
+ * \return Ok, LossyFormat or EncodeError
+ */
+Status writeImageFile(const std::string& path, const cv::Mat& image, const EncodeOptions& opts = EncodeOptions());
+
+/**
+ * \brief readImageFile that keeps the caller's buffers from one image to the next
+ * \param path Image file
+ * \param image Decoded image (CV_8UC3); decoded into its memory when the size matches, see decodeImageInto
+ * \param bytes Buffer for the encoded file
+ * \return Ok or ImageLoadError
+ */
+Status readImageFile(const std::string& path, cv::Mat& image, std::vector<uchar>& bytes);
+
+/**
+ * \brief writeImageFile that encodes into the caller's buffer
+ * \param path Output file; lossy formats such as .jpg are refused
+ * \param image Image to write
+ * \param opts Encoder settings
+ * \param bytes Buffer for the encoded file
+ * \return Ok, LossyFormat or EncodeError
+ */
+Status writeImageFile(const std::string& path, const cv::Mat& image, const EncodeOptions& opts, std::vector<uchar>& bytes);
+
+/**
+ * \brief Image properties read from the container header
+ */
+struct ImageHeader {
+    int width = 0;
+    int height = 0;
+    int channels = 0;   ///< Samples per pixel as stored; the decoder always expands them to three
+};
+
+/**
+ * \brief Reads the dimensions and channel count of an image file without decoding its pixels
+ *
+ * Only the PNG IHDR chunk, the BMP header, the PPM/PGM/PBM header or the first TIFF IFD (classic
+ * or BigTIFF) is read, so the cost is a few hundred bytes of I/O whatever the image size.
+ * \param path Image file
+ * \param header Output properties
+ * \return Ok, or ImageLoadError if the file cannot be read or is in another format
+ */
+Status readImageHeader(const std::string& path, ImageHeader& header);
+
+/**
+ * \brief Result of file-to-file embedding
+ */
+struct FileEmbedResult {
+    Status status = Status::Ok;
+    HSKey hs;   ///< Peak/zero points chosen by Histogram Shifting (unused by other methods)
+};
+
+/**
+ * \brief Number of rows per band that keeps one band of the given width at about 4 MiB
+ * \param width Image width in pixels
+ */
+int defaultBandRows(int width);
+
+/**
+ * \brief Embeds a message while streaming the cover file into the stego file band by band
+ *
+ * Peak memory is a band of rows plus the codec state, independent of the image size.
+ * Histogram Shifting reads the cover twice (statistics pass, then embedding pass), or once
+ * when opts.coverCache supplies the statistics.
+ * With opts.scatterKey the image is read and embedded whole, in any lossless output format.
+ * \param coverPath Cover image file
+ * \param stegoPath Output file, .png or .ppm; must differ from coverPath
+ * \param message The message to embed
+ * \param opts Method, its parameters and PNG encoder settings (opts.ext is ignored)
+ * \param bandRows Rows per band, 0 for defaultBandRows
+ * \return Status and the Histogram Shifting key
+ */
+FileEmbedResult embedFile(const std::string& coverPath, const std::string& stegoPath, const std::string& message, const EmbedOptions& opts, int bandRows = 0);
+
+/**
+ * \brief Embeds a message read from a source while streaming the cover file band by band
+ *
+ * LSB, PM1 and QIM pull the message from the source as the bands need it, so memory does not
+ * grow with the message; Histogram Shifting and scattered payloads read it whole.
+ * \param coverPath Cover image file
+ * \param stegoPath Output file, .png or .ppm; must differ from coverPath
+ * \param source The message; PayloadError if it ends before its size
+ * \param opts Method, its parameters and PNG encoder settings (opts.ext is ignored)
+ * \param bandRows Rows per band, 0 for defaultBandRows
+ * \return Status and the Histogram Shifting key
+ */
+FileEmbedResult embedFile(const std::string& coverPath, const std::string& stegoPath, PayloadSource& source, const EmbedOptions& opts, int bandRows = 0);
+
+/**
+ * \brief Extracts a message while streaming the stego file band by band, stopping once the message is complete
+ *
+ * Decoding stops with the band that completes the message, so for a short payload only the
+ * first rows of the file are read. With bandRows 0 the bands start at one row and double up to
+ * defaultBandRows, which keeps the rows decoded within twice the rows the payload occupies.
+ * Formats openRowReader cannot stream, and scattered payloads, are decoded whole.
+ * \param stegoPath Stego image file
+ * \param opts Method and its parameters
+ * \param bandRows Rows per band, 0 for growing bands
+ * \return Extracted message and status
+ */
+ExtractResult extractFile(const std::string& stegoPath, const ExtractOptions& opts, int bandRows = 0);
+
+/**
+ * \brief Extracts a message into a sink while streaming the stego file band by band
+ *
+ * LSB, PM1 and QIM write each chunk of the message as soon as it is complete; Histogram
+ * Shifting and whole-image decoding write it at the end. The result's message stays empty.
+ * On a failure the sink may already hold part of the message.
+ * \param stegoPath Stego image file
+ * \param opts Method and its parameters
+ * \param sink Destination of the message; PayloadError if a write fails
+ * \param bandRows Rows per band, 0 for growing bands
+ * \return Status
+ */
+ExtractResult extractFile(const std::string& stegoPath, const ExtractOptions& opts, PayloadSink& sink, int bandRows = 0);
+
+/**
+ * \brief Maximum framed message length for a cover file; only Histogram Shifting decodes the pixels
+ *
+ * LSB, PM1 and QIM need only the dimensions, which come from readImageHeader; formats it does
+ * not know are decoded whole. With opts.coverCache, Histogram Shifting reuses cached statistics.
+ * \param coverPath Cover image file
+ * \param method Steganography method
+ * \param q Quantization step size (QIM only)
+ * \param bandRows Rows per band, 0 for defaultBandRows
+ * \param bitsPerChannel Message bits per sample (LSB and PM1 only)
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityFile(const std::string& coverPath, Method method, int q = 4, int bandRows = 0, int bitsPerChannel = 1);
+
+/**
+ * \brief Maximum message length for a cover file in the layout selected by embedding options
+ * \param coverPath Cover image file
+ * \param opts Embedding options; the message-independent ones are used
+ * \param bandRows Rows per band, 0 for defaultBandRows
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityFile(const std::string& coverPath, const EmbedOptions& opts, int bandRows = 0);
+
+/**
+ * \brief Capacities of many cover files, computed concurrently
+ * \param coverPaths Cover image files
+ * \param opts Embedding options; the message-independent ones are used
+ * \param threads Files processed at once, 0 for threadCount()
+ * \return One result per path, in the order of coverPaths
+ */
+std::vector<CapacityResult> capacityFiles(const std::vector<std::string>& coverPaths, const EmbedOptions& opts, int threads = 0);
+
+}  // namespace steg
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef STEGO_BITSTREAM_HPP
+#define STEGO_BITSTREAM_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+
+/**
+ * \file bitstream.hpp
+ * \brief Packed MSB-first bit reader and writer used by every embedding method
+ *
+ * A payload is kept as the raw message bytes: bit i of the stream is bit (7 - i % 8)
+ * of byte i / 8, the same order messageToBits produces. Readers and writers move
+ * whole 64-bit words between the buffer and a register, so no per-bit allocation happens.
+ */
+
+
+
+/**
+ * \brief Reverses the byte order of a 64-bit word (big-endian loads and stores on little-endian hosts)
+ */
+inline uint64_t byteSwap64(uint64_t w) {
+#if defined(_MSC_VER)
+    return _byteswap_uint64(w);
+#else
+    return __builtin_bswap64(w);
+#endif
+}
+
+
+/**
+ * \brief Reads bits MSB-first from a packed byte buffer
+ */
+class BitReader {
+public:
+    /**
+     * \brief Creates a reader over a byte buffer
+     * \param data Packed payload bytes
+     * \param nbits Number of valid bits in the buffer
+     */
+    BitReader(const uint8_t* data, uint64_t nbits)
+        : data_(data), end_(data + (nbits + 7) / 8), next_(data), nbits_(nbits) {}
+
+    /**
+     * \brief Creates a reader over all bits of a string
+     * \param bytes Packed payload bytes
+     */
+    explicit BitReader(const std::string& bytes)
+        : BitReader(reinterpret_cast<const uint8_t*>(bytes.data()), static_cast<uint64_t>(bytes.size()) * 8) {}
+
+    /**
+     * \brief Number of bits not read yet
+     */
+    uint64_t remaining() const { return nbits_ - pos_; }
+
+    /**
+     * \brief Number of bits already read
+     */
+    uint64_t position() const { return pos_; }
+
+    /**
+     * \brief Reads one bit; past the end of the buffer returns 0
+     */
+    bool readBit() {
+        if (avail_ == 0)
+            refill();
+        bool bit = (cur_ >> 63) != 0;
+        cur_ <<= 1;
+        --avail_;
+        ++pos_;
+        return bit;
+    }
+
+    /**
+     * \brief Reads n bits (1..56) as an unsigned number, first bit in the most significant position
+     */
+    uint64_t readBits(unsigned n) {
+        if (avail_ < n)
+            refill();
+        uint64_t v = cur_ >> (64 - n);
+        cur_ <<= n;
+        avail_ -= n;
+        pos_ += n;
+        return v;
+    }
+
+    /**
+     * \brief Pointer to the underlying buffer
+     */
+    const uint8_t* data() const { return data_; }
+
+private:
+    void refill() {
+        if (end_ - next_ >= 8) {
+            // Branch-free refill: OR in the next word and advance by the whole bytes consumed
+            uint64_t w;
+            std::memcpy(&w, next_, 8);
+            cur_ |= byteSwap64(w) >> avail_;
+            next_ += (63 - avail_) >> 3;
+            avail_ |= 56;
+        } else {
+            while (avail_ <= 56 && next_ < end_) {
+                cur_ |= static_cast<uint64_t>(*next_++) << (56 - avail_);
+                avail_ += 8;
+            }
+            if (next_ == end_)
+                avail_ = 64;   // buffer exhausted: everything after the last byte reads as zero
+        }
+    }
+
+    const uint8_t* data_;
+    const uint8_t* end_;
+    const uint8_t* next_;
+    uint64_t nbits_;
+    uint64_t pos_ = 0;
+    uint64_t cur_ = 0;
+    unsigned avail_ = 0;
+};
+
+
+/**
+ * \brief Appends bits MSB-first to a packed byte string
+ */
+class BitWriter {
+public:
+    /**
+     * \brief Creates a writer appending to a string
+     * \param out Output buffer; only complete bytes are appended
+     */
+    explicit BitWriter(std::string& out) : out_(out) {}
+
+    ~BitWriter() { flush(); }
+
+    BitWriter(const BitWriter&) = delete;
+    BitWriter& operator=(const BitWriter&) = delete;
+
+    /**
+     * \brief Appends one bit
+     */
+    void writeBit(bool bit) {
+        acc_ |= static_cast<uint64_t>(bit) << (63 - n_);
+        if (++n_ == 64)
+            spill();
+    }
+
+    /**
+     * \brief Appends the n (1..56) low bits of v, most significant first
+     */
+    void writeBits(uint64_t v, unsigned n) {
+        if (n_ + n > 64)
+            spill();
+        acc_ |= (v << (64 - n)) >> n_;
+        n_ += n;
+        if (n_ == 64)
+            spill();   // writeBit relies on a free bit in the accumulator
+    }
+
+    /**
+     * \brief Total number of bits written
+     */
+    uint64_t bitCount() const { return written_ + n_; }
+
+    /**
+     * \brief Moves all complete bytes into the output; a trailing partial byte stays pending
+     */
+    void flush() { spill(); }
+
+private:
+    void spill() {
+        unsigned bytes = n_ / 8;
+        if (bytes == 0)
+            return;
+        uint64_t be = byteSwap64(acc_);
+        out_.append(reinterpret_cast<const char*>(&be), bytes);
+        acc_ = bytes == 8 ? 0 : acc_ << (bytes * 8);
+        n_ -= bytes * 8;
+        written_ += bytes * 8;
+    }
+
+    std::string& out_;
+    uint64_t acc_ = 0;
+    unsigned n_ = 0;
+    uint64_t written_ = 0;
+};
+
+/**
+ * \brief Appends the first nbits bits of a packed MSB-first buffer to a writer
+ */
+inline void appendBits(BitWriter& out, const uint8_t* data, uint64_t nbits) {
+    BitReader in(data, nbits);
+    while (in.remaining() >= 32)
+        out.writeBits(in.readBits(32), 32);
+    while (in.remaining() > 0)
+        out.writeBit(in.readBit());
+}
+
+#endif
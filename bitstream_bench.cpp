@@ -0,0 +1,115 @@
+#include "stego_api.hpp"
+#include "bitstream.hpp"
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+/**
+ * \file
+ * \brief Microbenchmark of payload conversion throughput (bit vectors vs packed bit streams)
+ *
+ * Usage: bitstream_bench [payload MiB]
+ */
+
+
+
+namespace {
+
+volatile uint64_t g_sink = 0;
+
+std::vector<bool> legacyMessageToBits(const std::string& message) {
+    std::vector<bool> bits;
+    for (char c : message) {
+        std::bitset<8> b(static_cast<unsigned char>(c));
+        for (int i = 7; i >= 0; --i)
+            bits.push_back(b[i]);
+    }
+    return bits;
+}
+
+std::string legacyBitsToMessage(const std::vector<bool>& bits) {
+    std::string message;
+    for (size_t i = 0; i + 7 < bits.size(); i += 8) {
+        std::bitset<8> b;
+        for (int j = 0; j < 8; ++j)
+            b[7 - j] = bits[i + j];
+        message += static_cast<char>(b.to_ulong());
+    }
+    return message;
+}
+
+void report(const char* name, size_t bytes, const std::function<void()>& fn) {
+    fn();   // warm-up
+    const int reps = 3;
+    double best = 1e30;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    std::printf("%-34s %9.3f GB/s  (%8.2f ms)\n", name, bytes / best / 1e9, best * 1e3);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    size_t size = mib << 20;
+    std::string payload(size, '\0');
+    uint64_t s = 0x9E3779B97F4A7C15ull;
+    for (char& c : payload) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        c = static_cast<char>(s);
+    }
+    std::vector<bool> bits = messageToBits(payload);
+
+    std::printf("payload: %zu MiB\n", mib);
+    report("legacy messageToBits", size, [&] { g_sink += legacyMessageToBits(payload).size(); });
+    report("legacy bitsToMessage", size, [&] { g_sink += legacyBitsToMessage(bits).size(); });
+    report("messageToBits (wrapper)", size, [&] { g_sink += messageToBits(payload).size(); });
+    report("bitsToMessage (wrapper)", size, [&] { g_sink += bitsToMessage(bits).size(); });
+    report("BitReader::readBit", size, [&] {
+        BitReader r(payload);
+        uint64_t acc = 0;
+        while (r.remaining() > 0)
+            acc += r.readBit();
+        g_sink += acc;
+    });
+    report("BitReader::readBits(8)", size, [&] {
+        BitReader r(payload);
+        uint64_t acc = 0;
+        while (r.remaining() >= 8)
+            acc += r.readBits(8);
+        g_sink += acc;
+    });
+    report("BitReader::readBits(56)", size, [&] {
+        BitReader r(payload);
+        uint64_t acc = 0;
+        while (r.remaining() >= 56)
+            acc ^= r.readBits(56);
+        g_sink += acc;
+    });
+    report("BitWriter::writeBit", size, [&] {
+        std::string out;
+        out.reserve(size);
+        BitWriter w(out);
+        for (size_t i = 0; i < size * 8; ++i)
+            w.writeBit(i & 1);
+        w.flush();
+        g_sink += out.size();
+    });
+    report("BitWriter::writeBits(56)", size, [&] {
+        std::string out;
+        out.reserve(size);
+        BitWriter w(out);
+        BitReader r(payload);
+        while (r.remaining() >= 56)
+            w.writeBits(r.readBits(56), 56);
+        w.flush();
+        g_sink += out.size();
+    });
+    return 0;
+}
@@ -0,0 +1,784 @@
+#include "cli.hpp"
+#include "stego_api.hpp"
+#include "band_io.hpp"
+#include "cover_cache.hpp"
+#include "daemon.hpp"
+#include "instrument.hpp"
+#include "json.hpp"
+#include "matrix_kernels.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+/**
+ * \file
+ * \brief File, where the batch command-line mode is realised
+ */
+
+
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* kUsage =
+    "Использование:\n"
+    "  project_steg embed    --method M (--in ФАЙЛ|КАТАЛОГ | --manifest ФАЙЛ) --out КАТАЛОГ\n"
+    "                        (--message ТЕКСТ | --payload-file ФАЙЛ|-) [--q N] [--ext .png]\n"
+    "  project_steg extract  --method M (--in ... | --manifest ...) [--q N] [--out КАТАЛОГ]\n"
+    "                        [--raw --length N [--hs Pr/Zr,Pg/Zg,Pb/Zb]]\n"
+    "  project_steg capacity --method M (--in ... | --manifest ...) [--q N]\n"
+    "  project_steg serve    (--socket ПУТЬ | --stdio) [--jobs N] [--threads N]\n"
+    "                        сервер запросов embed/extract/capacity с изображением в самом запросе\n"
+    "                        (формат кадров описан в daemon.hpp)\n"
+    "Общие параметры:\n"
+    "  --method lsb|hs|qim|pm1   метод\n"
+    "  --jobs N                  число одновременно обрабатываемых файлов\n"
+    "  --threads N               потоков на один файл (по умолчанию ядра / jobs)\n"
+    "  --decode-threads N        потоков чтения и декодирования обложек (embed без --stream)\n"
+    "  --embed-threads N         потоков встраивания (embed без --stream)\n"
+    "  --encode-threads N        потоков кодирования и записи результата (embed без --stream);\n"
+    "                            стадии работают конвейером над разными файлами, по умолчанию\n"
+    "                            --jobs делится между ними 1:1:2; с --stats последняя строка -\n"
+    "                            {\"pipeline\":...} с занятостью каждой стадии\n"
+    "  --stream                  embed и capacity полосами строк с ограниченной памятью (PPM, PNG, BMP)\n"
+    "  --band-rows N             строк в полосе (по умолчанию около 4 МиБ, у extract растут от одной строки)\n"
+    "  --raw                     без заголовка (старый формат: длину и P/Z задаёт пользователь)\n"
+    "  --seed N                  зерно случайного потока PM1 (одинаковый результат при любом --threads)\n"
+    "  --scatter-key N           рассеять сообщение по изображению в порядке, заданном ключом (lsb, qim, pm1)\n"
+    "  --bits K                  бит сообщения на канал, 1..4 (lsb, pm1); в заголовке, extract читает его сам\n"
+    "  --matrix K                матричное встраивание (lsb, pm1): K бит на группу из 2^K-1 каналов, 2..7;\n"
+    "                            меньше изменённых пикселей на бит; в заголовке, extract читает его сам\n"
+    "  --hs-pairs N              пар пик/ноль на канал, 1..4 (hs); в заголовке, extract читает их сам\n"
+    "  --compress lz4|none       сжать сообщение перед встраиванием (не с --raw): меньше каналов и времени\n"
+    "                            для текста и JSON; кодек в заголовке, extract распаковывает сам\n"
+    "  --stats                   добавить в результат время по фазам и счётчики (поле stats)\n"
+    "  --cache                   кэш гистограмм и вместимости обложек рядом с ними (файл.stgc);\n"
+    "                            hs: capacity и embed не сканируют обложку повторно\n"
+    "  --cache-dir КАТАЛОГ       то же, но записи кэша хранятся в КАТАЛОГЕ\n"
+    "Параметры вывода embed (только форматы без потерь: png, bmp, ppm, pam, tiff):\n"
+    "  --png-level 0..9          уровень сжатия PNG (0 - без сжатия)\n"
+    "  --png-strategy S          default|filtered|huffman|rle|fixed\n"
+    "  --tiff-uncompressed       TIFF без сжатия\n"
+    "Строка манифеста: путь[\\tключ=значение...], ключи: payload, length, hs\n"
+    "Сообщение - любые байты; --payload-file - читает его из stdin. С --stream embed читает файл\n"
+    "сообщения по частям, а extract --out пишет его по частям (lsb, qim, pm1).\n"
+    "extract всегда декодирует только строки, занятые сообщением (PPM, PNG, BMP).\n"
+    "Результат: одна строка JSON на файл в stdout. extract без --out кладёт сообщение в поле message,\n"
+    "а если оно не текст UTF-8 - в поле message_base64 (base64).\n"
+    "Без команды (или только с --stats) запускается диалоговый режим.\n";
+
+struct Options {
+    std::string command;
+    Method method = Method::LSB;
+    bool haveMethod = false;
+    std::string in, manifest, out, payloadFile, message, ext = ".png";
+    bool haveMessage = false;
+    int q = 4;
+    int jobs = 0;
+    int threads = 0;
+    int decodeThreads = 0;
+    int embedThreads = 0;
+    int encodeThreads = 0;
+    bool stream = false;
+    bool raw = false;
+    bool stats = false;
+    steg::EncodeOptions encode;
+    std::optional<uint64_t> seed;
+    std::optional<uint64_t> scatterKey;
+    int bits = 1;
+    int matrix = 0;
+    steg::Codec codec = steg::Codec::None;
+    int hsPairs = 1;
+    int bandRows = 0;
+    std::optional<std::string> cache;
+    size_t length = 0;
+    bool haveLength = false;
+    steg::HSKey hs;
+    bool haveHS = false;
+};
+
+struct Job {
+    std::string path;
+    std::map<std::string, std::string> params;
+};
+
+bool parsePngStrategy(const std::string& name, steg::PngStrategy& strategy) {
+    static const std::pair<const char*, steg::PngStrategy> names[] = {
+        {"default", steg::PngStrategy::Default}, {"filtered", steg::PngStrategy::Filtered},
+        {"huffman", steg::PngStrategy::HuffmanOnly}, {"rle", steg::PngStrategy::Rle},
+        {"fixed", steg::PngStrategy::Fixed}};
+    for (const auto& n : names) {
+        if (name == n.first) {
+            strategy = n.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readFile(const std::string& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    data = oss.str();
+    return true;
+}
+
+// Reads a whole payload source; false if it cannot be opened or ends early
+bool readSource(std::unique_ptr<steg::PayloadSource> source, std::string& data) {
+    if (!source)
+        return false;
+    data.assign(static_cast<size_t>(source->size()), '\0');
+    return source->read(reinterpret_cast<uint8_t*>(&data[0]), data.size()) == data.size();
+}
+
+bool isImageFile(const fs::path& p) {
+    static const char* exts[] = {".png", ".bmp", ".tif", ".tiff", ".ppm", ".pgm", ".pnm", ".pam", ".jpg", ".jpeg", ".webp"};
+    std::string e = p.extension().string();
+    std::transform(e.begin(), e.end(), e.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return std::find(std::begin(exts), std::end(exts), e) != std::end(exts);
+}
+
+bool parseArgs(int argc, char** argv, Options& opt, std::string& error) {
+    if (argc < 2) {
+        error = "не указана команда";
+        return false;
+    }
+    opt.command = argv[1];
+    if (opt.command != "embed" && opt.command != "extract" && opt.command != "capacity") {
+        error = "неизвестная команда: " + opt.command;
+        return false;
+    }
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](std::string& dst) {
+            if (i + 1 >= argc) {
+                error = "нет значения для " + arg;
+                return false;
+            }
+            dst = argv[++i];
+            return true;
+        };
+        std::string v;
+        if (arg == "--method") {
+            if (!value(v)) return false;
+            if (!steg::parseMethod(v, opt.method)) {
+                error = "неизвестный метод: " + v;
+                return false;
+            }
+            opt.haveMethod = true;
+        } else if (arg == "--in") {
+            if (!value(opt.in)) return false;
+        } else if (arg == "--manifest") {
+            if (!value(opt.manifest)) return false;
+        } else if (arg == "--out") {
+            if (!value(opt.out)) return false;
+        } else if (arg == "--payload-file") {
+            if (!value(opt.payloadFile)) return false;
+        } else if (arg == "--message") {
+            if (!value(opt.message)) return false;
+            opt.haveMessage = true;
+        } else if (arg == "--ext") {
+            if (!value(opt.ext)) return false;
+            if (opt.ext.empty() || opt.ext[0] != '.')
+                opt.ext = "." + opt.ext;
+        } else if (arg == "--q") {
+            if (!value(v)) return false;
+            opt.q = std::atoi(v.c_str());
+        } else if (arg == "--jobs") {
+            if (!value(v)) return false;
+            opt.jobs = std::atoi(v.c_str());
+        } else if (arg == "--threads") {
+            if (!value(v)) return false;
+            opt.threads = std::atoi(v.c_str());
+        } else if (arg == "--decode-threads") {
+            if (!value(v)) return false;
+            opt.decodeThreads = std::atoi(v.c_str());
+        } else if (arg == "--embed-threads") {
+            if (!value(v)) return false;
+            opt.embedThreads = std::atoi(v.c_str());
+        } else if (arg == "--encode-threads") {
+            if (!value(v)) return false;
+            opt.encodeThreads = std::atoi(v.c_str());
+        } else if (arg == "--raw") {
+            opt.raw = true;
+        } else if (arg == "--stream") {
+            opt.stream = true;
+        } else if (arg == "--stats") {
+            opt.stats = true;
+        } else if (arg == "--cache") {
+            if (!opt.cache)
+                opt.cache = std::string();
+        } else if (arg == "--cache-dir") {
+            if (!value(v)) return false;
+            opt.cache = v;
+        } else if (arg == "--png-level") {
+            if (!value(v)) return false;
+            opt.encode.pngCompression = std::atoi(v.c_str());
+            if (opt.encode.pngCompression < 0 || opt.encode.pngCompression > 9) {
+                error = "--png-level должен быть от 0 до 9";
+                return false;
+            }
+        } else if (arg == "--png-strategy") {
+            if (!value(v)) return false;
+            if (!parsePngStrategy(v, opt.encode.pngStrategy)) {
+                error = "неизвестная стратегия PNG: " + v;
+                return false;
+            }
+        } else if (arg == "--tiff-uncompressed") {
+            opt.encode.tiffCompression = false;
+        } else if (arg == "--seed") {
+            if (!value(v)) return false;
+            opt.seed = std::strtoull(v.c_str(), nullptr, 10);
+        } else if (arg == "--scatter-key") {
+            if (!value(v)) return false;
+            opt.scatterKey = std::strtoull(v.c_str(), nullptr, 10);
+        } else if (arg == "--bits") {
+            if (!value(v)) return false;
+            opt.bits = std::atoi(v.c_str());
+            if (opt.bits < 1 || opt.bits > 4) {
+                error = "--bits должен быть от 1 до 4";
+                return false;
+            }
+        } else if (arg == "--matrix") {
+            if (!value(v)) return false;
+            opt.matrix = std::atoi(v.c_str());
+            if (opt.matrix < 2 || opt.matrix > kMaxMatrixBits) {
+                error = "--matrix должен быть от 2 до " + std::to_string(kMaxMatrixBits);
+                return false;
+            }
+        } else if (arg == "--compress") {
+            if (!value(v)) return false;
+            if (!steg::parseCodec(v, opt.codec)) {
+                error = "неизвестный кодек: " + v + " (lz4 или none)";
+                return false;
+            }
+        } else if (arg == "--hs-pairs") {
+            if (!value(v)) return false;
+            opt.hsPairs = std::atoi(v.c_str());
+            if (opt.hsPairs < 1 || opt.hsPairs > steg::kMaxHSPairs) {
+                error = "--hs-pairs должен быть от 1 до " + std::to_string(steg::kMaxHSPairs);
+                return false;
+            }
+        } else if (arg == "--band-rows") {
+            if (!value(v)) return false;
+            opt.bandRows = std::atoi(v.c_str());
+        } else if (arg == "--length") {
+            if (!value(v)) return false;
+            opt.length = static_cast<size_t>(std::strtoull(v.c_str(), nullptr, 10));
+            opt.haveLength = true;
+        } else if (arg == "--hs") {
+            if (!value(v)) return false;
+            if (!steg::parseHSKey(v, opt.hs)) {
+                error = "неверный формат --hs (ожидается Pr/Zr,Pg/Zg,Pb/Zb, пары канала через +)";
+                return false;
+            }
+            opt.haveHS = true;
+        } else {
+            error = "неизвестный параметр: " + arg;
+            return false;
+        }
+    }
+    if (!opt.haveMethod) {
+        error = "не указан --method";
+        return false;
+    }
+    if (opt.in.empty() == opt.manifest.empty()) {
+        error = "нужно указать ровно один из --in или --manifest";
+        return false;
+    }
+    if (opt.command == "embed" && !steg::isLosslessFormat(opt.ext)) {
+        error = steg::statusMessage(steg::Status::LossyFormat);
+        return false;
+    }
+    if (opt.scatterKey && opt.method == Method::HS) {
+        error = "--scatter-key не поддерживается методом hs";
+        return false;
+    }
+    if (opt.bits > 1 && opt.method != Method::LSB && opt.method != Method::PM1) {
+        error = "--bits больше 1 поддерживается только методами lsb и pm1";
+        return false;
+    }
+    if (opt.matrix > 0 && ((opt.method != Method::LSB && opt.method != Method::PM1) || opt.bits > 1)) {
+        error = "--matrix поддерживается только методами lsb и pm1 с одним битом на канал";
+        return false;
+    }
+    if (opt.codec != steg::Codec::None && opt.raw) {
+        error = "--compress требует заголовка и несовместим с --raw";
+        return false;
+    }
+    if (opt.hsPairs > 1 && opt.method != Method::HS) {
+        error = "--hs-pairs поддерживается только методом hs";
+        return false;
+    }
+    if (opt.stream && opt.command == "embed" && !rowWriterSupports(opt.ext)) {
+        error = "режим --stream не поддерживает формат " + opt.ext;
+        return false;
+    }
+    if (opt.command == "embed") {
+        if (opt.out.empty()) {
+            error = "для embed нужен --out";
+            return false;
+        }
+        if (opt.haveMessage == !opt.payloadFile.empty() && opt.manifest.empty()) {
+            error = "для embed нужен ровно один из --message или --payload-file";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseServeArgs(int argc, char** argv, DaemonOptions& opt, std::string& error) {
+    bool stdio = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stdio") {
+            stdio = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "нет значения для " + arg;
+            return false;
+        }
+        std::string v = argv[++i];
+        if (arg == "--socket") {
+            opt.socketPath = v;
+        } else if (arg == "--jobs") {
+            opt.jobs = std::atoi(v.c_str());
+        } else if (arg == "--threads") {
+            opt.threads = std::atoi(v.c_str());
+        } else {
+            error = "неизвестный параметр: " + arg;
+            return false;
+        }
+    }
+    if (stdio == !opt.socketPath.empty()) {
+        error = "для serve нужен ровно один из --socket или --stdio";
+        return false;
+    }
+    return true;
+}
+
+bool collectJobs(const Options& opt, std::vector<Job>& jobs, std::string& error) {
+    if (!opt.manifest.empty()) {
+        std::ifstream in(opt.manifest);
+        if (!in) {
+            error = "не удалось открыть манифест: " + opt.manifest;
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+            Job job;
+            std::istringstream fields(line);
+            std::string field;
+            std::getline(fields, job.path, '\t');
+            while (std::getline(fields, field, '\t')) {
+                size_t eq = field.find('=');
+                if (eq != std::string::npos)
+                    job.params[field.substr(0, eq)] = field.substr(eq + 1);
+            }
+            jobs.push_back(std::move(job));
+        }
+        return true;
+    }
+    std::error_code ec;
+    if (fs::is_directory(opt.in, ec)) {
+        for (const fs::directory_entry& e : fs::directory_iterator(opt.in, ec))
+            if (e.is_regular_file() && isImageFile(e.path()))
+                jobs.push_back({e.path().string(), {}});
+        std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.path < b.path; });
+        if (ec) {
+            error = "не удалось прочитать каталог: " + opt.in;
+            return false;
+        }
+        return true;
+    }
+    jobs.push_back({opt.in, {}});
+    return true;
+}
+
+// A file on its way through the embed pipeline; the buffers stay with the slot for the next file
+struct EmbedSlot {
+    const Job* job = nullptr;
+    std::chrono::steady_clock::time_point t0;
+    JsonObject line;
+    steg::Status status = steg::Status::Ok;
+    std::string error;
+    steg::Stats stats;
+    std::string perJob;
+    const std::string* payload = nullptr;
+    steg::HSKey hs;
+    std::vector<uchar> bytes;   // encoded cover, then encoded stego
+    cv::Mat image;              // cover, embedded in place
+    bool cached = false;        // cover statistics come from the cache
+    steg::CoverStats cover;
+};
+
+class BatchRunner {
+public:
+    explicit BatchRunner(const Options& opt) : opt_(opt) {}
+
+    bool prepare(std::string& error) {
+        if (opt_.command == "embed") {
+            if (opt_.haveMessage) {
+                payload_ = opt_.message;
+            } else if (opt_.payloadFile == "-") {
+                // Every job embeds the same bytes, so standard input is read once
+                if (!readSource(steg::openPayloadFd(0), payload_)) {
+                    error = "не удалось прочитать сообщение из stdin";
+                    return false;
+                }
+            } else if (!opt_.payloadFile.empty() && !opt_.stream && !readFile(opt_.payloadFile, payload_)) {
+                error = "не удалось прочитать файл сообщения: " + opt_.payloadFile;
+                return false;
+            }
+        }
+        if (!opt_.out.empty()) {
+            std::error_code ec;
+            fs::create_directories(opt_.out, ec);
+            if (ec) {
+                error = "не удалось создать каталог: " + opt_.out;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void run(const Job& job) {
+        auto t0 = std::chrono::steady_clock::now();
+        JsonObject line = startLine(job);
+        std::string error;
+        steg::Status status = steg::Status::Ok;
+        steg::Stats stats;
+        std::optional<steg::StatsScope> scope;
+        if (opt_.stats)
+            scope.emplace(stats);
+        try {
+            if (opt_.command == "embed")
+                status = embed(job, line, error);
+            else if (opt_.command == "extract")
+                status = extract(job, line, error);
+            else
+                status = capacity(job, line);
+        } catch (const std::exception& e) {
+            status = steg::Status::InvalidParameter;
+            error = e.what();
+        }
+        scope.reset();
+        report(line, status, error, stats, t0);
+    }
+
+    // Embedding without --stream: decoding, embedding and encoding are stages with threads of
+    // their own, so one file is decoded while others are embedded and encoded
+    void runPipeline(const std::vector<Job>& jobs, int decodeThreads, int embedThreads, int encodeThreads) {
+        std::vector<EmbedSlot> slots;
+        Pipeline pipeline;
+        pipeline.addStage("decode", decodeThreads, [&](size_t i) { runStage(slots[i], &BatchRunner::decodeStage); });
+        pipeline.addStage("embed", embedThreads, [&](size_t i) { runStage(slots[i], &BatchRunner::embedStage); });
+        pipeline.addStage("encode", encodeThreads, [&](size_t i) {
+            EmbedSlot& slot = slots[i];
+            runStage(slot, &BatchRunner::encodeStage);
+            report(slot.line, slot.status, slot.error, slot.stats, slot.t0);
+        });
+        slots.resize(pipeline.slots());
+        size_t next = 0;
+        pipeline.run([&](size_t i) {
+            if (next == jobs.size())
+                return false;
+            EmbedSlot& slot = slots[i];
+            slot.job = &jobs[next++];
+            slot.t0 = std::chrono::steady_clock::now();
+            slot.line = startLine(*slot.job);
+            slot.status = steg::Status::Ok;
+            slot.error.clear();
+            slot.stats = steg::Stats();
+            slot.payload = &payload_;
+            return true;
+        });
+        if (opt_.stats) {
+            JsonObject line;
+            line.addRaw("pipeline", pipeline.statsJson());
+            print(line);
+        }
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    JsonObject startLine(const Job& job) const {
+        JsonObject line;
+        line.add("file", job.path).add("command", opt_.command).add("method", steg::methodName(opt_.method));
+        return line;
+    }
+
+    void report(JsonObject& line, steg::Status status, std::string error, const steg::Stats& stats,
+                std::chrono::steady_clock::time_point t0) {
+        if (status != steg::Status::Ok && error.empty())
+            error = steg::statusMessage(status);
+        line.add("status", steg::statusName(status));
+        if (!error.empty())
+            line.add("error", error);
+        line.add("ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        if (opt_.stats)
+            line.addRaw("stats", steg::statsJson(stats));
+        if (status != steg::Status::Ok)
+            failed_ = true;
+        print(line);
+    }
+
+    void print(const JsonObject& line) {
+        std::lock_guard<std::mutex> lock(outMutex_);
+        std::cout << line.str() << '\n' << std::flush;
+    }
+
+    // Runs a stage of the slot's file unless an earlier one failed; the file's statistics collect
+    // the phases of all three stages
+    void runStage(EmbedSlot& slot, steg::Status (BatchRunner::*stage)(EmbedSlot&)) {
+        if (slot.status != steg::Status::Ok)
+            return;
+        std::optional<steg::StatsScope> scope;
+        if (opt_.stats)
+            scope.emplace(slot.stats);
+        try {
+            slot.status = (this->*stage)(slot);
+        } catch (const std::exception& e) {
+            slot.status = steg::Status::InvalidParameter;
+            slot.error = e.what();
+        }
+    }
+
+    steg::Status decodeStage(EmbedSlot& slot) {
+        auto it = slot.job->params.find("payload");
+        if (it != slot.job->params.end()) {
+            if (!readFile(it->second, slot.perJob)) {
+                slot.error = "не удалось прочитать файл сообщения: " + it->second;
+                return steg::Status::InvalidParameter;
+            }
+            slot.payload = &slot.perJob;
+        }
+        // Cached statistics replace the Histogram Shifting pass over the cover, as in embedFile
+        slot.cached = opt_.cache && opt_.method == Method::HS;
+        if (slot.cached) {
+            steg::Status status = steg::cachedCoverStats(slot.job->path, *opt_.cache, slot.cover);
+            if (status != steg::Status::Ok)
+                return status;
+        }
+        return steg::readImageFile(slot.job->path, slot.image, slot.bytes);
+    }
+
+    steg::Status embedStage(EmbedSlot& slot) {
+        steg::EmbedResult res = slot.cached ? steg::embedInPlace(slot.image, *slot.payload, embedOptions(), slot.cover)
+                                            : steg::embedInPlace(slot.image, *slot.payload, embedOptions());
+        slot.hs = res.hs;
+        return res.status;
+    }
+
+    steg::Status encodeStage(EmbedSlot& slot) {
+        fs::path outPath = outputPath(*slot.job);
+        steg::Status status = steg::writeImageFile(outPath.string(), slot.image, opt_.encode, slot.bytes);
+        if (status != steg::Status::Ok)
+            return status;
+        slot.line.add("output", outPath.string()).add("payload_bytes", static_cast<uint64_t>(slot.payload->size()));
+        if (opt_.method == Method::HS)
+            slot.line.add("hs", steg::formatHSKey(slot.hs));
+        return steg::Status::Ok;
+    }
+
+    steg::EmbedOptions embedOptions() const {
+        steg::EmbedOptions eopts;
+        eopts.method = opt_.method;
+        eopts.q = opt_.q;
+        eopts.framed = !opt_.raw;
+        eopts.encode = opt_.encode;
+        eopts.seed = opt_.seed;
+        eopts.scatterKey = opt_.scatterKey;
+        eopts.bitsPerChannel = opt_.bits;
+        eopts.matrixBits = opt_.matrix;
+        eopts.codec = opt_.codec;
+        eopts.hsPairs = opt_.hsPairs;
+        eopts.coverCache = opt_.cache;
+        return eopts;
+    }
+
+    fs::path outputPath(const Job& job) const {
+        fs::path outPath = fs::path(opt_.out) / fs::path(job.path).stem();
+        outPath += opt_.ext;
+        return outPath;
+    }
+
+    // Embedding with --stream; otherwise files go through runPipeline
+    steg::Status embed(const Job& job, JsonObject& line, std::string& error) {
+        auto it = job.params.find("payload");
+        // A payload file is read as the bands need it rather than whole
+        std::string payloadPath = it != job.params.end() ? it->second : opt_.payloadFile == "-" ? std::string() : opt_.payloadFile;
+        std::unique_ptr<steg::PayloadSource> source;
+        if (!payloadPath.empty() && !(source = steg::openPayloadFile(payloadPath))) {
+            error = "не удалось прочитать файл сообщения: " + payloadPath;
+            return steg::Status::InvalidParameter;
+        }
+        steg::EmbedOptions eopts = embedOptions();
+        fs::path outPath = outputPath(job);
+        uint64_t payloadBytes = source ? source->size() : payload_.size();
+        steg::FileEmbedResult res = source ? steg::embedFile(job.path, outPath.string(), *source, eopts, opt_.bandRows)
+                                           : steg::embedFile(job.path, outPath.string(), payload_, eopts, opt_.bandRows);
+        if (res.status != steg::Status::Ok)
+            return res.status;
+        line.add("output", outPath.string()).add("payload_bytes", payloadBytes);
+        if (opt_.method == Method::HS)
+            line.add("hs", steg::formatHSKey(res.hs));
+        return steg::Status::Ok;
+    }
+
+    steg::Status extract(const Job& job, JsonObject& line, std::string& error) {
+        steg::ExtractOptions xopts;
+        xopts.method = opt_.method;
+        xopts.q = opt_.q;
+        xopts.msgLen = opt_.length;
+        xopts.hs = opt_.hs;
+        xopts.framed = !opt_.raw;
+        xopts.scatterKey = opt_.scatterKey;
+        xopts.bitsPerChannel = opt_.bits;
+        xopts.matrixBits = opt_.matrix;
+        auto it = job.params.find("length");
+        if (it != job.params.end())
+            xopts.msgLen = static_cast<size_t>(std::strtoull(it->second.c_str(), nullptr, 10));
+        it = job.params.find("hs");
+        if (it != job.params.end() && !steg::parseHSKey(it->second, xopts.hs)) {
+            error = "неверный формат hs";
+            return steg::Status::InvalidParameter;
+        }
+        // Decodes only the rows the message occupies; formats that cannot be streamed are read whole
+        if (opt_.out.empty()) {
+            steg::ExtractResult res = steg::extractFile(job.path, xopts, opt_.bandRows);
+            if (res.status != steg::Status::Ok)
+                return res.status;
+            line.add("payload_bytes", static_cast<uint64_t>(res.message.size())).addBytes("message", res.message);
+            return steg::Status::Ok;
+        }
+        // The message goes to the file chunk by chunk as it is recovered
+        fs::path outPath = fs::path(opt_.out) / fs::path(job.path).stem();
+        outPath += ".bin";
+        std::unique_ptr<steg::PayloadSink> sink = steg::createPayloadFile(outPath.string());
+        if (!sink) {
+            error = "не удалось записать " + outPath.string();
+            return steg::Status::EncodeError;
+        }
+        steg::ExtractResult res = steg::extractFile(job.path, xopts, *sink, opt_.bandRows);
+        sink.reset();
+        if (res.status != steg::Status::Ok) {
+            std::error_code ec;
+            fs::remove(outPath, ec);
+            if (res.status == steg::Status::PayloadError)
+                error = "не удалось записать " + outPath.string();
+            return res.status;
+        }
+        std::error_code ec;
+        line.add("payload_bytes", static_cast<uint64_t>(fs::file_size(outPath, ec))).add("output", outPath.string());
+        return steg::Status::Ok;
+    }
+
+    steg::Status capacity(const Job& job, JsonObject& line) {
+        steg::CapacityResult res;
+        // LSB, PM1 and QIM need only the dimensions, which capacityFile reads from the header
+        if (opt_.stream || opt_.method != Method::HS || opt_.cache) {
+            res = steg::capacityFile(job.path, capacityOptions(), opt_.bandRows);
+        } else {
+            cv::Mat cover;
+            if ((res.status = steg::readImageFile(job.path, cover)) != steg::Status::Ok)
+                return res.status;
+            res = steg::capacity(cover, capacityOptions());
+        }
+        if (res.status == steg::Status::Ok)
+            line.add("capacity_bytes", res.maxBytes);
+        return res.status;
+    }
+
+    // The options that decide the layout, and with it the capacity
+    steg::EmbedOptions capacityOptions() const {
+        steg::EmbedOptions eopts;
+        eopts.method = opt_.method;
+        eopts.q = opt_.q;
+        eopts.bitsPerChannel = opt_.bits;
+        eopts.matrixBits = opt_.matrix;
+        eopts.hsPairs = opt_.hsPairs;
+        eopts.coverCache = opt_.cache;
+        return eopts;
+    }
+
+    const Options& opt_;
+    std::string payload_;
+    std::mutex outMutex_;
+    std::atomic<bool> failed_{false};
+};
+
+}  // namespace
+
+int runCli(int argc, char** argv) {
+    Options opt;
+    std::string error;
+    if (argc >= 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h")) {
+        std::cout << kUsage;
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "serve") {
+        DaemonOptions dopts;
+        if (!parseServeArgs(argc, argv, dopts, error)) {
+            std::cerr << "Ошибка: " << error << "\n" << kUsage;
+            return 2;
+        }
+        return runDaemon(dopts);
+    }
+    if (!parseArgs(argc, argv, opt, error)) {
+        std::cerr << "Ошибка: " << error << "\n" << kUsage;
+        return 2;
+    }
+    std::vector<Job> jobs;
+    if (!collectJobs(opt, jobs, error)) {
+        std::cerr << "Ошибка: " << error << "\n";
+        return 2;
+    }
+    BatchRunner runner(opt);
+    if (!runner.prepare(error)) {
+        std::cerr << "Ошибка: " << error << "\n";
+        return 2;
+    }
+
+    int hw = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int workers = opt.jobs > 0 ? opt.jobs : hw;
+    workers = std::max(1, std::min<int>(workers, static_cast<int>(jobs.size())));
+    // Files in flight already keep the cores busy, so each one gets its share of the kernel threads
+    setThreadCount(opt.threads > 0 ? opt.threads : std::max(1, hw / workers));
+
+    if (opt.command == "embed" && !opt.stream) {
+        // Encoding is the slowest stage (deflate for PNG), so by default it gets half of the workers
+        int decodeThreads = opt.decodeThreads > 0 ? opt.decodeThreads : std::max(1, workers / 4);
+        int embedThreads = opt.embedThreads > 0 ? opt.embedThreads : std::max(1, workers / 4);
+        int encodeThreads = opt.encodeThreads > 0 ? opt.encodeThreads : std::max(1, workers - workers / 4 * 2);
+        runner.runPipeline(jobs, decodeThreads, embedThreads, encodeThreads);
+    } else {
+        ThreadPool pool(workers, static_cast<size_t>(workers) * 2);
+        for (const Job& job : jobs)
+            pool.submit([&runner, &job] { runner.run(job); });
+        pool.wait();
+    }
+    return runner.failed() ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#ifndef STEGO_CLI_HPP
+#define STEGO_CLI_HPP
+
+
+/**
+ * \file cli.hpp
+ * \brief Non-interactive command-line mode of project_steg (batch processing on a worker pool)
+ */
+
+
+
+/**
+ * \brief Runs project_steg in command-line mode
+ *
+ * project_steg embed|extract|capacity --method lsb|hs|qim|pm1 (--in file|dir | --manifest file) [options]
+ * Every processed file produces one JSON line on stdout.
+ * \param argc Argument count as passed to main
+ * \param argv Argument vector as passed to main
+ * \return 0 if every file succeeded, 1 if any failed, 2 on a usage error
+ */
+int runCli(int argc, char** argv);
+
+#endif
@@ -0,0 +1,410 @@
+#include "cover_cache.hpp"
+#include "band_io.hpp"
+#include "histogram.hpp"
+#include "instrument.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+/**
+ * \file
+ * \brief File, where the cover statistics cache is realised
+ */
+
+
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Entry layout: magic, version, then LEB128 varints (size, mtime, content hash, width, height,
+// 768 histogram bins, head length and bytes, the HS keys as bytes with their peak counts and
+// capacities, the LSB/PM1/QIM capacities) and a fixed 8-byte checksum of everything before it
+const char kMagic[4] = {'S', 'G', 'C', 'S'};
+const uint8_t kVersion = 1;
+
+uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+uint64_t load64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; --k)
+        v = (v << 8) | p[k];
+    return v;
+}
+
+// Four independent multiply-rotate lanes over 32-byte blocks, so the loop is not one long
+// dependency chain; `seed` chains the chunks of a file
+uint64_t hashBytes(const uint8_t* p, size_t n, uint64_t seed) {
+    const uint64_t m1 = 0x9E3779B97F4A7C15ull, m2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t lane[4] = {seed ^ m1, seed + m2, ~seed, seed * m1};
+    size_t blocks = n / 32;
+    for (size_t b = 0; b < blocks; ++b, p += 32) {
+        for (int k = 0; k < 4; ++k) {
+            uint64_t v = lane[k] ^ (load64(p + 8 * k) * m2);
+            lane[k] = ((v << 31) | (v >> 33)) * m1;
+        }
+    }
+    uint8_t tail[32] = {};
+    std::memcpy(tail, p, n % 32);
+    uint64_t h = mix64(n);
+    for (int k = 0; k < 4; ++k)
+        h = mix64(h ^ lane[k] ^ load64(tail + 8 * k));
+    return h;
+}
+
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+// Bounds-checked cursor over an entry; any read past the end clears `ok`
+struct EntryReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) {
+                ok = false;
+                return 0;
+            }
+            uint8_t b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    uint8_t byte() {
+        if (p == end) {
+            ok = false;
+            return 0;
+        }
+        return *p++;
+    }
+};
+
+// Identity of the cover file that makes an entry valid without hashing it again
+struct FileStamp {
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+};
+
+bool stampFile(const std::string& path, FileStamp& stamp) {
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+    auto time = fs::last_write_time(path, ec);
+    if (ec)
+        return false;
+    stamp.size = static_cast<uint64_t>(size);
+    stamp.mtime = static_cast<uint64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+std::string encodeEntry(const FileStamp& stamp, uint64_t contentHash, const steg::CoverStats& s) {
+    std::string out(kMagic, sizeof(kMagic));
+    out += static_cast<char>(kVersion);
+    putVarint(out, stamp.size);
+    putVarint(out, stamp.mtime);
+    putVarint(out, contentHash);
+    putVarint(out, static_cast<uint64_t>(s.width));
+    putVarint(out, static_cast<uint64_t>(s.height));
+    for (int c = 0; c < 3; ++c)
+        for (int v = 0; v < 256; ++v)
+            putVarint(out, s.hist.h[c][v]);
+    putVarint(out, s.head.size());
+    out.append(s.head.begin(), s.head.end());
+    for (int p = 0; p < steg::kMaxHSPairs; ++p) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i <= p; ++i) {
+                int P, Z;
+                steg::hsPair(s.hs[p], c, i, P, Z);
+                out += static_cast<char>(P);
+                out += static_cast<char>(Z);
+            }
+            putVarint(out, s.peakCount[p][c]);
+        }
+        putVarint(out, s.capacityHS[p]);
+    }
+    putVarint(out, s.capacityLSB);
+    putVarint(out, s.capacityPM1);
+    putVarint(out, s.capacityQIM);
+    uint64_t sum = hashBytes(reinterpret_cast<const uint8_t*>(out.data()), out.size(), 0);
+    for (int k = 0; k < 8; ++k)
+        out += static_cast<char>((sum >> (8 * k)) & 0xFF);
+    return out;
+}
+
+bool decodeEntry(const std::string& bytes, FileStamp& stamp, uint64_t& contentHash, steg::CoverStats& s) {
+    if (bytes.size() < sizeof(kMagic) + 1 + 8 || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0 ||
+        static_cast<uint8_t>(bytes[sizeof(kMagic)]) != kVersion)
+        return false;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(bytes.data());
+    size_t body = bytes.size() - 8;
+    if (hashBytes(data, body, 0) != load64(data + body))
+        return false;
+    EntryReader in{data + sizeof(kMagic) + 1, data + body};
+    stamp.size = in.varint();
+    stamp.mtime = in.varint();
+    contentHash = in.varint();
+    s.width = static_cast<int>(in.varint());
+    s.height = static_cast<int>(in.varint());
+    for (int c = 0; c < 3; ++c)
+        for (int v = 0; v < 256; ++v)
+            s.hist.h[c][v] = in.varint();
+    uint64_t headSize = in.varint();
+    if (!in.ok || headSize > static_cast<uint64_t>(in.end - in.p))
+        return false;
+    s.head.assign(in.p, in.p + headSize);
+    in.p += headSize;
+    for (int p = 0; p < steg::kMaxHSPairs; ++p) {
+        steg::HSKey& key = s.hs[p];
+        key = steg::HSKey();
+        key.pairs = p + 1;
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i <= p; ++i) {
+                int P = in.byte(), Z = in.byte();
+                if (i == 0) {
+                    key.P[c] = P;
+                    key.Z[c] = Z;
+                } else {
+                    key.moreP[c][i - 1] = P;
+                    key.moreZ[c][i - 1] = Z;
+                }
+            }
+            s.peakCount[p][c] = in.varint();
+        }
+        s.capacityHS[p] = in.varint();
+    }
+    s.capacityLSB = in.varint();
+    s.capacityPM1 = in.varint();
+    s.capacityQIM = in.varint();
+    return in.ok && in.p == in.end && s.width > 0 && s.height > 0;
+}
+
+bool readWhole(const std::string& path, std::string& bytes) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Writes a temporary file next to the entry and renames it over the entry, which is atomic,
+// so a concurrent reader never sees a partial entry
+void storeEntry(const std::string& entryPath, const std::string& bytes) {
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+    std::string tmp = entryPath + ".tmp" + std::to_string(rng());
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out) {
+            out.close();
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, entryPath, ec);
+    if (ec)
+        std::remove(tmp.c_str());
+}
+
+// Fills the keys, peak counts and capacities of the default layouts from hist and head
+void deriveStats(steg::CoverStats& s) {
+    using namespace steg;
+    for (int p = 0; p < kMaxHSPairs; ++p) {
+        // The pixels whose LSBs carry the framed header are not carriers, as in BandEmbedder
+        size_t reserved = std::min(s.head.size(), (headerSize(Method::HS, p + 1) * 8 + 2) / 3 * 3);
+        ChannelHistograms carriers = s.hist;
+        for (size_t i = 0; i < reserved; ++i)
+            --carriers.h[i % 3][s.head[i]];
+        chooseHSPairs(carriers, p + 1, s.hs[p], s.peakCount[p]);
+        EmbedOptions opts;
+        opts.method = Method::HS;
+        opts.hsPairs = p + 1;
+        s.capacityHS[p] = capacity(s, opts).maxBytes;
+    }
+    EmbedOptions opts;
+    opts.method = Method::LSB;
+    s.capacityLSB = capacity(s, opts).maxBytes;
+    opts.method = Method::PM1;
+    s.capacityPM1 = capacity(s, opts).maxBytes;
+    opts.method = Method::QIM;
+    s.capacityQIM = capacity(s, opts).maxBytes;
+}
+
+}  // namespace
+
+
+namespace steg {
+
+bool hashFileContent(const std::string& path, uint64_t& hash) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    std::vector<uint8_t> buf(size_t(1) << 20);   // a multiple of the 32-byte block
+    uint64_t h = 0;
+    size_t n;
+    while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0)
+        h = hashBytes(buf.data(), n, h);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    hash = h;
+    return ok;
+}
+
+Status computeCoverStats(const std::string& path, CoverStats& stats) {
+    stats = CoverStats();
+    size_t headSamples = coverHeadSamples();
+    auto addBand = [&](const cv::Mat& band) {
+        PhaseTimer timer(Phase::Histogram);
+        uint64_t hist[3][256];
+        buildHistograms(band, hist);
+        for (int c = 0; c < 3; ++c)
+            for (int v = 0; v < 256; ++v)
+                stats.hist.h[c][v] += hist[c][v];
+        for (int y = 0; y < band.rows && stats.head.size() < headSamples; ++y) {
+            const uchar* row = band.ptr<uchar>(y);
+            size_t n = std::min(headSamples - stats.head.size(), static_cast<size_t>(band.cols) * 3);
+            stats.head.insert(stats.head.end(), row, row + n);
+        }
+    };
+
+    std::unique_ptr<RowReader> reader = openRowReader(path);
+    if (activeStats()) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(path, ec);
+        countBytesRead(ec ? 0 : static_cast<uint64_t>(size));
+    }
+    if (reader) {
+        stats.width = reader->width();
+        stats.height = reader->height();
+        int bandRows = defaultBandRows(stats.width);
+        cv::Mat band;
+        for (int y = 0; y < stats.height; y += bandRows) {
+            {
+                PhaseTimer timer(Phase::Decode);
+                if (!reader->readRows(band, std::min(bandRows, stats.height - y)))
+                    return Status::ImageLoadError;
+            }
+            addBand(band);
+        }
+    } else {
+        cv::Mat image;
+        Status status = readImageFile(path, image);
+        if (status != Status::Ok)
+            return status;
+        stats.width = image.cols;
+        stats.height = image.rows;
+        addBand(image);
+    }
+    deriveStats(stats);
+    return Status::Ok;
+}
+
+std::string coverCachePath(const std::string& coverPath, const std::string& cacheDir) {
+    if (cacheDir.empty())
+        return coverPath + ".stgc";
+    std::error_code ec;
+    std::string key = fs::absolute(coverPath, ec).lexically_normal().string();
+    uint64_t h = hashBytes(reinterpret_cast<const uint8_t*>(key.data()), key.size(), 0);
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    return (fs::path(cacheDir) / (fs::path(coverPath).filename().string() + "-" + hex + ".stgc")).string();
+}
+
+Status cachedCoverStats(const std::string& coverPath, const std::string& cacheDir, CoverStats& stats, bool* hit) {
+    if (hit)
+        *hit = false;
+    FileStamp stamp;
+    if (!stampFile(coverPath, stamp))
+        return Status::ImageLoadError;
+    std::string entryPath = coverCachePath(coverPath, cacheDir);
+    std::string bytes;
+    FileStamp cached;
+    uint64_t cachedHash = 0;
+    bool have = readWhole(entryPath, bytes) && decodeEntry(bytes, cached, cachedHash, stats);
+    if (have && cached.size == stamp.size && cached.mtime == stamp.mtime) {
+        if (hit)
+            *hit = true;
+        return Status::Ok;
+    }
+
+    // The stamp changed (a copy, a touch or a new image): the content decides
+    uint64_t contentHash;
+    if (!hashFileContent(coverPath, contentHash))
+        return Status::ImageLoadError;
+    if (have && cached.size == stamp.size && cachedHash == contentHash) {
+        if (hit)
+            *hit = true;
+    } else {
+        Status status = computeCoverStats(coverPath, stats);
+        if (status != Status::Ok)
+            return status;
+    }
+    if (!cacheDir.empty()) {
+        std::error_code ec;
+        fs::create_directories(cacheDir, ec);
+    }
+    storeEntry(entryPath, encodeEntry(stamp, contentHash, stats));
+    return Status::Ok;
+}
+
+CapacityResult capacity(const CoverStats& stats, const EmbedOptions& opts) {
+    CapacityResult res;
+    if (!validEmbedOptions(opts)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    BandEmbedder embedder(std::string(), opts);
+    if (embedder.needsScan())
+        embedder.setStats(stats.hist.h, stats.head.data(), stats.head.size());
+    res.maxBytes = embedder.capacityBytes(stats.width, stats.height);
+    return res;
+}
+
+EmbedResult embedInPlace(cv::Mat& image, const std::string& message, const EmbedOptions& opts, const CoverStats& stats) {
+    BandEmbedder embedder(message, opts);
+    if (!embedder.needsScan() || opts.scatterKey)
+        return embedInPlace(image, message, opts);
+    EmbedResult res;
+    if (image.empty() || image.type() != CV_8UC3) {
+        res.status = image.empty() ? Status::ImageLoadError : Status::InvalidImage;
+        return res;
+    }
+    if (image.cols != stats.width || image.rows != stats.height) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    embedder.setStats(stats.hist.h, stats.head.data(), stats.head.size());
+    if ((res.status = embedder.prepare(image.cols, image.rows)) != Status::Ok)
+        return res;
+    // The comparison needs the cover, which embedding overwrites
+    cv::Mat cover = activeStats() ? image.clone() : cv::Mat();
+    embedder.embedBand(image);
+    if (activeStats())
+        countPixelsChanged(changedPixels(cover, image));
+    res.stego = image;
+    res.hs = embedder.hsKey();
+    return res;
+}
+
+}  // namespace steg
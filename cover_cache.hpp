@@ -0,0 +1,104 @@
+#ifndef STEGO_COVER_CACHE_HPP
+#define STEGO_COVER_CACHE_HPP
+
+#include "hs_engine.hpp"
+#include "stego_api.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file cover_cache.hpp
+ * \brief Persistent cache of cover statistics (histograms, P/Z, capacities)
+ *
+ * One small binary file per cover, either next to it (`<cover>.stgc`) or in a cache directory,
+ * named after the cover's absolute path. An entry records the cover's size, modification time
+ * and a content hash: when the size and time still match, a lookup is one stat and one small
+ * read; otherwise the file is hashed and the entry is reused if the content is unchanged.
+ * Only a miss decodes the pixels.
+ *
+ * Entries are written to a temporary file and renamed into place, so any number of processes
+ * may share a cache: readers see either a complete old entry or a complete new one, and a
+ * checksum rejects anything else. Concurrent writers of one entry store identical data.
+ */
+
+
+
+namespace steg {
+
+/**
+ * \brief Statistics of a cover image
+ *
+ * The HS keys, peak counts and capacities are those of the framed layout with one bit per
+ * sample, the defaults of embedding; other layouts are computed from hist and head.
+ */
+struct CoverStats {
+    int width = 0;
+    int height = 0;
+    ChannelHistograms hist;                ///< B, G and R histograms of every sample
+    std::vector<uint8_t> head;             ///< First coverHeadSamples() samples in raster order
+    HSKey hs[kMaxHSPairs];                 ///< Histogram Shifting key with 1..kMaxHSPairs pairs per channel
+    uint64_t peakCount[kMaxHSPairs][3] = {};   ///< Carrier samples of each channel for those keys
+    uint64_t capacityHS[kMaxHSPairs] = {};     ///< Histogram Shifting capacity in bytes, by pairs - 1
+    uint64_t capacityLSB = 0;
+    uint64_t capacityPM1 = 0;
+    uint64_t capacityQIM = 0;              ///< Independent of q
+};
+
+/**
+ * \brief Fast non-cryptographic hash of a file's content
+ * \param path File
+ * \param hash Output hash
+ * \return false if the file cannot be read
+ */
+bool hashFileContent(const std::string& path, uint64_t& hash);
+
+/**
+ * \brief Decodes a cover and computes its statistics, streaming PPM, PNG and BMP by row bands
+ * \param path Cover image file
+ * \param stats Output statistics
+ * \return Ok or ImageLoadError
+ */
+Status computeCoverStats(const std::string& path, CoverStats& stats);
+
+/**
+ * \brief Cache entry file of a cover
+ * \param coverPath Cover image file
+ * \param cacheDir Cache directory, empty for a sidecar next to the cover
+ */
+std::string coverCachePath(const std::string& coverPath, const std::string& cacheDir);
+
+/**
+ * \brief Statistics of a cover from the cache, computing and storing them on a miss
+ * \param coverPath Cover image file
+ * \param cacheDir Cache directory (created if missing), empty for a sidecar next to the cover
+ * \param stats Output statistics
+ * \param hit Optional output: whether the entry was reused
+ * \return Ok or ImageLoadError; an entry that cannot be written is not an error
+ */
+Status cachedCoverStats(const std::string& coverPath, const std::string& cacheDir, CoverStats& stats, bool* hit = nullptr);
+
+/**
+ * \brief Maximum message length for a cover with known statistics
+ * \param stats Cover statistics
+ * \param opts Embedding options; the message-independent ones are used
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacity(const CoverStats& stats, const EmbedOptions& opts);
+
+/**
+ * \brief embedInPlace() with the Histogram Shifting statistics pass replaced by known statistics
+ *
+ * Methods without that pass ignore stats and embed as embedInPlace() does.
+ * \param image Cover image (CV_8UC3), the stego image on return; left unchanged on failure
+ * \param message The message to embed
+ * \param opts Method and its parameters
+ * \param stats Statistics of this very cover; other dimensions give InvalidParameter
+ * \return Status and HS key; stego refers to image
+ */
+EmbedResult embedInPlace(cv::Mat& image, const std::string& message, const EmbedOptions& opts, const CoverStats& stats);
+
+}  // namespace steg
+
+#endif
@@ -0,0 +1,51 @@
+#include "cpu_dispatch.hpp"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+
+/**
+ * \file
+ * \brief File, where runtime instruction set selection is realised
+ */
+
+
+
+namespace {
+
+std::atomic<int> g_level{-1};
+
+}  // namespace
+
+SimdLevel detectedSimdLevel() {
+#ifdef STEG_X86
+    if (cv::checkHardwareSupport(CV_CPU_AVX2))
+        return SimdLevel::AVX2;
+    if (cv::checkHardwareSupport(CV_CPU_SSE2))
+        return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+SimdLevel activeSimdLevel() {
+    int level = g_level.load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = static_cast<int>(detectedSimdLevel());
+        g_level.store(level, std::memory_order_relaxed);
+    }
+    return static_cast<SimdLevel>(level);
+}
+
+void setSimdLevel(SimdLevel level) {
+    SimdLevel best = detectedSimdLevel();
+    if (static_cast<int>(level) > static_cast<int>(best))
+        level = best;
+    g_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE2:   return "sse2";
+        case SimdLevel::AVX2:   return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,50 @@
+#ifndef STEGO_CPU_DISPATCH_HPP
+#define STEGO_CPU_DISPATCH_HPP
+
+
+/**
+ * \file cpu_dispatch.hpp
+ * \brief Runtime selection of the instruction set used by the pixel kernels
+ */
+
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define STEG_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define STEG_TARGET_SSE2
+#define STEG_TARGET_AVX2
+#else
+#define STEG_TARGET_SSE2 __attribute__((target("sse2")))
+#define STEG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+/**
+ * \brief Instruction set levels the kernels are specialised for
+ */
+enum class SimdLevel { Scalar = 0, SSE2 = 1, AVX2 = 2 };
+
+/**
+ * \brief Best level supported by the running CPU
+ */
+SimdLevel detectedSimdLevel();
+
+/**
+ * \brief Level the kernels currently dispatch to
+ */
+SimdLevel activeSimdLevel();
+
+/**
+ * \brief Forces a level (e.g. for tests and benchmarks); clamped to detectedSimdLevel()
+ * \param level Requested level
+ */
+void setSimdLevel(SimdLevel level);
+
+/**
+ * \brief Printable name of a level
+ */
+const char* simdLevelName(SimdLevel level);
+
+#endif
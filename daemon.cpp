@@ -0,0 +1,511 @@
+#include "daemon.hpp"
+#include "stego_api.hpp"
+#include "json.hpp"
+#include "parallel.hpp"
+#include "thread_pool.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the request server and its wire format are realised
+ */
+
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Longest request line and largest inline image or payload accepted
+const size_t kMaxLine = 4096;
+const uint64_t kMaxBytes = uint64_t(1) << 31;
+
+long readSome(int fd, void* buf, size_t n) {
+#ifdef _WIN32
+    return _read(fd, buf, static_cast<unsigned>(std::min<size_t>(n, 1 << 30)));
+#else
+    for (;;) {
+        ssize_t r = ::read(fd, buf, n);
+        if (r >= 0 || errno != EINTR)
+            return static_cast<long>(r);
+    }
+#endif
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t n) {
+    while (n > 0) {
+#ifdef _WIN32
+        long w = _write(fd, data, static_cast<unsigned>(std::min<size_t>(n, 1 << 30)));
+#else
+        ssize_t w = ::send(fd, data, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == ENOTSOCK)
+            w = ::write(fd, data, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+#endif
+        if (w <= 0)
+            return false;
+        data += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+}  // namespace
+
+bool DaemonStream::fill() {
+    if (pos_ == end_)
+        pos_ = end_ = 0;
+    if (end_ == buf_.size())
+        return false;
+    long r = readSome(in_, buf_.data() + end_, buf_.size() - end_);
+    if (r <= 0)
+        return false;
+    end_ += static_cast<size_t>(r);
+    return true;
+}
+
+bool DaemonStream::readLine(std::string& line) {
+    line.clear();
+    for (;;) {
+        uint8_t* begin = buf_.data() + pos_;
+        uint8_t* nl = static_cast<uint8_t*>(std::memchr(begin, '\n', end_ - pos_));
+        if (nl) {
+            line.append(reinterpret_cast<const char*>(begin), nl - begin);
+            pos_ += nl - begin + 1;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            return true;
+        }
+        line.append(reinterpret_cast<const char*>(begin), end_ - pos_);
+        pos_ = end_;
+        if (line.size() > kMaxLine || !fill())
+            return false;
+    }
+}
+
+bool DaemonStream::readBytes(std::vector<uint8_t>& bytes, size_t n) {
+    bytes.resize(n);
+    size_t have = std::min(n, end_ - pos_);
+    std::memcpy(bytes.data(), buf_.data() + pos_, have);
+    pos_ += have;
+    // Large bodies go straight into the destination instead of through the buffer
+    while (have < n) {
+        long r = readSome(in_, bytes.data() + have, n - have);
+        if (r <= 0)
+            return false;
+        have += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+bool DaemonStream::readRequest(DaemonFrame& frame) {
+    if (!readLine(frame.line))
+        return false;
+    if (!parseDaemonLine(frame.line, frame.command, frame.fields))
+        return false;
+    uint64_t sizes[2] = {0, 0};
+    const char* keys[2] = {"payload", "image"};
+    for (int i = 0; i < 2; ++i) {
+        auto it = frame.fields.find(keys[i]);
+        if (it == frame.fields.end())
+            continue;
+        char* end = nullptr;
+        sizes[i] = std::strtoull(it->second.c_str(), &end, 10);
+        if (*end != '\0' || sizes[i] > kMaxBytes)
+            return false;
+    }
+    return readBytes(frame.payload, static_cast<size_t>(sizes[0])) && readBytes(frame.data, static_cast<size_t>(sizes[1]));
+}
+
+bool DaemonStream::readResponse(DaemonFrame& frame) {
+    if (!readLine(frame.line))
+        return false;
+    uint64_t size = 0;
+    daemonResponseField(frame.line, "data_bytes", size);
+    return size <= kMaxBytes && readBytes(frame.data, static_cast<size_t>(size));
+}
+
+bool DaemonStream::write(const std::string& line, const uint8_t* bytes1, size_t size1, const uint8_t* bytes2, size_t size2) {
+    // Small frames go out in one write so a request costs one syscall on each side
+    std::string head = line + '\n';
+    if (size1 + size2 <= 4096) {
+        if (size1) head.append(reinterpret_cast<const char*>(bytes1), size1);
+        if (size2) head.append(reinterpret_cast<const char*>(bytes2), size2);
+        return writeAll(out_, reinterpret_cast<const uint8_t*>(head.data()), head.size());
+    }
+    return writeAll(out_, reinterpret_cast<const uint8_t*>(head.data()), head.size()) &&
+           (size1 == 0 || writeAll(out_, bytes1, size1)) && (size2 == 0 || writeAll(out_, bytes2, size2));
+}
+
+bool parseDaemonLine(const std::string& line, std::string& command, std::map<std::string, std::string>& fields) {
+    std::istringstream iss(line);
+    fields.clear();
+    if (!(iss >> command))
+        return false;
+    std::string field;
+    while (iss >> field) {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            return false;
+        fields[field.substr(0, eq)] = field.substr(eq + 1);
+    }
+    return true;
+}
+
+bool daemonResponseField(const std::string& line, const char* key, uint64_t& value) {
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos)
+        return false;
+    value = std::strtoull(line.c_str() + at + pattern.size(), nullptr, 10);
+    return true;
+}
+
+int connectDaemon(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    return -1;
+#else
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+void closeDaemon(int fd) {
+#ifndef _WIN32
+    if (fd >= 0)
+        ::close(fd);
+#else
+    (void)fd;
+#endif
+}
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void onStopSignal(int) {
+    g_stop = true;
+}
+
+// Connection-owned buffers, reused from one request to the next
+struct Connection {
+    DaemonStream stream;
+    DaemonFrame request;
+    std::vector<uchar> image;   // encoded stego image of the last embed
+    std::string message;        // payload or extracted message
+
+    Connection(int in, int out) : stream(in, out) {}
+};
+
+class Server {
+public:
+    explicit Server(const DaemonOptions& opts)
+        : jobs_(opts.jobs > 0 ? opts.jobs : std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
+          pool_(jobs_, static_cast<size_t>(jobs_) * 2) {
+        int hw = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        setThreadCount(opts.threads > 0 ? opts.threads : std::max(1, hw / jobs_));
+        warmUp();
+    }
+
+    // Serves requests in order until the peer closes the stream or sends garbage
+    void serve(int in, int out) {
+        Connection conn(in, out);
+        while (conn.stream.readRequest(conn.request)) {
+            std::string line;
+            const std::vector<uchar>* data = nullptr;
+            auto queued = Clock::now();
+            std::promise<void> done;
+            pool_.submit([&] {
+                line = handle(conn, msSince(queued), data);
+                done.set_value();
+            });
+            done.get_future().wait();
+            if (!conn.stream.write(line, data ? data->data() : nullptr, data ? data->size() : 0))
+                return;
+        }
+    }
+
+private:
+    // First use of the codecs and the kernels happens here instead of in the first request
+    void warmUp() {
+        cv::Mat tiny(8, 8, CV_8UC3, cv::Scalar(90, 120, 150));
+        std::vector<uchar> bytes;
+        cv::Mat decoded;
+        for (const char* ext : {".png", ".bmp", ".ppm"})
+            if (steg::encodeImage(tiny, ext, bytes) == steg::Status::Ok)
+                steg::decodeImage(bytes, decoded);
+        steg::EmbedOptions eopts;
+        for (Method m : {Method::LSB, Method::HS, Method::QIM, Method::PM1}) {
+            eopts.method = m;
+            steg::embed(tiny, "", eopts);
+        }
+    }
+
+    std::string handle(Connection& conn, double queueMs, const std::vector<uchar>*& data) {
+        auto t0 = Clock::now();
+        JsonObject line;
+        const std::string& command = conn.request.command;
+        std::map<std::string, std::string>& f = conn.request.fields;
+        if (f.count("id"))
+            line.add("id", f["id"]);
+        line.add("command", command);
+        steg::Status status = steg::Status::Ok;
+        std::string error;
+        try {
+            status = run(command, f, conn, line, data, error);
+        } catch (const std::exception& e) {
+            status = steg::Status::InvalidParameter;
+            error = e.what();
+        }
+        if (status != steg::Status::Ok) {
+            data = nullptr;
+            if (error.empty())
+                error = steg::statusMessage(status);
+        }
+        line.add("status", steg::statusName(status));
+        if (!error.empty())
+            line.add("error", error);
+        if (data)
+            line.add("data_bytes", static_cast<uint64_t>(data->size()));
+        line.add("ms", msSince(t0)).add("queue_ms", queueMs);
+        return line.str();
+    }
+
+    steg::Status run(const std::string& command, std::map<std::string, std::string>& f, Connection& conn,
+                     JsonObject& line, const std::vector<uchar>*& data, std::string& error) {
+        if (command == "ping")
+            return steg::Status::Ok;
+        if (command != "embed" && command != "extract" && command != "capacity") {
+            error = "unknown command: " + command;
+            return steg::Status::InvalidParameter;
+        }
+        Method method = Method::LSB;
+        if (f.count("method") && !steg::parseMethod(f["method"], method)) {
+            error = "unknown method: " + f["method"];
+            return steg::Status::InvalidParameter;
+        }
+        line.add("method", steg::methodName(method));
+        auto number = [&](const char* key, uint64_t fallback) {
+            auto it = f.find(key);
+            return it == f.end() ? fallback : std::strtoull(it->second.c_str(), nullptr, 10);
+        };
+        if (command == "embed" && f.count("ext") && !steg::isLosslessFormat(f["ext"]))
+            return steg::Status::LossyFormat;
+        cv::Mat image;
+        steg::Status status = steg::decodeImage(conn.request.data, image);
+        if (status != steg::Status::Ok)
+            return status;
+
+        if (command == "extract") {
+            steg::ExtractOptions xopts;
+            xopts.method = method;
+            xopts.q = static_cast<int>(number("q", 4));
+            xopts.framed = number("raw", 0) == 0;
+            xopts.msgLen = static_cast<size_t>(number("length", 0));
+            xopts.bitsPerChannel = static_cast<int>(number("bits", 1));
+            xopts.matrixBits = static_cast<int>(number("matrix", 0));
+            if (f.count("scatter"))
+                xopts.scatterKey = number("scatter", 0);
+            if (f.count("hs") && !steg::parseHSKey(f["hs"], xopts.hs)) {
+                error = "bad hs key";
+                return steg::Status::InvalidParameter;
+            }
+            steg::ExtractResult res = steg::extract(image, xopts);
+            if (res.status != steg::Status::Ok)
+                return res.status;
+            conn.image.assign(res.message.begin(), res.message.end());
+            data = &conn.image;
+            return steg::Status::Ok;
+        }
+
+        steg::EmbedOptions eopts;
+        eopts.method = method;
+        eopts.q = static_cast<int>(number("q", 4));
+        eopts.framed = number("raw", 0) == 0;
+        eopts.bitsPerChannel = static_cast<int>(number("bits", 1));
+        eopts.matrixBits = static_cast<int>(number("matrix", 0));
+        if (f.count("compress") && !steg::parseCodec(f["compress"], eopts.codec)) {
+            error = "unknown codec: " + f["compress"];
+            return steg::Status::InvalidParameter;
+        }
+        eopts.hsPairs = static_cast<int>(number("pairs", 1));
+        if (f.count("seed"))
+            eopts.seed = number("seed", 0);
+        if (f.count("scatter"))
+            eopts.scatterKey = number("scatter", 0);
+        if (f.count("ext"))
+            eopts.ext = f["ext"];
+        if (f.count("png-level"))
+            eopts.encode.pngCompression = static_cast<int>(number("png-level", 1));
+        if (command == "capacity") {
+            steg::CapacityResult res = steg::capacity(image, eopts);
+            if (res.status == steg::Status::Ok)
+                line.add("capacity_bytes", res.maxBytes);
+            return res.status;
+        }
+        conn.message.assign(conn.request.payload.begin(), conn.request.payload.end());
+        steg::EmbedResult res = steg::embed(image, conn.message, eopts);
+        if (res.status != steg::Status::Ok)
+            return res.status;
+        if ((status = steg::encodeImage(res.stego, eopts.ext, conn.image, eopts.encode)) != steg::Status::Ok)
+            return status;
+        line.add("payload_bytes", static_cast<uint64_t>(conn.message.size()));
+        if (method == Method::HS)
+            line.add("hs", steg::formatHSKey(res.hs));
+        data = &conn.image;
+        return steg::Status::Ok;
+    }
+
+    int jobs_;
+    ThreadPool pool_;
+};
+
+#ifndef _WIN32
+// Removes a socket left behind by a daemon that is gone; anything else at the path is kept
+bool clearStaleSocket(const std::string& path, const sockaddr_un& addr, std::string& error) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT)
+            return true;
+        error = std::strerror(errno);
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        error = "путь занят и не является сокетом";
+        return false;
+    }
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    bool live = probe >= 0 && ::connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (probe >= 0)
+        ::close(probe);
+    if (live) {
+        error = "на сокете уже работает сервер";
+        return false;
+    }
+    ::unlink(path.c_str());
+    return true;
+}
+
+int serveSocket(Server& server, const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Ошибка: слишком длинный путь сокета: " << path << "\n";
+        return 2;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    std::string error;
+    if (!clearStaleSocket(path, addr, error)) {
+        std::cerr << "Ошибка: не удалось открыть сокет " << path << ": " << error << "\n";
+        return 2;
+    }
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listener, 128) != 0) {
+        std::cerr << "Ошибка: не удалось открыть сокет " << path << ": " << std::strerror(errno) << "\n";
+        if (listener >= 0)
+            ::close(listener);
+        return 2;
+    }
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cerr << "project_steg: слушает " << path << "\n";
+
+    // Open connections, so a shutdown can wake their readers; shared with the detached threads
+    struct OpenSet {
+        std::mutex mutex;
+        std::condition_variable closed;
+        std::set<int> fds;
+    };
+    auto open = std::make_shared<OpenSet>();
+    while (!g_stop) {
+        pollfd p{listener, POLLIN, 0};
+        if (::poll(&p, 1, 200) <= 0)
+            continue;
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(open->mutex);
+            open->fds.insert(fd);
+        }
+        std::thread([&server, open, fd] {
+            server.serve(fd, fd);
+            std::lock_guard<std::mutex> lock(open->mutex);
+            ::close(fd);
+            open->fds.erase(fd);
+            open->closed.notify_all();
+        }).detach();
+    }
+    ::close(listener);
+    ::unlink(path.c_str());
+    std::unique_lock<std::mutex> lock(open->mutex);
+    for (int fd : open->fds)
+        ::shutdown(fd, SHUT_RDWR);
+    open->closed.wait(lock, [&] { return open->fds.empty(); });
+    return 0;
+}
+#endif
+
+}  // namespace
+
+int runDaemon(const DaemonOptions& opts) {
+    Server server(opts);
+    if (opts.socketPath.empty()) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        server.serve(0, 1);
+        return 0;
+    }
+#ifdef _WIN32
+    std::cerr << "Ошибка: сокеты Unix недоступны, используйте --stdio\n";
+    return 2;
+#else
+    return serveSocket(server, opts.socketPath);
+#endif
+}
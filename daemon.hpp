@@ -0,0 +1,133 @@
+#ifndef STEGO_DAEMON_HPP
+#define STEGO_DAEMON_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file daemon.hpp
+ * \brief Long-running request server of project_steg and its wire format
+ *
+ * A request is one text line followed by raw bytes:
+ *
+ *     embed method=lsb payload=11 image=52311 [key=value ...]\n<11 payload bytes><52311 image bytes>
+ *
+ * The command is embed, extract, capacity or ping. payload and image give the number of raw
+ * bytes that follow (0 when absent). The other keys mirror the command-line options: method,
+ * q, bits, matrix, pairs, seed, scatter, raw (1 for the headerless layout), length and hs (raw
+ * extraction), compress (lz4 or none), ext and png-level (embed output), id (echoed back).
+ *
+ * A response is one JSON line followed by raw bytes: "status", "ms" (time on the worker),
+ * "queue_ms" (time waiting for one) and the command's fields. "data_bytes" gives the length of
+ * the stego image (embed) or message (extract) that follows the line.
+ *
+ * Requests on one connection are answered in order; connections are served concurrently by a
+ * warm worker pool, so the per-image cost excludes process start and codec set-up.
+ */
+
+
+
+/**
+ * \brief One framed message: the text line and the raw bytes after it
+ */
+struct DaemonFrame {
+    std::string line;               ///< Header line without the trailing newline
+    std::string command;            ///< Request command, as parsed by readRequest
+    std::map<std::string, std::string> fields;   ///< Request key=value fields, as parsed by readRequest
+    std::vector<uint8_t> payload;   ///< Request payload (message)
+    std::vector<uint8_t> data;      ///< Request image or response data
+};
+
+/**
+ * \brief Buffered reader and writer of frames over a pair of descriptors (a socket or stdin/stdout)
+ */
+class DaemonStream {
+public:
+    /**
+     * \brief Wraps the descriptors; they are not closed by the stream
+     * \param in Readable descriptor
+     * \param out Writable descriptor
+     */
+    DaemonStream(int in, int out) : in_(in), out_(out) {}
+
+    /**
+     * \brief Reads one request: the line, then its payload= and image= bytes
+     * \param frame Output frame; its buffers are reused
+     * \return false on end of stream or a malformed frame
+     */
+    bool readRequest(DaemonFrame& frame);
+
+    /**
+     * \brief Reads one response: the JSON line, then its data_bytes bytes into frame.data
+     * \param frame Output frame; its buffers are reused
+     * \return false on end of stream or a malformed frame
+     */
+    bool readResponse(DaemonFrame& frame);
+
+    /**
+     * \brief Writes a line, a newline and then two byte ranges
+     * \return false if the peer has gone
+     */
+    bool write(const std::string& line, const uint8_t* bytes1 = nullptr, size_t size1 = 0,
+               const uint8_t* bytes2 = nullptr, size_t size2 = 0);
+
+private:
+    bool readLine(std::string& line);
+    bool readBytes(std::vector<uint8_t>& bytes, size_t n);
+    bool fill();
+
+    int in_, out_;
+    std::vector<uint8_t> buf_ = std::vector<uint8_t>(1 << 16);
+    size_t pos_ = 0, end_ = 0;
+};
+
+/**
+ * \brief Splits a request line into its command and key=value fields
+ * \param line Request line
+ * \param command Output: first word of the line
+ * \param fields Output: key/value pairs
+ * \return false if a field has no '='
+ */
+bool parseDaemonLine(const std::string& line, std::string& command, std::map<std::string, std::string>& fields);
+
+/**
+ * \brief Reads an unsigned number field of a JSON response line
+ * \param line JSON line
+ * \param key Field name
+ * \param value Output value
+ * \return false if the field is missing
+ */
+bool daemonResponseField(const std::string& line, const char* key, uint64_t& value);
+
+/**
+ * \brief Connects to a daemon listening on a Unix domain socket
+ * \param path Socket path
+ * \return Connected descriptor, or -1
+ */
+int connectDaemon(const std::string& path);
+
+/**
+ * \brief Closes a descriptor returned by connectDaemon
+ */
+void closeDaemon(int fd);
+
+/**
+ * \brief Server settings
+ */
+struct DaemonOptions {
+    std::string socketPath;   ///< Unix domain socket to listen on; empty serves stdin/stdout
+    int jobs = 0;             ///< Requests processed at once, 0 for the core count
+    int threads = 0;          ///< Kernel threads per request, 0 for cores / jobs
+};
+
+/**
+ * \brief Runs the server until the input ends (stdio) or SIGINT/SIGTERM arrives (socket)
+ * \param opts Server settings
+ * \return 0 on a clean shutdown, 2 if the socket cannot be opened
+ */
+int runDaemon(const DaemonOptions& opts);
+
+#endif
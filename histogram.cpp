@@ -0,0 +1,87 @@
+#include "histogram.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <vector>
+
+/**
+ * \file
+ * \brief File, where the parallel histogram builder is realised
+ */
+
+
+
+namespace {
+
+const int kLanes = 4;
+// 32-bit sub-histogram counters are folded into the 64-bit totals before they can overflow
+const uint64_t kFlushPixels = uint64_t(1) << 30;
+
+template <int CN>
+struct BandHistogram {
+    uint32_t sub[kLanes][CN][256];
+    uint64_t total[CN][256];
+
+    BandHistogram() {
+        std::fill(&sub[0][0][0], &sub[0][0][0] + kLanes * CN * 256, 0u);
+        std::fill(&total[0][0], &total[0][0] + CN * 256, uint64_t(0));
+    }
+
+    void flush() {
+        for (int k = 0; k < kLanes; ++k)
+            for (int c = 0; c < CN; ++c)
+                for (int v = 0; v < 256; ++v) {
+                    total[c][v] += sub[k][c][v];
+                    sub[k][c][v] = 0;
+                }
+    }
+
+    void countRow(const uchar* p, int cols) {
+        int x = 0;
+        for (; x + kLanes <= cols; x += kLanes, p += kLanes * CN) {
+            for (int c = 0; c < CN; ++c) {
+                ++sub[0][c][p[c]];
+                ++sub[1][c][p[CN + c]];
+                ++sub[2][c][p[2 * CN + c]];
+                ++sub[3][c][p[3 * CN + c]];
+            }
+        }
+        for (; x < cols; ++x, p += CN)
+            for (int c = 0; c < CN; ++c)
+                ++sub[0][c][p[c]];
+    }
+};
+
+template <int CN>
+void buildBands(const cv::Mat& image, uint64_t hist[][256], int threads) {
+    int bands = bandCount(image.rows, static_cast<uint64_t>(image.cols) * CN, threads);
+    std::vector<BandHistogram<CN>> parts(bands);
+    parallelForBands(image.rows, bands, [&](int band, int y0, int y1) {
+        BandHistogram<CN>& part = parts[band];
+        uint64_t pending = 0;
+        for (int y = y0; y < y1; ++y) {
+            part.countRow(image.ptr<uchar>(y), image.cols);
+            pending += static_cast<uint64_t>(image.cols);
+            if (pending >= kFlushPixels) {
+                part.flush();
+                pending = 0;
+            }
+        }
+        part.flush();
+    });
+    for (int c = 0; c < CN; ++c)
+        std::fill(hist[c], hist[c] + 256, uint64_t(0));
+    for (const BandHistogram<CN>& part : parts)
+        for (int c = 0; c < CN; ++c)
+            for (int v = 0; v < 256; ++v)
+                hist[c][v] += part.total[c][v];
+}
+
+}  // namespace
+
+void buildHistograms(const cv::Mat& image, uint64_t hist[][256], int threads) {
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3));
+    if (image.channels() == 1)
+        buildBands<1>(image, hist, threads);
+    else
+        buildBands<3>(image, hist, threads);
+}
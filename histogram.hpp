@@ -0,0 +1,27 @@
+#ifndef STEGO_HISTOGRAM_HPP
+#define STEGO_HISTOGRAM_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+
+
+/**
+ * \file histogram.hpp
+ * \brief Parallel per-channel histogram builder
+ *
+ * Each thread counts one band of rows into private sub-histograms; the band results
+ * are merged at the end. Consecutive pixels go to four interleaved sub-histograms so
+ * runs of equal values (flat areas) do not serialise on one counter.
+ */
+
+
+
+/**
+ * \brief Builds the histogram of every channel of an 8-bit image
+ * \param image Input image (CV_8UC1 or CV_8UC3)
+ * \param hist Output, image.channels() histograms of 256 bins
+ * \param threads Thread count, 0 for threadCount()
+ */
+void buildHistograms(const cv::Mat& image, uint64_t hist[][256], int threads = 0);
+
+#endif
@@ -0,0 +1,361 @@
+#include "hs_engine.hpp"
+#include "histogram.hpp"
+#include "instrument.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * \file
+ * \brief File, where the fused Histogram Shifting engine is realised
+ */
+
+
+
+void findPZFromHistogram(const uint64_t hist[256], int& P, int& Z) {
+    P = static_cast<int>(std::max_element(hist, hist + 256) - hist);
+
+    int left = P - 1, right = P + 1;
+    int Z_left = -1, Z_right = -1;
+    while (left >= 0) {
+        if (hist[left] == 0) { Z_left = left; break; }
+        --left;
+    }
+    while (right < 256) {
+        if (hist[right] == 0) { Z_right = right; break; }
+        ++right;
+    }
+
+    if (Z_left == -1 && Z_right == -1) Z = 0;
+    else if (Z_left == -1) Z = Z_right;
+    else if (Z_right == -1) Z = Z_left;
+    else Z = (std::abs(Z_left - P) < std::abs(Z_right - P)) ? Z_left : Z_right;
+}
+
+
+namespace steg {
+
+void buildChannelHistograms(const cv::Mat& image, ChannelHistograms& hist) {
+    CV_Assert(image.type() == CV_8UC3);
+    PhaseTimer timer(Phase::Histogram);
+    buildHistograms(image, hist.h);
+}
+
+void chooseHSKey(const ChannelHistograms& hist, HSKey& key, uint64_t peakCount[3]) {
+    key.pairs = 1;
+    for (int c = 0; c < 3; ++c) {
+        findPZFromHistogram(hist.h[c], key.P[c], key.Z[c]);
+        // Shifting never moves a sample onto P, so the peak bin is the channel capacity;
+        // P == Z (peak at 0 and no empty bin) shifts nothing and carries nothing
+        peakCount[c] = key.P[c] == key.Z[c] ? 0 : hist.h[c][key.P[c]];
+    }
+}
+
+void chooseHSPairs(const ChannelHistograms& hist, int pairs, HSKey& key, uint64_t peakCount[3]) {
+    if (pairs <= 1) {
+        chooseHSKey(hist, key, peakCount);
+        return;
+    }
+    key = HSKey();
+    key.pairs = std::min(pairs, kMaxHSPairs);
+    for (int c = 0; c < 3; ++c) {
+        const uint64_t* h = hist.h[c];
+        int order[256];
+        for (int v = 0; v < 256; ++v)
+            order[v] = v;
+        std::stable_sort(order, order + 256, [h](int a, int b) { return h[a] > h[b]; });
+        bool taken[256] = {};   // inside the shift range of a chosen pair
+        peakCount[c] = 0;
+        int found = 0;
+        for (int k = 0; k < 256 && found < key.pairs && h[order[k]] > 0; ++k) {
+            int P = order[k];
+            if (taken[P])
+                continue;
+            int left = -1, right = -1;
+            for (int v = P - 1; v >= 0 && !taken[v] && left < 0; --v)
+                if (h[v] == 0) left = v;
+            for (int v = P + 1; v < 256 && !taken[v] && right < 0; ++v)
+                if (h[v] == 0) right = v;
+            if (left < 0 && right < 0)
+                continue;
+            // Ties go right, as in findPZFromHistogram
+            int Z = right < 0 || (left >= 0 && P - left < right - P) ? left : right;
+            for (int v = std::min(P, Z); v <= std::max(P, Z); ++v)
+                taken[v] = true;
+            if (found == 0) {
+                key.P[c] = P;
+                key.Z[c] = Z;
+            } else {
+                key.moreP[c][found - 1] = P;
+                key.moreZ[c][found - 1] = Z;
+            }
+            peakCount[c] += h[P];
+            ++found;
+        }
+    }
+}
+
+void hsCarrierCodes(const HSKey& key, uint8_t code[3][256], bool active[3]) {
+    for (int c = 0; c < 3; ++c) {
+        std::fill(code[c], code[c] + 256, 0);
+        active[c] = false;
+        for (int i = 0; i < key.pairs; ++i) {
+            int P, Z;
+            hsPair(key, c, i, P, Z);
+            if (P == Z)
+                continue;
+            code[c][P] = 1;
+            code[c][P < Z ? P + 1 : P - 1] = 2;
+            active[c] = true;
+        }
+    }
+}
+
+HSBandEmbedder::HSBandEmbedder(const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits, uint64_t firstBit)
+    : payload_(payload) {
+    // Channel c takes payload bits firstBit + peakCount[0] + ... + peakCount[c - 1] onwards
+    uint64_t offset = firstBit, last = firstBit + nbits;
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            lut_[c][v] = one_[c][v] = static_cast<uchar>(v);
+            carrier_[c][v] = false;
+        }
+        for (int i = 0; i < key.pairs; ++i) {
+            int P, Z;
+            hsPair(key, c, i, P, Z);
+            if (P == Z)
+                continue;
+            // Values strictly between P and Z move one step towards Z; the guards only matter
+            // for a single pair whose Z fell back to a non-empty bin
+            for (int v = std::min(P, Z) + 1; v < std::max(P, Z); ++v) {
+                if (P < Z && v < 255) lut_[c][v] = static_cast<uchar>(v + 1);
+                else if (P > Z && v > 0) lut_[c][v] = static_cast<uchar>(v - 1);
+            }
+            carrier_[c][P] = true;
+            one_[c][P] = static_cast<uchar>(P < Z ? P + 1 : P - 1);
+        }
+        begin_[c] = cursor_[c] = std::min(offset, last);
+        offset += peakCount[c];
+        end_[c] = std::min(offset, last);
+    }
+}
+
+void HSBandEmbedder::process(const cv::Mat& src, cv::Mat& dst) {
+    CV_Assert(src.type() == CV_8UC3);
+    if (dst.data != src.data)
+        dst.create(src.size(), CV_8UC3);
+
+    int bands = bandCount(src.rows, static_cast<uint64_t>(src.cols) * 3);
+    if (bands == 1) {
+        processRows(src, dst);
+        return;
+    }
+    bool pending = false;
+    for (int c = 0; c < 3; ++c)
+        pending = pending || cursor_[c] < end_[c];
+
+    // Pass 1: peaks per band and channel, only needed while payload is left
+    std::vector<std::array<uint64_t, 3>> count(bands, {0, 0, 0});
+    if (pending) {
+        parallelForBands(src.rows, bands, [&](int b, int y0, int y1) {
+            uint64_t n[3] = {0, 0, 0};
+            for (int y = y0; y < y1; ++y) {
+                const uchar* s = src.ptr<uchar>(y);
+                const uchar* rowEnd = s + static_cast<size_t>(src.cols) * 3;
+                for (; s < rowEnd; s += 3) {
+                    n[0] += carrier_[0][s[0]];
+                    n[1] += carrier_[1][s[1]];
+                    n[2] += carrier_[2][s[2]];
+                }
+            }
+            std::copy(n, n + 3, count[b].begin());
+        });
+    }
+
+    // Pass 2: every band starts each channel at the prefix sum of the peaks above it
+    std::vector<HSBandEmbedder> workers(bands, *this);
+    uint64_t offset[3] = {0, 0, 0};
+    for (int b = 0; b < bands; ++b) {
+        for (int c = 0; c < 3; ++c) {
+            workers[b].cursor_[c] = std::min(cursor_[c] + offset[c], end_[c]);
+            std::fill(workers[b].ones_[c], workers[b].ones_[c] + 256, 0);
+            offset[c] += count[b][c];
+        }
+    }
+    parallelForBands(src.rows, bands, [&](int b, int y0, int y1) {
+        cv::Mat out = dst.rowRange(y0, y1);
+        workers[b].processRows(src.rowRange(y0, y1), out);
+    });
+    for (int c = 0; c < 3; ++c) {
+        cursor_[c] = std::min(cursor_[c] + offset[c], end_[c]);
+        for (const HSBandEmbedder& w : workers)
+            for (int v = 0; v < 256; ++v)
+                ones_[c][v] += w.ones_[c][v];
+    }
+}
+
+void HSBandEmbedder::processRows(const cv::Mat& src, cv::Mat& dst) {
+    for (int y = 0; y < src.rows; ++y) {
+        const uchar* s = src.ptr<uchar>(y);
+        uchar* d = dst.ptr<uchar>(y);
+        const uchar* rowEnd = s + static_cast<size_t>(src.cols) * 3;
+        for (; s < rowEnd; s += 3, d += 3) {
+            for (int c = 0; c < 3; ++c) {
+                uchar v = s[c];
+                d[c] = lut_[c][v];
+                if (carrier_[c][v] && cursor_[c] < end_[c]) {
+                    uint64_t bit = cursor_[c]++;
+                    if ((payload_[bit >> 3] >> (7 - (bit & 7))) & 1) {
+                        d[c] = one_[c][v];
+                        ++ones_[c][v];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void HSBandEmbedder::updateHistograms(ChannelHistograms& hist) const {
+    for (int c = 0; c < 3; ++c) {
+        uint64_t next[256] = {};
+        for (int v = 0; v < 256; ++v)
+            next[lut_[c][v]] += hist.h[c][v];
+        for (int v = 0; v < 256; ++v) {
+            next[v] -= ones_[c][v];
+            next[one_[c][v]] += ones_[c][v];
+        }
+        std::copy(next, next + 256, hist.h[c]);
+    }
+}
+
+namespace {
+
+// Appends the bits of channels with room left to their writers, scanning rows [y0, y1)
+void readHSRows(const cv::Mat& image, int y0, int y1, const uint8_t code[3][256], const uint64_t want[3], BitWriter* out[3]) {
+    for (int y = y0; y < y1; ++y) {
+        const uchar* p = image.ptr<uchar>(y);
+        const uchar* rowEnd = p + static_cast<size_t>(image.cols) * 3;
+        for (int c = 0; c < 3; ++c) {
+            if (out[c]->bitCount() >= want[c])
+                continue;
+            for (const uchar* q = p + c; q < rowEnd; q += 3) {
+                uint8_t k = code[c][*q];
+                if (k != 0) {
+                    out[c]->writeBit(k == 2);
+                    if (out[c]->bitCount() >= want[c])
+                        break;
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void readHSBits(const cv::Mat& image, const uint8_t code[3][256], const uint64_t limit[3], BitWriter* out[3]) {
+    CV_Assert(image.type() == CV_8UC3);
+    uint64_t need[3];
+    bool pending = false;
+    for (int c = 0; c < 3; ++c) {
+        need[c] = limit[c] - std::min(limit[c], out[c]->bitCount());
+        pending = pending || need[c] > 0;
+    }
+    int bands = bandCount(image.rows, static_cast<uint64_t>(image.cols) * 3);
+    if (!pending)
+        return;
+    if (bands == 1) {
+        readHSRows(image, 0, image.rows, code, limit, out);
+        return;
+    }
+
+    // Pass 1: carriers per band and channel
+    std::vector<std::array<uint64_t, 3>> count(bands, {0, 0, 0});
+    parallelForBands(image.rows, bands, [&](int b, int y0, int y1) {
+        uint64_t n[3] = {0, 0, 0};
+        for (int y = y0; y < y1; ++y) {
+            const uchar* p = image.ptr<uchar>(y);
+            const uchar* rowEnd = p + static_cast<size_t>(image.cols) * 3;
+            for (; p < rowEnd; p += 3) {
+                n[0] += code[0][p[0]] != 0;
+                n[1] += code[1][p[1]] != 0;
+                n[2] += code[2][p[2]] != 0;
+            }
+        }
+        std::copy(n, n + 3, count[b].begin());
+    });
+
+    // Pass 2: each band takes the bits between its prefix sum and the channel's need
+    std::vector<std::array<uint64_t, 3>> want(bands);
+    uint64_t offset[3] = {0, 0, 0};
+    for (int b = 0; b < bands; ++b) {
+        for (int c = 0; c < 3; ++c) {
+            want[b][c] = std::min(count[b][c], need[c] - std::min(need[c], offset[c]));
+            offset[c] += count[b][c];
+        }
+    }
+    std::vector<std::array<std::string, 3>> bits(bands);
+    parallelForBands(image.rows, bands, [&](int b, int y0, int y1) {
+        BitWriter w0(bits[b][0]), w1(bits[b][1]), w2(bits[b][2]);
+        BitWriter* w[3] = {&w0, &w1, &w2};
+        readHSRows(image, y0, y1, code, want[b].data(), w);
+        for (BitWriter* x : w)
+            x->writeBits(0, 7);   // pushes the trailing partial byte out
+    });
+    for (int b = 0; b < bands; ++b)
+        for (int c = 0; c < 3; ++c)
+            appendBits(*out[c], reinterpret_cast<const uint8_t*>(bits[b][c].data()), want[b][c]);
+}
+
+void restoreHSPass(cv::Mat& image, const HSKey& key, const uint64_t bits[3], uint8_t* out, uint64_t firstBit) {
+    CV_Assert(image.type() == CV_8UC3);
+    uint8_t code[3][256];
+    bool active[3];
+    hsCarrierCodes(key, code, active);
+    // inv[c][v]: value before the layer; the neighbour of a peak (bit 1) and the shifted values
+    // all move one step back towards P
+    uchar inv[3][256];
+    uint64_t cursor[3], end[3];
+    uint64_t offset = firstBit;
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 256; ++v)
+            inv[c][v] = static_cast<uchar>(v);
+        for (int i = 0; i < key.pairs; ++i) {
+            int P, Z;
+            hsPair(key, c, i, P, Z);
+            if (P < Z)
+                for (int v = P + 1; v <= Z; ++v) inv[c][v] = static_cast<uchar>(v - 1);
+            else if (P > Z)
+                for (int v = Z; v < P; ++v) inv[c][v] = static_cast<uchar>(v + 1);
+        }
+        cursor[c] = offset;
+        offset += bits[c];
+        end[c] = offset;
+    }
+    for (int y = 0; y < image.rows; ++y) {
+        uchar* p = image.ptr<uchar>(y);
+        uchar* rowEnd = p + static_cast<size_t>(image.cols) * 3;
+        for (; p < rowEnd; p += 3) {
+            for (int c = 0; c < 3; ++c) {
+                uchar v = p[c];
+                if (code[c][v] != 0 && cursor[c] < end[c]) {
+                    uint64_t bit = cursor[c]++;
+                    if (code[c][v] == 2)
+                        out[bit >> 3] |= static_cast<uint8_t>(0x80 >> (bit & 7));
+                }
+                p[c] = inv[c][v];
+            }
+        }
+    }
+}
+
+void embedHSPass(const cv::Mat& src, cv::Mat& dst, const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits) {
+    HSBandEmbedder(key, peakCount, payload, nbits).process(src, dst);
+}
+
+void embedHSInPlace(cv::Mat& image, const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits) {
+    embedHSPass(image, image, key, peakCount, payload, nbits);
+}
+
+}  // namespace steg
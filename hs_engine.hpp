@@ -0,0 +1,181 @@
+#ifndef STEGO_HS_ENGINE_HPP
+#define STEGO_HS_ENGINE_HPP
+
+#include "stego_api.hpp"
+#include "bitstream.hpp"
+#include <cstdint>
+
+
+/**
+ * \file hs_engine.hpp
+ * \brief Histogram Shifting engine working on the interleaved BGR image without splitting it into planes
+ */
+
+
+
+/**
+ * \brief Per-channel histograms of an interleaved 3-channel image
+ */
+struct ChannelHistograms {
+    uint64_t h[3][256] = {};
+};
+
+/**
+ * \brief Picks the peak point and the nearest empty bin around it, as findPZ does
+ * \param hist Histogram of one channel
+ * \param P Reference to store the peak point
+ * \param Z Reference to store the zero point (0 when no bin is empty)
+ */
+void findPZFromHistogram(const uint64_t hist[256], int& P, int& Z);
+
+namespace steg {
+
+/**
+ * \brief Builds the B, G and R histograms in one parallel pass over an 8-bit 3-channel image
+ * \param image Input image (CV_8UC3)
+ * \param hist Output histograms
+ */
+void buildChannelHistograms(const cv::Mat& image, ChannelHistograms& hist);
+
+/**
+ * \brief Chooses P/Z for every channel from its histogram
+ * \param hist Channel histograms of the cover
+ * \param key Output peak/zero points
+ * \param peakCount Output number of peak samples per channel (the channel capacity in bits);
+ *                  0 for a channel with no empty bin whose peak is at 0, where P == Z
+ */
+void chooseHSKey(const ChannelHistograms& hist, HSKey& key, uint64_t peakCount[3]);
+
+/**
+ * \brief Chooses up to `pairs` peak/zero pairs per channel with non-overlapping shift ranges
+ *
+ * One pair is chooseHSKey. With more, peaks are taken from the highest bin down, each with the
+ * nearest empty bin that keeps its range clear of the ranges already taken. Only empty bins are
+ * used as zero points, so a channel without any gets no pair instead of one that cannot be undone.
+ * \param hist Channel histograms of the cover
+ * \param pairs Pairs per channel, 1..kMaxHSPairs
+ * \param key Output key; unused pairs have P == Z
+ * \param peakCount Output number of peak samples per channel over all its pairs
+ */
+void chooseHSPairs(const ChannelHistograms& hist, int pairs, HSKey& key, uint64_t peakCount[3]);
+
+/**
+ * \brief Peak and zero point of pair i of channel c
+ */
+inline void hsPair(const HSKey& key, int c, int i, int& P, int& Z) {
+    P = i == 0 ? key.P[c] : key.moreP[c][i - 1];
+    Z = i == 0 ? key.Z[c] : key.moreZ[c][i - 1];
+}
+
+/**
+ * \brief Per-value decoding table of a stego channel
+ * \param key Peak/zero points
+ * \param code Output: 0 for values that carry no bit, 1 for a peak (bit 0), 2 for its neighbour (bit 1)
+ * \param active Output: whether each channel has a used pair
+ */
+void hsCarrierCodes(const HSKey& key, uint8_t code[3][256], bool active[3]);
+
+/**
+ * \brief Appends the Histogram Shifting bits of an image to per-channel writers, in parallel row bands
+ *
+ * Channel c stops once out[c] holds limit[c] bits, as a serial top-to-bottom scan would. Each
+ * row band first counts its carriers per channel; prefix sums of the counts give every band the
+ * position of its first bit, so the bands decode into their own buffers at the same time and are
+ * then appended in band order.
+ * \param image Stego rows (CV_8UC3)
+ * \param code Decoding table from hsCarrierCodes
+ * \param limit Number of bits each channel should end up with
+ * \param out Per-channel writers
+ */
+void readHSBits(const cv::Mat& image, const uint8_t code[3][256], const uint64_t limit[3], BitWriter* out[3]);
+
+/**
+ * \brief Fused shift-and-embed state that can be fed the image as consecutive row bands
+ *
+ * Per-channel payload cursors persist between process() calls, so feeding the bands of an
+ * image top to bottom gives the same result as one embedHSPass over the whole image. Within a
+ * band the rows are split over threads; prefix sums of per-band peak counts tell every thread
+ * where its part of each channel's payload starts, so the result does not depend on the split.
+ */
+class HSBandEmbedder {
+public:
+    /**
+     * \brief Prepares the shift tables and payload cursors
+     * \param key Peak/zero points of each channel
+     * \param peakCount Number of peak samples per channel in the whole image
+     * \param payload Packed payload bytes, MSB-first; must outlive the embedder
+     * \param nbits Number of payload bits
+     * \param firstBit Index of the first payload bit to embed
+     */
+    HSBandEmbedder(const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits, uint64_t firstBit = 0);
+
+    /**
+     * \brief Processes the next band of rows
+     * \param src Cover rows (CV_8UC3)
+     * \param dst Stego rows; allocated unless it is src itself (in-place)
+     */
+    void process(const cv::Mat& src, cv::Mat& dst);
+
+    /**
+     * \brief Payload bits assigned to channel c
+     */
+    uint64_t channelBits(int c) const { return end_[c] - begin_[c]; }
+
+    /**
+     * \brief Turns the histograms of the processed samples into those of the result
+     *
+     * Applies the shift tables to the bins and moves the peaks that took a 1 to their neighbour,
+     * which is all the embedding changed; no pixel is read.
+     * \param hist Histograms of the cover samples given to process(), updated in place
+     */
+    void updateHistograms(ChannelHistograms& hist) const;
+
+private:
+    // Serial kernel: shifts the rows and embeds from the current cursors
+    void processRows(const cv::Mat& src, cv::Mat& dst);
+
+    uchar lut_[3][256];       // value after the shift; peaks map to themselves
+    uchar one_[3][256];       // value of a peak that carries bit 1
+    bool carrier_[3][256];    // the value is a peak
+    uint64_t ones_[3][256] = {};   // peaks of each value that took a 1
+    uint64_t begin_[3], cursor_[3], end_[3];
+    const uint8_t* payload_;
+};
+
+/**
+ * \brief Reads one Histogram Shifting layer and undoes it in a single in-place pass
+ * \param image Stego image (CV_8UC3); receives the image before the layer
+ * \param key Peak/zero points of the layer
+ * \param bits Message bits carried by each channel
+ * \param out Packed output bytes, zeroed; the layer's bits are set from firstBit on
+ * \param firstBit Index of the layer's first bit in out
+ */
+void restoreHSPass(cv::Mat& image, const HSKey& key, const uint64_t bits[3], uint8_t* out, uint64_t firstBit);
+
+/**
+ * \brief Shifts the histograms and embeds the payload in a single pass from src into dst
+ *
+ * Channel c receives payload bits starting at peakCount[0] + ... + peakCount[c - 1],
+ * which reproduces the channel-by-channel order of the plane-based implementation.
+ * \param src Cover image (CV_8UC3)
+ * \param dst Stego image; allocated unless it is src itself (in-place)
+ * \param key Peak/zero points of each channel
+ * \param peakCount Number of peak samples per channel
+ * \param payload Packed payload bytes, MSB-first
+ * \param nbits Number of payload bits
+ */
+void embedHSPass(const cv::Mat& src, cv::Mat& dst, const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits);
+
+/**
+ * \brief Shifts the histograms and embeds the payload in a single in-place pass
+ * \param image Image to modify (CV_8UC3)
+ * \param key Peak/zero points of each channel
+ * \param peakCount Number of peak samples per channel
+ * \param payload Packed payload bytes, MSB-first
+ * \param nbits Number of payload bits
+ */
+void embedHSInPlace(cv::Mat& image, const HSKey& key, const uint64_t peakCount[3], const uint8_t* payload, uint64_t nbits);
+
+}  // namespace steg
+
+#endif
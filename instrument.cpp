@@ -0,0 +1,100 @@
+#include "instrument.hpp"
+#include "json.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the opt-in phase timing and counters are realised
+ */
+
+
+
+namespace steg {
+
+namespace detail {
+thread_local Stats* tlsStats = nullptr;
+}
+
+namespace {
+// Innermost running timer of this thread, paused while a nested one runs
+thread_local PhaseTimer* tlsTimer = nullptr;
+}
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Decode:    return "decode";
+        case Phase::Payload:   return "payload";
+        case Phase::Histogram: return "histogram";
+        case Phase::Kernel:    return "kernel";
+        case Phase::Encode:    return "encode";
+    }
+    return "unknown";
+}
+
+StatsScope::StatsScope(Stats& stats) : previous_(detail::tlsStats) {
+    detail::tlsStats = &stats;
+}
+
+StatsScope::~StatsScope() {
+    detail::tlsStats->peakRssBytes = peakRssBytes();
+    detail::tlsStats = previous_;
+}
+
+PhaseTimer::PhaseTimer(Phase phase) : stats_(activeStats()), phase_(static_cast<int>(phase)) {
+    if (!stats_)
+        return;
+    start_ = std::chrono::steady_clock::now();
+    outer_ = tlsTimer;
+    if (outer_ && outer_->stats_ == stats_)
+        outer_->stats_->phaseMs[outer_->phase_] += std::chrono::duration<double, std::milli>(start_ - outer_->start_).count();
+    tlsTimer = this;
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!stats_)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    stats_->phaseMs[phase_] += std::chrono::duration<double, std::milli>(now - start_).count();
+    if (outer_ && outer_->stats_ == stats_)
+        outer_->start_ = now;
+    tlsTimer = outer_;
+}
+
+uint64_t peakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(ru.ru_maxrss);
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+std::string statsJson(const Stats& stats) {
+    JsonObject phases;
+    for (int p = 0; p < kPhaseCount; ++p)
+        phases.add(phaseName(static_cast<Phase>(p)), stats.phaseMs[p]);
+    JsonObject obj;
+    obj.addRaw("phase_ms", phases.str())
+        .add("bytes_read", stats.bytesRead)
+        .add("bytes_written", stats.bytesWritten)
+        .add("pixels_touched", stats.pixelsTouched)
+        .add("pixels_changed", stats.pixelsChanged)
+        .add("peak_rss_bytes", stats.peakRssBytes);
+    return obj.str();
+}
+
+}  // namespace steg
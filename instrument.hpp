@@ -0,0 +1,132 @@
+#ifndef STEGO_INSTRUMENT_HPP
+#define STEGO_INSTRUMENT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * \file instrument.hpp
+ * \brief Opt-in per-phase timing and counters of embedding and extraction
+ *
+ * Nothing is recorded unless a StatsScope is alive on the calling thread; otherwise every
+ * probe is a single thread-local pointer check and no clock is read.
+ */
+
+
+
+namespace steg {
+
+/**
+ * \brief Phases the wall time is split into
+ */
+enum class Phase { Decode = 0, Payload, Histogram, Kernel, Encode };
+
+constexpr int kPhaseCount = 5;
+
+/**
+ * \brief Lower-case phase name as used in the JSON dump ("decode", "payload", ...)
+ */
+const char* phaseName(Phase phase);
+
+/**
+ * \brief Statistics collected while a StatsScope is alive
+ *
+ * Phase times are exclusive: a phase started inside another one pauses the outer phase.
+ */
+struct Stats {
+    double phaseMs[kPhaseCount] = {};
+    uint64_t bytesRead = 0;       ///< Encoded image bytes decoded
+    uint64_t bytesWritten = 0;    ///< Encoded image bytes produced
+    uint64_t pixelsTouched = 0;   ///< Pixels read or written by the embed/extract kernels
+    uint64_t pixelsChanged = 0;   ///< Pixels whose value differs between cover and stego
+    uint64_t peakRssBytes = 0;    ///< Process peak resident set size when the scope ended
+
+    double ms(Phase phase) const { return phaseMs[static_cast<int>(phase)]; }
+};
+
+/**
+ * \brief Collects the statistics of everything the calling thread runs while it is alive
+ *
+ * Scopes nest; the innermost one receives the data. Work done on the kernel worker threads
+ * is attributed to the phase of the thread that started it.
+ */
+class StatsScope {
+public:
+    explicit StatsScope(Stats& stats);
+    ~StatsScope();
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+private:
+    Stats* previous_;
+};
+
+namespace detail {
+extern thread_local Stats* tlsStats;
+}
+
+/**
+ * \brief Statistics of the innermost StatsScope of this thread, or nullptr
+ */
+inline Stats* activeStats() {
+    return detail::tlsStats;
+}
+
+/**
+ * \brief Adds the lifetime of the object to a phase of the active statistics
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Stats* stats_;
+    int phase_;
+    PhaseTimer* outer_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline void countBytesRead(uint64_t n) {
+    if (Stats* s = activeStats())
+        s->bytesRead += n;
+}
+
+inline void countBytesWritten(uint64_t n) {
+    if (Stats* s = activeStats())
+        s->bytesWritten += n;
+}
+
+/**
+ * \brief Counts the pixels behind a number of channel samples (rounded up to whole pixels)
+ */
+inline void countSamplesTouched(uint64_t samples) {
+    if (Stats* s = activeStats())
+        s->pixelsTouched += (samples + 2) / 3;
+}
+
+inline void countPixelsChanged(uint64_t n) {
+    if (Stats* s = activeStats())
+        s->pixelsChanged += n;
+}
+
+/**
+ * \brief Peak resident set size of the process so far
+ * \return Bytes, or 0 where the platform does not report it
+ */
+uint64_t peakRssBytes();
+
+/**
+ * \brief Formats statistics as a single-line JSON object
+ */
+std::string statsJson(const Stats& stats);
+
+}  // namespace steg
+
+#endif
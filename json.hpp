@@ -0,0 +1,180 @@
+#ifndef STEGO_JSON_HPP
+#define STEGO_JSON_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+
+/**
+ * \file json.hpp
+ * \brief Minimal writer for flat JSON objects (one result per line)
+ */
+
+
+
+/**
+ * \brief Escapes a string for use inside JSON quotes
+ * \param s Raw string (UTF-8 passes through, control bytes become \\u00XX)
+ * \return Escaped string without the surrounding quotes
+ */
+inline std::string jsonEscape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+/**
+ * \brief Whether a byte string is well-formed UTF-8 (no overlong forms, surrogates or code points past U+10FFFF)
+ */
+inline bool isValidUtf8(const std::string& s) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+    const unsigned char* end = p + s.size();
+    while (p < end) {
+        unsigned char c = *p++;
+        if (c < 0x80)
+            continue;
+        int more;
+        unsigned char lo = 0x80, hi = 0xBF;   // range of the first continuation byte
+        if (c >= 0xC2 && c <= 0xDF) {
+            more = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            more = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            more = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+        if (end - p < more || *p < lo || *p > hi)
+            return false;
+        for (int i = 1; i < more; ++i)
+            if ((p[i] & 0xC0) != 0x80)
+                return false;
+        p += more;
+    }
+    return true;
+}
+
+/**
+ * \brief Encodes bytes as standard base64 with padding
+ */
+inline std::string base64Encode(const std::string& s) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((s.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < s.size(); i += 3) {
+        uint32_t v = static_cast<uint32_t>(static_cast<unsigned char>(s[i])) << 16;
+        if (i + 1 < s.size())
+            v |= static_cast<uint32_t>(static_cast<unsigned char>(s[i + 1])) << 8;
+        if (i + 2 < s.size())
+            v |= static_cast<unsigned char>(s[i + 2]);
+        out += digits[v >> 18];
+        out += digits[(v >> 12) & 63];
+        out += i + 1 < s.size() ? digits[(v >> 6) & 63] : '=';
+        out += i + 2 < s.size() ? digits[v & 63] : '=';
+    }
+    return out;
+}
+
+/**
+ * \brief Builds a single-line JSON object field by field
+ */
+class JsonObject {
+public:
+    JsonObject& add(const char* key, const std::string& value) {
+        field(key);
+        body_ += '"';
+        body_ += jsonEscape(value);
+        body_ += '"';
+        return *this;
+    }
+
+    JsonObject& add(const char* key, const char* value) {
+        return add(key, std::string(value));
+    }
+
+    JsonObject& add(const char* key, uint64_t value) {
+        field(key);
+        body_ += std::to_string(value);
+        return *this;
+    }
+
+    JsonObject& add(const char* key, int64_t value) {
+        field(key);
+        body_ += std::to_string(value);
+        return *this;
+    }
+
+    JsonObject& add(const char* key, int value) {
+        return add(key, static_cast<int64_t>(value));
+    }
+
+    JsonObject& add(const char* key, double value) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6g", value);
+        field(key);
+        body_ += buf;
+        return *this;
+    }
+
+    JsonObject& add(const char* key, bool value) {
+        field(key);
+        body_ += value ? "true" : "false";
+        return *this;
+    }
+
+    /**
+     * \brief Adds arbitrary bytes: as a string under key if they are UTF-8 text, otherwise
+     *        base64-encoded under key with "_base64" appended, so the line stays valid JSON
+     */
+    JsonObject& addBytes(const char* key, const std::string& bytes) {
+        if (isValidUtf8(bytes))
+            return add(key, bytes);
+        return add((std::string(key) + "_base64").c_str(), base64Encode(bytes));
+    }
+
+    /**
+     * \brief Adds a value that is already valid JSON (nested object or array)
+     */
+    JsonObject& addRaw(const char* key, const std::string& json) {
+        field(key);
+        body_ += json;
+        return *this;
+    }
+
+    std::string str() const { return "{" + body_ + "}"; }
+
+private:
+    void field(const char* key) {
+        if (!body_.empty())
+            body_ += ',';
+        body_ += '"';
+        body_ += jsonEscape(key);
+        body_ += "\":";
+    }
+
+    std::string body_;
+};
+
+#endif
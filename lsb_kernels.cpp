@@ -0,0 +1,257 @@
+#include "lsb_kernels.hpp"
+#include "cpu_dispatch.hpp"
+#include <cstring>
+#ifdef STEG_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the scalar and vectorized LSB span kernels are realised
+ */
+
+
+
+namespace {
+
+inline void embedBit(uint8_t& sample, const uint8_t* payload, uint64_t bit) {
+    sample = static_cast<uint8_t>((sample & ~1) | ((payload[bit >> 3] >> (7 - (bit & 7))) & 1));
+}
+
+inline void extractBit(uint8_t sample, uint8_t* out, uint64_t bit) {
+    uint8_t mask = static_cast<uint8_t>(0x80 >> (bit & 7));
+    out[bit >> 3] = static_cast<uint8_t>((out[bit >> 3] & ~mask) | ((sample & 1) ? mask : 0));
+}
+
+// Bit-reversal of a byte: movemask puts sample 0 into bit 0, the payload wants it in bit 7
+struct ReverseTable {
+    uint8_t v[256];
+    ReverseTable() {
+        for (int i = 0; i < 256; ++i) {
+            int r = 0;
+            for (int b = 0; b < 8; ++b)
+                r |= ((i >> b) & 1) << (7 - b);
+            v[i] = static_cast<uint8_t>(r);
+        }
+    }
+};
+const ReverseTable kReverse;
+
+// Scalar body on byte-aligned payload: 8 samples per payload byte
+void embedBytesScalar(uint8_t* s, size_t bytes, const uint8_t* payload) {
+    for (size_t i = 0; i < bytes; ++i, s += 8) {
+        unsigned b = payload[i];
+        for (int k = 0; k < 8; ++k)
+            s[k] = static_cast<uint8_t>((s[k] & ~1) | ((b >> (7 - k)) & 1));
+    }
+}
+
+void extractBytesScalar(const uint8_t* s, size_t bytes, uint8_t* out) {
+    for (size_t i = 0; i < bytes; ++i, s += 8) {
+        unsigned b = 0;
+        for (int k = 0; k < 8; ++k)
+            b = (b << 1) | (s[k] & 1);
+        out[i] = static_cast<uint8_t>(b);
+    }
+}
+
+#ifdef STEG_X86
+// 16 samples (2 payload bytes) per step
+STEG_TARGET_SSE2 void embedBytesSSE2(uint8_t* s, size_t bytes, const uint8_t* payload) {
+    const __m128i bitMask = _mm_setr_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i keep = _mm_set1_epi8((char)0xFE);
+    size_t i = 0;
+    for (; i + 2 <= bytes; i += 2, s += 16) {
+        __m128i b = _mm_cvtsi32_si128(payload[i] | (payload[i + 1] << 8));
+        b = _mm_unpacklo_epi8(b, b);
+        b = _mm_unpacklo_epi16(b, b);
+        b = _mm_unpacklo_epi32(b, b);   // b0 x8, b1 x8
+        __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(b, bitMask), bitMask), one);
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        v = _mm_or_si128(_mm_and_si128(v, keep), bits);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s), v);
+    }
+    embedBytesScalar(s, bytes - i, payload + i);
+}
+
+STEG_TARGET_SSE2 void extractBytesSSE2(const uint8_t* s, size_t bytes, uint8_t* out) {
+    size_t i = 0;
+    for (; i + 2 <= bytes; i += 2, s += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        int m = _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+        out[i] = kReverse.v[m & 0xFF];
+        out[i + 1] = kReverse.v[(m >> 8) & 0xFF];
+    }
+    extractBytesScalar(s, bytes - i, out + i);
+}
+
+// 32 samples (4 payload bytes) per step
+STEG_TARGET_AVX2 void embedBytesAVX2(uint8_t* s, size_t bytes, const uint8_t* payload) {
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bitMask = _mm256_set1_epi64x(0x0102040810204080ll);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i keep = _mm256_set1_epi8((char)0xFE);
+    size_t i = 0;
+    for (; i + 4 <= bytes; i += 4, s += 32) {
+        int32_t word;
+        std::memcpy(&word, payload + i, 4);
+        __m256i b = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+        __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(b, bitMask), bitMask), one);
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        v = _mm256_or_si256(_mm256_and_si256(v, keep), bits);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(s), v);
+    }
+    embedBytesSSE2(s, bytes - i, payload + i);
+}
+
+STEG_TARGET_AVX2 void extractBytesAVX2(const uint8_t* s, size_t bytes, uint8_t* out) {
+    // Reverse each group of 8 samples so movemask yields payload bytes MSB-first
+    const __m256i reverse = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 4 <= bytes; i += 4, s += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        v = _mm256_shuffle_epi8(v, reverse);
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi16(v, 7)));
+        std::memcpy(out + i, &m, 4);
+    }
+    extractBytesSSE2(s, bytes - i, out + i);
+}
+#endif
+
+void embedBytes(uint8_t* s, size_t bytes, const uint8_t* payload) {
+#ifdef STEG_X86
+    switch (activeSimdLevel()) {
+        case SimdLevel::AVX2: embedBytesAVX2(s, bytes, payload); return;
+        case SimdLevel::SSE2: embedBytesSSE2(s, bytes, payload); return;
+        default: break;
+    }
+#endif
+    embedBytesScalar(s, bytes, payload);
+}
+
+void extractBytes(const uint8_t* s, size_t bytes, uint8_t* out) {
+#ifdef STEG_X86
+    switch (activeSimdLevel()) {
+        case SimdLevel::AVX2: extractBytesAVX2(s, bytes, out); return;
+        case SimdLevel::SSE2: extractBytesSSE2(s, bytes, out); return;
+        default: break;
+    }
+#endif
+    extractBytesScalar(s, bytes, out);
+}
+
+}  // namespace
+
+void lsbEmbedSpan(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset) {
+    size_t i = 0;
+    // Head: bring the payload position to a byte boundary
+    for (; i < count && ((bitOffset + i) & 7) != 0; ++i)
+        embedBit(samples[i], payload, bitOffset + i);
+    size_t bytes = (count - i) / 8;
+    embedBytes(samples + i, bytes, payload + ((bitOffset + i) >> 3));
+    i += bytes * 8;
+    for (; i < count; ++i)
+        embedBit(samples[i], payload, bitOffset + i);
+}
+
+void lsbExtractSpan(const uint8_t* samples, size_t count, uint8_t* out, uint64_t bitOffset) {
+    size_t i = 0;
+    for (; i < count && ((bitOffset + i) & 7) != 0; ++i)
+        extractBit(samples[i], out, bitOffset + i);
+    size_t bytes = (count - i) / 8;
+    extractBytes(samples + i, bytes, out + ((bitOffset + i) >> 3));
+    i += bytes * 8;
+    for (; i < count; ++i)
+        extractBit(samples[i], out, bitOffset + i);
+}
+
+
+// ==== K bits per sample ====
+namespace {
+
+// K payload bits starting at `bit`, as the low bits of the result
+template <int K>
+inline unsigned getBits(const uint8_t* payload, uint64_t bit) {
+    const uint8_t* p = payload + (bit >> 3);
+    unsigned shift = static_cast<unsigned>(bit & 7);
+    unsigned window = (p[0] << 8) | (shift + K > 8 ? p[1] : 0);
+    return (window >> (16 - shift - K)) & ((1u << K) - 1);
+}
+
+template <int K>
+inline void putBits(uint8_t* out, uint64_t bit, unsigned value) {
+    uint8_t* p = out + (bit >> 3);
+    unsigned shift = static_cast<unsigned>(bit & 7);
+    unsigned mask = ((1u << K) - 1) << (16 - shift - K);
+    unsigned window = value << (16 - shift - K);
+    p[0] = static_cast<uint8_t>((p[0] & ~(mask >> 8)) | (window >> 8));
+    if (shift + K > 8)
+        p[1] = static_cast<uint8_t>((p[1] & ~mask) | (window & 0xFF));
+}
+
+}  // namespace
+
+template <int K>
+void lsbEmbedSpanBits(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset) {
+    static_assert(K >= 1 && K <= 4, "1 to 4 bits per sample");
+    if (K == 1) {
+        lsbEmbedSpan(samples, count, payload, bitOffset);
+        return;
+    }
+    constexpr unsigned mask = (1u << K) - 1;
+    size_t i = 0;
+    for (; i < count && ((bitOffset + K * i) & 7) != 0; ++i)
+        samples[i] = static_cast<uint8_t>((samples[i] & ~mask) | getBits<K>(payload, bitOffset + K * i));
+    // Body: 8 samples take K whole payload bytes
+    const uint8_t* p = payload + ((bitOffset + K * i) >> 3);
+    for (; i + 8 <= count; i += 8, p += K) {
+        uint32_t word = 0;
+        for (int b = 0; b < K; ++b)
+            word = (word << 8) | p[b];
+        uint8_t* s = samples + i;
+        for (int j = 0; j < 8; ++j)
+            s[j] = static_cast<uint8_t>((s[j] & ~mask) | ((word >> (K * (7 - j))) & mask));
+    }
+    for (; i < count; ++i)
+        samples[i] = static_cast<uint8_t>((samples[i] & ~mask) | getBits<K>(payload, bitOffset + K * i));
+}
+
+template <int K>
+void lsbExtractSpanBits(const uint8_t* samples, size_t count, uint8_t* out, uint64_t bitOffset) {
+    static_assert(K >= 1 && K <= 4, "1 to 4 bits per sample");
+    if (K == 1) {
+        lsbExtractSpan(samples, count, out, bitOffset);
+        return;
+    }
+    constexpr unsigned mask = (1u << K) - 1;
+    size_t i = 0;
+    for (; i < count && ((bitOffset + K * i) & 7) != 0; ++i)
+        putBits<K>(out, bitOffset + K * i, samples[i] & mask);
+    uint8_t* p = out + ((bitOffset + K * i) >> 3);
+    for (; i + 8 <= count; i += 8, p += K) {
+        const uint8_t* s = samples + i;
+        uint32_t word = 0;
+        for (int j = 0; j < 8; ++j)
+            word = (word << K) | (s[j] & mask);
+        for (int b = K - 1; b >= 0; --b, word >>= 8)
+            p[b] = static_cast<uint8_t>(word);
+    }
+    for (; i < count; ++i)
+        putBits<K>(out, bitOffset + K * i, samples[i] & mask);
+}
+
+template void lsbEmbedSpanBits<1>(uint8_t*, size_t, const uint8_t*, uint64_t);
+template void lsbEmbedSpanBits<2>(uint8_t*, size_t, const uint8_t*, uint64_t);
+template void lsbEmbedSpanBits<3>(uint8_t*, size_t, const uint8_t*, uint64_t);
+template void lsbEmbedSpanBits<4>(uint8_t*, size_t, const uint8_t*, uint64_t);
+template void lsbExtractSpanBits<1>(const uint8_t*, size_t, uint8_t*, uint64_t);
+template void lsbExtractSpanBits<2>(const uint8_t*, size_t, uint8_t*, uint64_t);
+template void lsbExtractSpanBits<3>(const uint8_t*, size_t, uint8_t*, uint64_t);
+template void lsbExtractSpanBits<4>(const uint8_t*, size_t, uint8_t*, uint64_t);
@@ -0,0 +1,62 @@
+#ifndef STEGO_LSB_KERNELS_HPP
+#define STEGO_LSB_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * \file lsb_kernels.hpp
+ * \brief Row-span kernels moving packed payload bits into and out of sample LSBs
+ *
+ * A span is a contiguous run of 8-bit channel samples in raster order (one Mat row,
+ * or the whole image when it is continuous). Sample i of the span carries payload
+ * bit bitOffset + i, MSB-first within each payload byte. The SSE2/AVX2 versions are
+ * picked at runtime (see cpu_dispatch.hpp) and produce the same bytes as the scalar one.
+ */
+
+
+
+/**
+ * \brief Replaces the LSB of each sample with the next payload bit
+ * \param samples Span of channel samples to modify
+ * \param count Number of samples in the span
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the payload bit that goes into samples[0]
+ */
+void lsbEmbedSpan(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset);
+
+/**
+ * \brief Collects the LSB of each sample into packed payload bits
+ * \param samples Span of channel samples
+ * \param count Number of samples in the span
+ * \param out Packed output bytes; bits [bitOffset, bitOffset + count) are overwritten, others kept
+ * \param bitOffset Index of the payload bit taken from samples[0]
+ */
+void lsbExtractSpan(const uint8_t* samples, size_t count, uint8_t* out, uint64_t bitOffset);
+
+/**
+ * \brief Replaces the K low bits of each sample with the next K payload bits (K = 1..4)
+ *
+ * Sample i carries payload bits [bitOffset + K*i, bitOffset + K*(i+1)), the first of them in
+ * the highest of its K bits. K = 1 is lsbEmbedSpan; larger K unpack the K payload bytes of
+ * every 8 samples from one word. Up to 4 bytes past the last payload bit may be read.
+ * \param samples Span of channel samples to modify
+ * \param count Number of samples in the span
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the first payload bit that goes into samples[0]
+ */
+template <int K>
+void lsbEmbedSpanBits(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset);
+
+/**
+ * \brief Collects the K low bits of each sample into packed payload bits (K = 1..4)
+ * \param samples Span of channel samples
+ * \param count Number of samples in the span
+ * \param out Packed output bytes; bits [bitOffset, bitOffset + K*count) are overwritten, others kept
+ * \param bitOffset Index of the first payload bit taken from samples[0]
+ */
+template <int K>
+void lsbExtractSpanBits(const uint8_t* samples, size_t count, uint8_t* out, uint64_t bitOffset);
+
+#endif
@@ -1,13 +1,16 @@
 #include "steganography.hpp"
+#include "cli.hpp"
+#include "instrument.hpp"
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <optional>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
 
 
-int main() {
+int main(int argc, char** argv) {
     #ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
@@ -15,6 +18,17 @@ int main() {
 
     std::locale::global(std::locale(""));
 
+    // С аргументами программа работает в пакетном режиме без диалога
+    bool stats = argc == 2 && std::string(argv[1]) == "--stats";
+    if (argc > 1 && !stats)
+        return runCli(argc, argv);
+
+    // --stats: после операции время по фазам и счётчики выводятся в stderr строкой JSON
+    steg::Stats collected;
+    std::optional<steg::StatsScope> scope;
+    if (stats)
+        scope.emplace(collected);
+
     std::cout << "Выберите стеганографический метод:\n";
     std::cout << " 1 - LSB (Least Significant Bit)\n";
     std::cout << " 2 - HS (Histogram Shifting)\n";
@@ -32,5 +46,9 @@ int main() {
         case Method::PM1: runPM1(); break;
         default: std::cerr << "Неверный выбор метода.\n"; break;
     }
+    if (stats) {
+        scope.reset();
+        std::cerr << steg::statsJson(collected) << "\n";
+    }
     return 0;
 }
\ No newline at end of file
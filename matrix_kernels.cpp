@@ -0,0 +1,119 @@
+#include "matrix_kernels.hpp"
+#include "lsb_kernels.hpp"
+#include "pm1_kernels.hpp"
+#include <algorithm>
+
+/**
+ * \file
+ * \brief File, where the matrix embedding kernels are realised
+ */
+
+
+
+namespace {
+
+// Groups whose LSBs are packed at a time: 64 groups of at most 127 samples fit in 1 KiB
+const size_t kBatchGroups = 64;
+const size_t kBatchBytes = (kBatchGroups * ((1 << kMaxMatrixBits) - 1) + 7) / 8 + 1;
+
+// k <= 7 payload bits starting at bit pos, MSB-first
+inline unsigned readBits(const uint8_t* p, uint64_t pos, int k) {
+    size_t b = static_cast<size_t>(pos >> 3);
+    unsigned sh = static_cast<unsigned>(pos & 7);
+    unsigned w = static_cast<unsigned>(p[b]) << 8;
+    if (sh + k > 8)
+        w |= p[b + 1];
+    return (w >> (16 - sh - k)) & ((1u << k) - 1);
+}
+
+inline void writeBits(uint8_t* p, uint64_t pos, int k, unsigned v) {
+    size_t b = static_cast<size_t>(pos >> 3);
+    unsigned sh = static_cast<unsigned>(pos & 7);
+    unsigned mask = ((1u << k) - 1) << (16 - sh - k);
+    unsigned bits = v << (16 - sh - k);
+    p[b] = static_cast<uint8_t>((p[b] & ~(mask >> 8)) | (bits >> 8));
+    if (sh + k > 8)
+        p[b + 1] = static_cast<uint8_t>((p[b + 1] & ~mask) | (bits & 0xFF));
+}
+
+// Syndrome of the group whose n packed LSBs start at bit pos of lsb: one lookup per 8 bits
+inline unsigned syndromeAt(const MatrixCode& code, const uint8_t* lsb, uint64_t pos) {
+    unsigned s = 0;
+    int chunks = (code.n + 7) / 8;
+    for (int c = 0; c < chunks; ++c, pos += 8) {
+        size_t b = static_cast<size_t>(pos >> 3);
+        unsigned sh = static_cast<unsigned>(pos & 7);
+        unsigned v = sh ? ((lsb[b] << sh) | (lsb[b + 1] >> (8 - sh))) & 0xFF : lsb[b];
+        s ^= code.syndrome[c][v];
+    }
+    return s;
+}
+
+// Runs fn(group, syndrome) for every group, packing the LSBs of a batch of groups at a time
+template <typename Fn>
+void forEachSyndrome(const uint8_t* samples, size_t groups, const MatrixCode& code, Fn&& fn) {
+    uint8_t lsb[kBatchBytes] = {};
+    for (size_t g0 = 0; g0 < groups; g0 += kBatchGroups) {
+        size_t batch = std::min(kBatchGroups, groups - g0);
+        lsbExtractSpan(samples + g0 * code.n, batch * code.n, lsb, 0);
+        for (size_t g = 0; g < batch; ++g)
+            fn(g0 + g, syndromeAt(code, lsb, static_cast<uint64_t>(g) * code.n));
+    }
+}
+
+}  // namespace
+
+
+void buildMatrixCode(int k, MatrixCode& code) {
+    code.k = k;
+    code.n = (1 << k) - 1;
+    int chunks = (code.n + 7) / 8;
+    for (int c = 0; c < chunks; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            unsigned s = 0;
+            for (int t = 0; t < 8; ++t) {
+                int pos = 8 * c + t;
+                if (pos < code.n && ((v >> (7 - t)) & 1))
+                    s ^= static_cast<unsigned>(pos + 1);
+            }
+            code.syndrome[c][v] = static_cast<uint8_t>(s);
+        }
+    }
+}
+
+uint64_t matrixEmbedSpan(uint8_t* samples, size_t groups, const MatrixCode& code, const uint8_t* payload, uint64_t bitOffset) {
+    uint64_t changes = 0;
+    forEachSyndrome(samples, groups, code, [&](size_t g, unsigned s) {
+        unsigned d = s ^ readBits(payload, bitOffset + static_cast<uint64_t>(g) * code.k, code.k);
+        if (d != 0) {
+            samples[g * code.n + d - 1] ^= 1;
+            ++changes;
+        }
+    });
+    return changes;
+}
+
+uint64_t pm1MatrixEmbedSpan(uint8_t* samples, size_t groups, const MatrixCode& code, const uint8_t* payload, uint64_t bitOffset,
+                            uint64_t seed, uint64_t randomOffset) {
+    uint64_t changes = 0;
+    forEachSyndrome(samples, groups, code, [&](size_t g, unsigned s) {
+        unsigned d = s ^ readBits(payload, bitOffset + static_cast<uint64_t>(g) * code.k, code.k);
+        if (d == 0)
+            return;
+        size_t i = g * code.n + d - 1;
+        uint64_t r = randomOffset + i;
+        unsigned rnd = static_cast<unsigned>(pm1RandomWord(seed, r >> 6) >> (63 - (r & 63))) & 1u;
+        uint8_t& sample = samples[i];
+        // Same direction rule as pm1EmbedSpan: random 0 steps up, 1 down, reversed at 255 and 0
+        bool up = rnd == 0 ? sample != 255 : sample == 0;
+        sample = static_cast<uint8_t>(up ? sample + 1 : sample - 1);
+        ++changes;
+    });
+    return changes;
+}
+
+void matrixExtractSpan(const uint8_t* samples, size_t groups, const MatrixCode& code, uint8_t* out, uint64_t bitOffset) {
+    forEachSyndrome(samples, groups, code, [&](size_t g, unsigned s) {
+        writeBits(out, bitOffset + static_cast<uint64_t>(g) * code.k, code.k, s);
+    });
+}
@@ -0,0 +1,83 @@
+#ifndef STEGO_MATRIX_KERNELS_HPP
+#define STEGO_MATRIX_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * \file matrix_kernels.hpp
+ * \brief Span kernels for matrix embedding with the binary Hamming code (2^k - 1, 2^k - k - 1)
+ *
+ * A group of n = 2^k - 1 consecutive samples carries k payload bits as the syndrome of its
+ * LSBs: the XOR of the positions 1..n of the samples whose LSB is 1. Embedding changes at most
+ * one sample per group (the one at position syndrome XOR message), so on average a change
+ * carries k * 2^k / (2^k - 1) bits instead of the 2 bits of plain LSB replacement.
+ * The LSBs of a run of groups are packed with lsbExtractSpan and each syndrome is the XOR of
+ * one table lookup per 8 packed bits. Payload bits are packed MSB-first as in lsb_kernels.hpp;
+ * group g of a span carries payload bits [bitOffset + k*g, bitOffset + k*(g+1)).
+ */
+
+
+
+/**
+ * \brief Largest supported k (groups of 127 samples)
+ */
+constexpr int kMaxMatrixBits = 7;
+
+/**
+ * \brief Syndrome tables of the Hamming code for one k
+ */
+struct MatrixCode {
+    int k = 0;
+    int n = 0;   ///< Samples per group, 2^k - 1
+    /// syndrome[c][v]: XOR of the positions of the set bits of v (MSB first) among group bits 8c .. 8c + 7
+    uint8_t syndrome[(((1 << kMaxMatrixBits) - 1) + 7) / 8][256];
+};
+
+/**
+ * \brief Fills the syndrome tables for k message bits per group
+ * \param k 2..kMaxMatrixBits
+ * \param code Output tables
+ */
+void buildMatrixCode(int k, MatrixCode& code);
+
+/**
+ * \brief Makes the LSB syndrome of each group equal to the next k payload bits by flipping at most one LSB
+ * \param samples First sample of the first group
+ * \param groups Number of consecutive groups of code.n samples
+ * \param code Syndrome tables
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the first payload bit of group 0
+ * \return Number of samples changed
+ */
+uint64_t matrixEmbedSpan(uint8_t* samples, size_t groups, const MatrixCode& code, const uint8_t* payload, uint64_t bitOffset);
+
+/**
+ * \brief matrixEmbedSpan with the change made by a ±1 step, as in pm1EmbedSpan
+ *
+ * The step direction of the sample at span index i is random bit randomOffset + i of the
+ * PM1 stream, so it does not depend on how the image is split into spans.
+ * \param samples First sample of the first group
+ * \param groups Number of consecutive groups of code.n samples
+ * \param code Syndrome tables
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the first payload bit of group 0
+ * \param seed Random stream seed
+ * \param randomOffset Index of the random stream bit of samples[0]
+ * \return Number of samples changed
+ */
+uint64_t pm1MatrixEmbedSpan(uint8_t* samples, size_t groups, const MatrixCode& code, const uint8_t* payload, uint64_t bitOffset,
+                            uint64_t seed, uint64_t randomOffset);
+
+/**
+ * \brief Collects the syndrome of each group into packed payload bits
+ * \param samples First sample of the first group
+ * \param groups Number of consecutive groups of code.n samples
+ * \param code Syndrome tables
+ * \param out Packed output bytes; bits [bitOffset, bitOffset + k*groups) are overwritten, others kept
+ * \param bitOffset Index of the first payload bit of group 0
+ */
+void matrixExtractSpan(const uint8_t* samples, size_t groups, const MatrixCode& code, uint8_t* out, uint64_t bitOffset);
+
+#endif
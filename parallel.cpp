@@ -0,0 +1,161 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \file
+ * \brief File, where row-band parallelism is realised
+ */
+
+
+
+namespace {
+
+std::atomic<int> g_threads{0};
+
+// Below this many samples per band handing it to another thread costs more than it saves
+const uint64_t kMinBandSamples = 1 << 18;
+
+// One parallelForBands call; the caller and the pool workers claim its bands in order
+struct BandJob {
+    const std::function<void(int, int, int)>* fn;
+    int rows;
+    int bands;
+    std::atomic<int> next{1};   // band 0 is the caller's
+    int remaining;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    int start(int b) const { return static_cast<int>(static_cast<int64_t>(rows) * b / bands); }
+
+    // Runs bands until none is left to claim
+    void work() {
+        for (int b; (b = next.fetch_add(1)) < bands;)
+            runBand(b);
+    }
+
+    void runBand(int b) {
+        (*fn)(b, start(b), start(b + 1));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remaining == 0)
+            finished.notify_all();
+    }
+};
+
+// Kernel threads that outlive the calls, so a request does not pay for starting its threads.
+// Callers run bands themselves while they wait, so nested and concurrent calls always progress
+class KernelPool {
+public:
+    ~KernelPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : workers_)
+            t.join();
+    }
+
+    void run(const std::shared_ptr<BandJob>& job) {
+        int helpers = job->bands - 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (static_cast<int>(workers_.size()) < helpers)
+                workers_.emplace_back(&KernelPool::workerLoop, this);
+            for (int i = 0; i < helpers; ++i)
+                queue_.push_back(job);
+        }
+        if (helpers == 1)
+            wake_.notify_one();
+        else
+            wake_.notify_all();
+        job->runBand(0);
+        job->work();
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&] { return job->remaining == 0; });
+    }
+
+private:
+    void workerLoop() {
+        for (;;) {
+            std::shared_ptr<BandJob> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            job->work();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::shared_ptr<BandJob>> queue_;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+};
+
+KernelPool& kernelPool() {
+    static KernelPool pool;
+    return pool;
+}
+
+}  // namespace
+
+int threadCount() {
+    int n = g_threads.load(std::memory_order_relaxed);
+    if (n > 0)
+        return n;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : static_cast<int>(hw);
+}
+
+void setThreadCount(int n) {
+    g_threads.store(std::max(0, n), std::memory_order_relaxed);
+}
+
+int bandCount(int rows, uint64_t rowSamples, int threads) {
+    if (rows <= 0)
+        return 1;
+    if (threads <= 0)
+        threads = threadCount();
+    uint64_t total = static_cast<uint64_t>(rows) * rowSamples;
+    uint64_t bySize = std::max<uint64_t>(1, total / kMinBandSamples);
+    return static_cast<int>(std::min<uint64_t>({static_cast<uint64_t>(threads), bySize, static_cast<uint64_t>(rows)}));
+}
+
+void parallelForBands(int rows, int bands, const std::function<void(int, int, int)>& fn) {
+    bands = std::max(1, std::min(bands, std::max(rows, 1)));
+    if (bands == 1) {
+        fn(0, 0, rows);
+        return;
+    }
+    auto job = std::make_shared<BandJob>();
+    job->fn = &fn;
+    job->rows = rows;
+    job->bands = bands;
+    job->remaining = bands;
+    kernelPool().run(job);
+}
+
+void parallelForRange(uint64_t count, const std::function<void(uint64_t, uint64_t)>& fn, uint64_t align) {
+    align = std::max<uint64_t>(align, 1);
+    uint64_t units = (count + align - 1) / align;
+    int chunks = static_cast<int>(std::min<uint64_t>({static_cast<uint64_t>(threadCount()),
+                                                      std::max<uint64_t>(1, count / kMinBandSamples), std::max<uint64_t>(units, 1)}));
+    parallelForBands(chunks, chunks, [&](int chunk, int, int) {
+        uint64_t begin = std::min(count, units * chunk / chunks * align);
+        uint64_t end = std::min(count, units * (chunk + 1) / chunks * align);
+        if (begin < end)
+            fn(begin, end);
+    });
+}
@@ -0,0 +1,61 @@
+#ifndef STEGO_PARALLEL_HPP
+#define STEGO_PARALLEL_HPP
+
+#include <cstdint>
+#include <functional>
+
+
+/**
+ * \file parallel.hpp
+ * \brief Row-band parallelism shared by the pixel kernels
+ */
+
+
+
+/**
+ * \brief Number of worker threads the kernels may use
+ * \return Value set by setThreadCount, or the hardware concurrency when unset
+ */
+int threadCount();
+
+/**
+ * \brief Sets the number of worker threads used by the kernels
+ * \param n Thread count; 0 restores the hardware default
+ */
+void setThreadCount(int n);
+
+/**
+ * \brief Number of bands to split a job into
+ * \param rows Number of image rows
+ * \param rowSamples Number of samples in one row
+ * \param threads Requested thread count, 0 for threadCount()
+ * \return Band count in [1, rows], small jobs stay on one band
+ */
+int bandCount(int rows, uint64_t rowSamples, int threads = 0);
+
+/**
+ * \brief Splits rows [0, rows) into equal contiguous bands and runs them in parallel
+ *
+ * Band boundaries depend only on rows and bands, so per-band results merged in band order
+ * are deterministic. Band 0 runs on the calling thread, the others on a process-wide pool of
+ * kernel threads that stay alive between calls; the caller takes bands no pool thread has
+ * started yet, so calls from several threads or from inside a band never wait on each other.
+ * \param rows Number of rows
+ * \param bands Number of bands (see bandCount)
+ * \param fn Callback fn(band, firstRow, endRow)
+ */
+void parallelForBands(int rows, int bands, const std::function<void(int, int, int)>& fn);
+
+/**
+ * \brief Splits the index range [0, count) into contiguous chunks and runs fn on each, one thread per chunk
+ *
+ * Used where work is indexed by sample rather than by row (e.g. scattered payload positions).
+ * Chunk boundaries are multiples of `align`, so chunks never share an output byte when
+ * align is 8 and each index writes one bit.
+ * \param count Number of indices
+ * \param fn Callback fn(begin, end)
+ * \param align Granularity of chunk boundaries
+ */
+void parallelForRange(uint64_t count, const std::function<void(uint64_t, uint64_t)>& fn, uint64_t align = 1);
+
+#endif
@@ -0,0 +1,404 @@
+#include "payload_codec.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the payload codecs are realised
+ */
+
+
+
+namespace {
+
+// LZ4 block format limits: a match is at least 4 bytes, the last 5 bytes are literals and the
+// last match starts at least 12 bytes before the end of the block
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;
+const size_t kMatchLimit = 12;
+
+// Positions in a block of at most 64 KiB fit 16 bits; 2^13 entries keep the table in L1
+const int kHashBits = 13;
+
+// Bit 31 of a block word: the block is stored uncompressed
+const uint32_t kStoredBlock = 0x80000000u;
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+inline uint8_t* writeLength(uint8_t* op, size_t len) {
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+// Index of the lowest set bit of a non-zero word
+inline unsigned lowestBit(uint64_t w) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, w);
+    return static_cast<unsigned>(i);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(w));
+#endif
+}
+
+// Number of equal bytes at a and b (little-endian host), comparing no further than limit
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, const uint8_t* limit) {
+    const uint8_t* start = a;
+    while (a + 8 <= limit) {
+        uint64_t diff = read64(a) ^ read64(b);
+        if (diff != 0)
+            return static_cast<size_t>(a - start) + lowestBit(diff) / 8;
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return static_cast<size_t>(a - start);
+}
+
+uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t literalCount, size_t offset, size_t match) {
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4);
+    if (literalCount >= 15)
+        op = writeLength(op, literalCount - 15);
+    std::memcpy(op, literals, literalCount);
+    op += literalCount;
+    if (match == 0)
+        return op;   // the last sequence carries literals only
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    size_t code = match - kMinMatch;
+    *token |= static_cast<uint8_t>(std::min<size_t>(code, 15));
+    if (code >= 15)
+        op = writeLength(op, code - 15);
+    return op;
+}
+
+void putWord(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+uint32_t getWord(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Packs one block of at most kCodecBlock bytes, word included, into dst; returns the packed size
+size_t packBlock(const uint8_t* src, size_t n, uint8_t* dst) {
+    size_t packed = steg::lz4CompressBlock(src, n, dst + 4);
+    if (packed >= n) {
+        std::memcpy(dst + 4, src, n);
+        putWord(dst, kStoredBlock | static_cast<uint32_t>(n));
+        return n + 4;
+    }
+    putWord(dst, static_cast<uint32_t>(packed));
+    return packed + 4;
+}
+
+// Unpacks the bytes of a block with word `word` into kCodecBlock bytes at dst; false if they are malformed
+// Most message bytes a block can unpack to: a stored block holds its bytes as they are, and no
+// byte of an LZ4 block yields more than 255 (a match length byte)
+size_t blockOutputBound(uint32_t word) {
+    size_t n = word & ~kStoredBlock;
+    return std::min(steg::kCodecBlock, word & kStoredBlock ? n : n * 255);
+}
+
+bool unpackBlock(uint32_t word, const uint8_t* src, uint8_t* dst, size_t capacity, size_t& written) {
+    size_t n = word & ~kStoredBlock;
+    if (word & kStoredBlock) {
+        if (n > capacity)
+            return false;
+        std::memcpy(dst, src, n);
+        written = n;
+        return true;
+    }
+    return steg::lz4DecompressBlock(src, n, dst, capacity, written);
+}
+
+}  // namespace
+
+
+namespace steg {
+
+const char* codecName(Codec codec) {
+    switch (codec) {
+        case Codec::None: return "none";
+        case Codec::LZ4:  return "lz4";
+    }
+    return "unknown";
+}
+
+bool parseCodec(const std::string& name, Codec& codec) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (Codec c : {Codec::None, Codec::LZ4}) {
+        if (lower == codecName(c)) {
+            codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t lz4BlockBound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+size_t lz4CompressBlock(const uint8_t* src, size_t n, uint8_t* dst) {
+    uint8_t* op = dst;
+    if (n < kMatchLimit + 1)
+        return static_cast<size_t>(writeSequence(op, src, n, 0, 0) - dst);
+    uint16_t table[1 << kHashBits] = {};
+    const uint8_t* anchor = src;
+    const uint8_t* ip = src + 1;
+    const uint8_t* mflimit = src + n - kMatchLimit;
+    const uint8_t* matchEnd = src + n - kLastLiterals;
+    while (true) {
+        // Skips ahead faster the longer no match turns up, as incompressible data would
+        const uint8_t* ref;
+        unsigned attempts = 1u << 6;
+        for (;;) {
+            if (ip > mflimit)
+                return static_cast<size_t>(writeSequence(op, anchor, static_cast<size_t>(src + n - anchor), 0, 0) - dst);
+            uint32_t h = hash4(read32(ip));
+            ref = src + table[h];
+            table[h] = static_cast<uint16_t>(ip - src);
+            if (ref < ip && read32(ref) == read32(ip))
+                break;
+            ip += attempts++ >> 6;
+        }
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            --ip;
+            --ref;
+        }
+        size_t match = kMinMatch + matchLength(ip + kMinMatch, ref + kMinMatch, matchEnd);
+        op = writeSequence(op, anchor, static_cast<size_t>(ip - anchor), static_cast<size_t>(ip - ref), match);
+        ip += match;
+        anchor = ip;
+        if (ip > mflimit)
+            continue;
+        table[hash4(read32(ip - 2))] = static_cast<uint16_t>(ip - 2 - src);
+    }
+}
+
+bool lz4DecompressBlock(const uint8_t* src, size_t n, uint8_t* dst, size_t capacity, size_t& written) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + n;
+    size_t op = 0;
+    auto readLength = [&](size_t& len) {
+        uint8_t b;
+        do {
+            if (ip >= end)
+                return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals))
+            return false;
+        if (literals <= 16 && end - ip >= 16 && capacity - op >= 16) {
+            std::memcpy(dst + op, ip, 16);   // a fixed-size copy; the bytes past the literals are overwritten later
+        } else {
+            if (literals > static_cast<size_t>(end - ip) || literals > capacity - op)
+                return false;
+            std::memcpy(dst + op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == end)
+            break;
+        if (end - ip < 2)
+            return false;
+        size_t offset = ip[0] | (size_t(ip[1]) << 8);
+        ip += 2;
+        size_t match = (token & 15) + kMinMatch;
+        if ((token & 15) == 15 && !readLength(match))
+            return false;
+        if (offset == 0 || offset > op || match > capacity - op)
+            return false;
+        uint8_t* out = dst + op;
+        const uint8_t* from = out - offset;
+        size_t i = 0;
+        // 8 bytes at a time never read bytes the same step writes once the offset is at least 8,
+        // and may run up to 7 bytes past the match while the buffer has room for them; shorter
+        // offsets repeat the last offset bytes one at a time
+        if (offset >= 8) {
+            size_t limit = capacity - op >= match + 8 ? match : match & ~size_t(7);
+            for (; i < limit; i += 8)
+                std::memcpy(out + i, from + i, 8);
+        }
+        for (; i < match; ++i)
+            out[i] = from[i];
+        op += match;
+    }
+    written = op;
+    return true;
+}
+
+std::string packPayload(const std::string& message, Codec codec) {
+    if (codec == Codec::None)
+        return message;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(message.data());
+    size_t blocks = (message.size() + kCodecBlock - 1) / kCodecBlock;
+    size_t stride = lz4BlockBound(kCodecBlock) + 4;
+    std::vector<uint8_t> packed(blocks * stride);
+    std::vector<size_t> sizes(blocks);
+    // Blocks are independent, so they are packed in parallel and joined in order
+    parallelForRange(blocks, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t b = begin; b < end; ++b) {
+            size_t first = static_cast<size_t>(b) * kCodecBlock;
+            sizes[b] = packBlock(src + first, std::min(kCodecBlock, message.size() - first), packed.data() + b * stride);
+        }
+    });
+    std::string out;
+    size_t total = 0;
+    for (size_t s : sizes)
+        total += s;
+    out.reserve(total);
+    for (size_t b = 0; b < blocks; ++b)
+        out.append(reinterpret_cast<const char*>(packed.data() + b * stride), sizes[b]);
+    return out;
+}
+
+bool unpackPayload(const std::string& packed, Codec codec, std::string& message) {
+    message.clear();
+    if (codec == Codec::None) {
+        message = packed;
+        return true;
+    }
+    // The block words are walked first, then the blocks are unpacked in parallel, each into its
+    // kCodecBlock slot of the message. packPayload fills every block but the last and never writes
+    // an empty one, so anything else is refused before the message is allocated: a block that
+    // cannot fill its slot would let a few packed bytes claim 64 KiB each
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(packed.data());
+    std::vector<size_t> starts;
+    for (size_t pos = 0; pos < packed.size();) {
+        if (packed.size() - pos < 4)
+            return false;
+        uint32_t word = getWord(src + pos);
+        size_t n = word & ~kStoredBlock;
+        if (n == 0 || n > packed.size() - pos - 4)
+            return false;
+        pos += 4 + n;
+        if (pos < packed.size() && blockOutputBound(word) < kCodecBlock)
+            return false;
+        starts.push_back(pos - 4 - n);
+    }
+    if (starts.empty())
+        return true;
+    size_t blocks = starts.size();
+    size_t lastCapacity = blockOutputBound(getWord(src + starts.back()));
+    message.resize((blocks - 1) * kCodecBlock + lastCapacity);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(&message[0]);
+    std::vector<size_t> sizes(blocks);
+    std::vector<char> ok(blocks);
+    parallelForRange(blocks, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t b = begin; b < end; ++b) {
+            bool last = b + 1 == blocks;
+            size_t capacity = last ? lastCapacity : kCodecBlock;
+            ok[b] = ::unpackBlock(getWord(src + starts[b]), src + starts[b] + 4, dst + b * kCodecBlock, capacity, sizes[b]) &&
+                    (last || sizes[b] == kCodecBlock);
+        }
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+        message.clear();
+        return false;
+    }
+    message.resize((blocks - 1) * kCodecBlock + sizes.back());
+    return true;
+}
+
+std::unique_ptr<PayloadSource> packSource(PayloadSource& source, Codec) {
+    SpoolSink spool;
+    std::vector<uint8_t> plain(kCodecBlock);
+    std::vector<uint8_t> packed(lz4BlockBound(kCodecBlock) + 4);
+    uint64_t left = source.size();
+    while (left > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(left, kCodecBlock));
+        if (source.read(plain.data(), n) != n)
+            return nullptr;
+        if (!spool.write(packed.data(), packBlock(plain.data(), n, packed.data())))
+            return nullptr;
+        left -= n;
+    }
+    return spool.source();
+}
+
+bool UnpackSink::write(const uint8_t* data, size_t n) {
+    if (codec_ == Codec::None)
+        return out_.write(data, n);
+    if (corrupt_)
+        return false;
+    while (n > 0) {
+        size_t take = std::min(n, need_ - block_.size());
+        block_.insert(block_.end(), data, data + take);
+        data += take;
+        n -= take;
+        if (block_.size() < need_)
+            break;
+        if (need_ == 4) {
+            // The word is complete: collect the block bytes it announces
+            // As in unpackPayload: no empty blocks, and nothing after a block short of kCodecBlock
+            uint32_t word = getWord(block_.data());
+            if ((word & ~kStoredBlock) == 0 || (word & ~kStoredBlock) > lz4BlockBound(kCodecBlock) || ended_) {
+                corrupt_ = true;
+                return false;
+            }
+            need_ = 4 + (word & ~kStoredBlock);
+            continue;
+        }
+        if (!unpackBlock())
+            return false;
+    }
+    return true;
+}
+
+bool UnpackSink::finish() {
+    if (codec_ != Codec::None && !block_.empty())
+        corrupt_ = true;
+    return !corrupt_;
+}
+
+bool UnpackSink::unpackBlock() {
+    size_t written = 0;
+    plain_.resize(kCodecBlock);
+    if (!::unpackBlock(getWord(block_.data()), block_.data() + 4, plain_.data(), kCodecBlock, written)) {
+        corrupt_ = true;
+        return false;
+    }
+    ended_ = written < kCodecBlock;
+    block_.clear();
+    need_ = 4;
+    return out_.write(plain_.data(), written);
+}
+
+}  // namespace steg
@@ -0,0 +1,145 @@
+#ifndef STEGO_PAYLOAD_CODEC_HPP
+#define STEGO_PAYLOAD_CODEC_HPP
+
+#include "payload_stream.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file payload_codec.hpp
+ * \brief Compression of the message before it is embedded
+ *
+ * A packed message is a sequence of blocks, each holding at most kCodecBlock message bytes:
+ * a 32-bit big-endian word whose bit 31 marks a block stored as is and whose other bits give
+ * the number of bytes that follow (at least one), then those bytes. Every block but the last
+ * unpacks to exactly kCodecBlock bytes. Blocks are compressed independently in the LZ4 block
+ * format, so they are packed in parallel and unpacked one at a time into a sink with memory
+ * for a single block. A block that does not shrink is stored.
+ */
+
+
+
+namespace steg {
+
+/**
+ * \brief Payload compression codec, recorded in the header flags
+ */
+enum class Codec { None = 0, LZ4 = 1 };
+
+/**
+ * \brief Message bytes per block of a packed message
+ */
+constexpr size_t kCodecBlock = size_t(1) << 16;
+
+/**
+ * \brief Returns the short lowercase name of a codec ("none", "lz4")
+ * \param codec Codec to name
+ * \return Static null-terminated string
+ */
+const char* codecName(Codec codec);
+
+/**
+ * \brief Parses a codec name as returned by codecName (case-insensitive)
+ * \param name Codec name
+ * \param codec Output codec
+ * \return true if the name is known
+ */
+bool parseCodec(const std::string& name, Codec& codec);
+
+/**
+ * \brief Largest LZ4 block lz4CompressBlock can produce for n input bytes
+ */
+size_t lz4BlockBound(size_t n);
+
+/**
+ * \brief Compresses bytes into one LZ4 block (no frame, no checksum)
+ * \param src Input bytes, at most kCodecBlock of them
+ * \param n Number of input bytes
+ * \param dst Output buffer of at least lz4BlockBound(n) bytes
+ * \return Compressed size
+ */
+size_t lz4CompressBlock(const uint8_t* src, size_t n, uint8_t* dst);
+
+/**
+ * \brief Decompresses one LZ4 block, checking every length and offset against the buffers
+ * \param src Compressed block
+ * \param n Compressed size
+ * \param dst Output buffer
+ * \param capacity Size of dst
+ * \param written Output: decompressed size
+ * \return false if the block is malformed or does not fit into capacity bytes
+ */
+bool lz4DecompressBlock(const uint8_t* src, size_t n, uint8_t* dst, size_t capacity, size_t& written);
+
+/**
+ * \brief Packs a message with a codec
+ * \param message Message bytes
+ * \param codec Codec; Codec::None returns the message unchanged
+ * \return Packed message
+ */
+std::string packPayload(const std::string& message, Codec codec);
+
+/**
+ * \brief Unpacks a message packed by packPayload
+ * \param packed Packed bytes
+ * \param codec Codec the message was packed with
+ * \param message Output message
+ * \return false if the packed bytes are malformed or truncated
+ */
+bool unpackPayload(const std::string& packed, Codec codec, std::string& message);
+
+/**
+ * \brief Packs the whole of a source into an anonymous temporary file, one block in memory at a time
+ *
+ * The packed size goes into the header in front of the message, so it has to be known before
+ * the first band is embedded.
+ * \param source Message source, read to its end
+ * \param codec Codec other than Codec::None
+ * \return Source of the packed message, or nullptr if the source ended early or the file failed
+ */
+std::unique_ptr<PayloadSource> packSource(PayloadSource& source, Codec codec);
+
+/**
+ * \brief Sink that unpacks a packed message into another sink as each block completes
+ */
+class UnpackSink : public PayloadSink {
+public:
+    /**
+     * \brief Creates the sink
+     * \param out Destination of the message; it must outlive this sink
+     * \param codec Codec the message was packed with
+     */
+    UnpackSink(PayloadSink& out, Codec codec) : out_(out), codec_(codec) {}
+
+    bool write(const uint8_t* data, size_t n) override;
+
+    /**
+     * \brief Checks that the packed message ended on a block boundary; out is not finished
+     * \return false if a block is incomplete
+     */
+    bool finish() override;
+
+    /**
+     * \brief Whether a write failed because the packed bytes are malformed rather than because out failed
+     */
+    bool corrupt() const { return corrupt_; }
+
+private:
+    bool unpackBlock();
+
+    PayloadSink& out_;
+    Codec codec_;
+    std::vector<uint8_t> block_;   // block header and bytes received so far
+    std::vector<uint8_t> plain_;
+    size_t need_ = 4;              // size of the block being collected, header included
+    bool ended_ = false;           // a block short of kCodecBlock came, so it was the last one
+    bool corrupt_ = false;
+};
+
+}  // namespace steg
+
+#endif
@@ -0,0 +1,175 @@
+#include "payload_stream.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the payload sources and sinks are realised
+ */
+
+
+
+namespace {
+
+// Copy unit of a pipe spooled to a temporary file
+const size_t kSpoolChunk = size_t(1) << 16;
+
+struct FileCloser {
+    void operator()(std::FILE* f) const { if (f) std::fclose(f); }
+};
+using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+// A stdio stream on a duplicate of fd, so closing the stream leaves the caller's descriptor open
+FilePtr streamOnFd(int fd, const char* mode) {
+#ifdef _WIN32
+    int copy = _dup(fd);
+    std::FILE* f = copy >= 0 ? _fdopen(copy, mode) : nullptr;
+    if (!f && copy >= 0)
+        _close(copy);
+#else
+    int copy = ::dup(fd);
+    std::FILE* f = copy >= 0 ? ::fdopen(copy, mode) : nullptr;
+    if (!f && copy >= 0)
+        ::close(copy);
+#endif
+    return FilePtr(f);
+}
+
+// Bytes left in a regular file from the current position, or -1 for a pipe or terminal
+int64_t regularFileRemaining(int fd) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_fstat64(fd, &st) != 0 || !(st.st_mode & _S_IFREG))
+        return -1;
+    int64_t pos = _lseeki64(fd, 0, SEEK_CUR);
+#else
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return -1;
+    int64_t pos = ::lseek(fd, 0, SEEK_CUR);
+#endif
+    return pos < 0 ? -1 : std::max<int64_t>(0, static_cast<int64_t>(st.st_size) - pos);
+}
+
+class FileSource : public steg::PayloadSource {
+public:
+    FileSource(FilePtr file, uint64_t size) : file_(std::move(file)), size_(size) {}
+
+    uint64_t size() const override { return size_; }
+
+    size_t read(uint8_t* dst, size_t n) override {
+        n = static_cast<size_t>(std::min<uint64_t>(n, size_ - consumed_));
+        size_t got = n > 0 ? std::fread(dst, 1, n, file_.get()) : 0;
+        consumed_ += got;
+        return got;
+    }
+
+private:
+    FilePtr file_;
+    uint64_t size_;
+    uint64_t consumed_ = 0;
+};
+
+class FileSink : public steg::PayloadSink {
+public:
+    explicit FileSink(FilePtr file) : file_(std::move(file)) {}
+
+    bool write(const uint8_t* data, size_t n) override {
+        return std::fwrite(data, 1, n, file_.get()) == n;
+    }
+
+    bool finish() override {
+        return std::fflush(file_.get()) == 0;
+    }
+
+private:
+    FilePtr file_;
+};
+
+}  // namespace
+
+
+namespace steg {
+
+size_t MemorySource::read(uint8_t* dst, size_t n) {
+    n = std::min(n, size_ - pos_);
+    if (n > 0)
+        std::memcpy(dst, data_ + pos_, n);
+    pos_ += n;
+    return n;
+}
+
+std::unique_ptr<PayloadSource> openPayloadFile(const std::string& path) {
+    FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file || std::fseek(file.get(), 0, SEEK_END) != 0)
+        return nullptr;
+    long size = std::ftell(file.get());
+    if (size < 0 || std::fseek(file.get(), 0, SEEK_SET) != 0)
+        return nullptr;
+    return std::make_unique<FileSource>(std::move(file), static_cast<uint64_t>(size));
+}
+
+std::unique_ptr<PayloadSource> openPayloadFd(int fd) {
+    int64_t remaining = regularFileRemaining(fd);
+    FilePtr in = streamOnFd(fd, "rb");
+    if (!in)
+        return nullptr;
+    if (remaining >= 0)
+        return std::make_unique<FileSource>(std::move(in), static_cast<uint64_t>(remaining));
+
+    SpoolSink spool;
+    std::vector<uint8_t> chunk(kSpoolChunk);
+    size_t n;
+    while ((n = std::fread(chunk.data(), 1, chunk.size(), in.get())) > 0) {
+        if (!spool.write(chunk.data(), n))
+            return nullptr;
+    }
+    if (std::ferror(in.get()))
+        return nullptr;
+    return spool.source();
+}
+
+SpoolSink::SpoolSink() : file_(std::tmpfile()), failed_(file_ == nullptr) {}
+
+SpoolSink::~SpoolSink() {
+    if (file_)
+        std::fclose(file_);
+}
+
+bool SpoolSink::write(const uint8_t* data, size_t n) {
+    if (!failed_ && std::fwrite(data, 1, n, file_) != n)
+        failed_ = true;
+    size_ += n;
+    return !failed_;
+}
+
+std::unique_ptr<PayloadSource> SpoolSink::source() {
+    if (failed_ || std::fflush(file_) != 0 || std::fseek(file_, 0, SEEK_SET) != 0)
+        return nullptr;
+    FilePtr file(file_);
+    file_ = nullptr;
+    return std::make_unique<FileSource>(std::move(file), size_);
+}
+
+std::unique_ptr<PayloadSink> createPayloadFile(const std::string& path) {
+    FilePtr file(std::fopen(path.c_str(), "wb"));
+    if (!file)
+        return nullptr;
+    return std::make_unique<FileSink>(std::move(file));
+}
+
+std::unique_ptr<PayloadSink> openPayloadSinkFd(int fd) {
+    FilePtr out = streamOnFd(fd, "wb");
+    if (!out)
+        return nullptr;
+    return std::make_unique<FileSink>(std::move(out));
+}
+
+}  // namespace steg
@@ -0,0 +1,158 @@
+#ifndef STEGO_PAYLOAD_STREAM_HPP
+#define STEGO_PAYLOAD_STREAM_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+
+/**
+ * \file payload_stream.hpp
+ * \brief Sequential payload sources and sinks, so a message never has to be held whole in memory
+ *
+ * BandEmbedder pulls the message from a source a band's worth at a time and BandExtractor
+ * pushes the recovered bytes into a sink as soon as they are complete, so the memory used
+ * does not grow with the payload. Payloads are arbitrary bytes.
+ */
+
+
+
+namespace steg {
+
+/**
+ * \brief Sequential reader of a payload of known size
+ */
+class PayloadSource {
+public:
+    virtual ~PayloadSource() = default;
+
+    /**
+     * \brief Total number of payload bytes
+     */
+    virtual uint64_t size() const = 0;
+
+    /**
+     * \brief Reads the next bytes
+     * \param dst Output buffer
+     * \param n Number of bytes wanted
+     * \return Bytes read; fewer than n only at the end of the payload or on an error
+     */
+    virtual size_t read(uint8_t* dst, size_t n) = 0;
+};
+
+/**
+ * \brief Source over bytes in memory; the bytes must outlive the source
+ */
+class MemorySource : public PayloadSource {
+public:
+    MemorySource(const void* data, size_t size) : data_(static_cast<const uint8_t*>(data)), size_(size) {}
+    explicit MemorySource(const std::string& data) : MemorySource(data.data(), data.size()) {}
+
+    uint64_t size() const override { return size_; }
+    size_t read(uint8_t* dst, size_t n) override;
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+/**
+ * \brief Sequential writer of a recovered payload
+ */
+class PayloadSink {
+public:
+    virtual ~PayloadSink() = default;
+
+    /**
+     * \brief Appends bytes
+     * \return false on a write error
+     */
+    virtual bool write(const uint8_t* data, size_t n) = 0;
+
+    /**
+     * \brief Flushes buffered bytes after the last write
+     * \return false on a write error
+     */
+    virtual bool finish() { return true; }
+};
+
+/**
+ * \brief Sink that appends to a string
+ */
+class StringSink : public PayloadSink {
+public:
+    explicit StringSink(std::string& out) : out_(out) {}
+
+    bool write(const uint8_t* data, size_t n) override {
+        out_.append(reinterpret_cast<const char*>(data), n);
+        return true;
+    }
+
+private:
+    std::string& out_;
+};
+
+/**
+ * \brief Sink into an anonymous temporary file, read back afterwards as a source
+ *
+ * Used where the size of a payload has to be known before it is embedded but the payload
+ * arrives as a stream (a pipe, or a message being compressed).
+ */
+class SpoolSink : public PayloadSink {
+public:
+    SpoolSink();
+    ~SpoolSink() override;
+
+    SpoolSink(const SpoolSink&) = delete;
+    SpoolSink& operator=(const SpoolSink&) = delete;
+
+    bool write(const uint8_t* data, size_t n) override;
+
+    /**
+     * \brief Source over everything written; the sink must not be used afterwards
+     * \return Source, or nullptr if the file could not be created or written
+     */
+    std::unique_ptr<PayloadSource> source();
+
+private:
+    std::FILE* file_;
+    uint64_t size_ = 0;
+    bool failed_ = false;
+};
+
+/**
+ * \brief Opens a file as a payload source
+ * \param path Payload file
+ * \return Source, or nullptr if the file cannot be opened
+ */
+std::unique_ptr<PayloadSource> openPayloadFile(const std::string& path);
+
+/**
+ * \brief Opens a descriptor (a file, a pipe or standard input) as a payload source
+ *
+ * The size of a pipe is not known in advance, so its content is first copied in fixed-size
+ * chunks to an anonymous temporary file; memory use stays constant either way.
+ * \param fd Readable descriptor; it is not closed
+ * \return Source, or nullptr on a read error
+ */
+std::unique_ptr<PayloadSource> openPayloadFd(int fd);
+
+/**
+ * \brief Creates a file as a payload sink
+ * \param path Output file
+ * \return Sink, or nullptr if the file cannot be created
+ */
+std::unique_ptr<PayloadSink> createPayloadFile(const std::string& path);
+
+/**
+ * \brief Opens a descriptor (a file, a pipe or standard output) as a payload sink
+ * \param fd Writable descriptor; it is not closed
+ * \return Sink, or nullptr if the descriptor cannot be used
+ */
+std::unique_ptr<PayloadSink> openPayloadSinkFd(int fd);
+
+}  // namespace steg
+
+#endif
@@ -0,0 +1,169 @@
+#include "pipeline.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * \file
+ * \brief File, where the staged pipeline is realised
+ */
+
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msBetween(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// FIFO of slot indices; pop() returns false once the queue is closed and drained
+class SlotQueue {
+public:
+    explicit SlotQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    void push(size_t slot) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return queue_.size() < capacity_; });
+        queue_.push_back(slot);
+        lock.unlock();
+        notEmpty_.notify_one();
+    }
+
+    bool pop(size_t& slot) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if (queue_.empty())
+            return false;
+        slot = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notEmpty_.notify_all();
+    }
+
+private:
+    std::deque<size_t> queue_;
+    size_t capacity_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+}  // namespace
+
+
+double StageStats::occupancy(double wallMs) const {
+    return threads > 0 && wallMs > 0 ? std::min(1.0, busyMs / (threads * wallMs)) : 0.0;
+}
+
+void Pipeline::addStage(const std::string& name, int threads, StageFn fn) {
+    stages_.push_back({std::max(1, threads), std::move(fn)});
+    StageStats s;
+    s.name = name;
+    s.threads = stages_.back().threads;
+    stats_.push_back(s);
+}
+
+size_t Pipeline::slots() const {
+    size_t n = 0;
+    for (const Stage& stage : stages_)
+        n += 2 * static_cast<size_t>(stage.threads);   // one in work and one queued per thread
+    return std::max<size_t>(1, n);
+}
+
+void Pipeline::run(const std::function<bool(size_t slot)>& feed) {
+    for (StageStats& s : stats_) {
+        s.items = 0;
+        s.busyMs = s.starvedMs = s.blockedMs = 0;
+    }
+    auto start = Clock::now();
+    size_t slotCount = slots();
+    // Queue i feeds stage i; the free list takes the slots the last stage is done with
+    std::vector<std::unique_ptr<SlotQueue>> queues;
+    for (const Stage& stage : stages_)
+        queues.push_back(std::make_unique<SlotQueue>(stage.threads));
+    SlotQueue freeList(slotCount);
+    for (size_t i = 0; i < slotCount; ++i)
+        freeList.push(i);
+
+    std::mutex statsMutex;
+    std::vector<int> running(stages_.size());
+    std::vector<std::thread> threads;
+    for (size_t s = 0; s < stages_.size(); ++s) {
+        running[s] = stages_[s].threads;
+        SlotQueue& out = s + 1 < stages_.size() ? *queues[s + 1] : freeList;
+        for (int t = 0; t < stages_[s].threads; ++t) {
+            threads.emplace_back([&, s] {
+                StageStats mine;
+                size_t slot;
+                for (;;) {
+                    auto t0 = Clock::now();
+                    if (!queues[s]->pop(slot))
+                        break;
+                    auto t1 = Clock::now();
+                    stages_[s].fn(slot);
+                    auto t2 = Clock::now();
+                    out.push(slot);
+                    mine.starvedMs += msBetween(t0, t1);
+                    mine.busyMs += msBetween(t1, t2);
+                    mine.blockedMs += msBetween(t2, Clock::now());
+                    ++mine.items;
+                }
+                std::lock_guard<std::mutex> lock(statsMutex);
+                StageStats& total = stats_[s];
+                total.items += mine.items;
+                total.busyMs += mine.busyMs;
+                total.starvedMs += mine.starvedMs;
+                total.blockedMs += mine.blockedMs;
+                // The last thread of a stage to finish tells the next stage that nothing more comes
+                if (--running[s] == 0 && s + 1 < stages_.size())
+                    queues[s + 1]->close();
+            });
+        }
+    }
+
+    if (!stages_.empty()) {
+        size_t slot;
+        while (freeList.pop(slot)) {
+            if (!feed(slot))
+                break;
+            queues[0]->push(slot);
+        }
+        queues[0]->close();
+    }
+    for (std::thread& t : threads)
+        t.join();
+    wallMs_ = msBetween(start, Clock::now());
+}
+
+std::string Pipeline::statsJson() const {
+    std::string stages = "[";
+    for (const StageStats& s : stats_) {
+        JsonObject stage;
+        stage.add("name", s.name).add("threads", s.threads).add("items", s.items).add("busy_ms", s.busyMs)
+            .add("starved_ms", s.starvedMs).add("blocked_ms", s.blockedMs).add("occupancy", s.occupancy(wallMs_));
+        if (stages.size() > 1)
+            stages += ',';
+        stages += stage.str();
+    }
+    stages += ']';
+    JsonObject obj;
+    obj.add("wall_ms", wallMs_).addRaw("stages", stages);
+    return obj.str();
+}
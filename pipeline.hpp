@@ -0,0 +1,100 @@
+#ifndef STEGO_PIPELINE_HPP
+#define STEGO_PIPELINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file pipeline.hpp
+ * \brief Chain of worker stages joined by bounded queues, with recycled item slots
+ */
+
+
+
+/**
+ * \brief Where the threads of one pipeline stage spent a run
+ */
+struct StageStats {
+    std::string name;
+    int threads = 0;
+    uint64_t items = 0;
+    double busyMs = 0;      ///< In the stage function, summed over the stage threads
+    double starvedMs = 0;   ///< Waiting for an item from the previous stage, summed
+    double blockedMs = 0;   ///< Waiting for room in the queue of the next stage, summed
+
+    /**
+     * \brief Share of the stage threads' time spent working, 0..1
+     * \param wallMs Duration of the run
+     */
+    double occupancy(double wallMs) const;
+};
+
+/**
+ * \brief Fixed chain of stages, each with its own worker threads, that every item passes through in order
+ *
+ * Items are slot indices 0 .. slots() - 1 into storage the caller owns. A slot goes back to
+ * the free list when the last stage is done with it, so the buffers it holds serve the next
+ * item instead of being allocated again. The queue in front of a stage holds as many slots as
+ * the stage has threads and there are no more slots than the stages and queues can hold: a slow
+ * stage holds back the ones before it rather than letting their output pile up.
+ */
+class Pipeline {
+public:
+    /**
+     * \brief Work of a stage on one item; it runs on a stage thread and must not throw
+     */
+    using StageFn = std::function<void(size_t slot)>;
+
+    /**
+     * \brief Appends a stage
+     * \param name Name used in the statistics
+     * \param threads Number of worker threads of the stage (at least 1)
+     * \param fn Work done on each item
+     */
+    void addStage(const std::string& name, int threads, StageFn fn);
+
+    /**
+     * \brief Number of item slots; the caller's storage needs one entry per slot
+     */
+    size_t slots() const;
+
+    /**
+     * \brief Passes items through all stages until feed runs out
+     *
+     * Returns once the last item has left the last stage. Statistics of an earlier run are reset.
+     * \param feed Called on the calling thread with a free slot: fills it with the next item and
+     *             returns true, or returns false when there are no more items
+     */
+    void run(const std::function<bool(size_t slot)>& feed);
+
+    /**
+     * \brief Statistics of the last run, one entry per stage in order
+     */
+    const std::vector<StageStats>& stats() const { return stats_; }
+
+    /**
+     * \brief Duration of the last run
+     */
+    double wallMs() const { return wallMs_; }
+
+    /**
+     * \brief Formats the statistics of the last run as a single-line JSON object
+     */
+    std::string statsJson() const;
+
+private:
+    struct Stage {
+        int threads;
+        StageFn fn;
+    };
+
+    std::vector<Stage> stages_;
+    std::vector<StageStats> stats_;
+    double wallMs_ = 0;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "pm1_kernels.hpp"
+#include "cpu_dispatch.hpp"
+#include <cstring>
+#ifdef STEG_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the counter-based random stream and the PM1 span kernels are realised
+ */
+
+
+
+namespace {
+
+inline void embedSample(uint8_t& sample, unsigned bit, unsigned rnd) {
+    if ((sample & 1u) == bit)
+        return;
+    bool up = rnd == 0 ? sample != 255 : sample == 0;
+    sample = static_cast<uint8_t>(up ? sample + 1 : sample - 1);
+}
+
+// The 8 bytes of a random word in payload order: byte 0 holds the bits of the first 8 samples
+inline void wordBytes(uint64_t word, uint8_t* out) {
+    for (int j = 0; j < 8; ++j)
+        out[j] = static_cast<uint8_t>(word >> (56 - 8 * j));
+}
+
+// Scalar body: `blocks` runs of 64 samples, block b using random word first + b
+void embedBlocksScalar(uint8_t* s, size_t blocks, const uint8_t* payload, uint64_t first, uint64_t seed) {
+    for (size_t b = 0; b < blocks; ++b, s += 64, payload += 8) {
+        uint64_t word = pm1RandomWord(seed, first + b);
+        for (int k = 0; k < 64; ++k)
+            embedSample(s[k], (payload[k >> 3] >> (7 - (k & 7))) & 1u, static_cast<unsigned>(word >> (63 - k)) & 1u);
+    }
+}
+
+#ifdef STEG_X86
+// New sample values for 16 samples given 0xFF masks of the payload and random bits
+STEG_TARGET_SSE2 inline __m128i stepSSE2(__m128i v, __m128i bits, __m128i rnd) {
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    const __m128i all = _mm_set1_epi8((char)0xFF);
+    __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(v, one), one);
+    __m128i mismatch = _mm_xor_si128(odd, bits);
+    __m128i is255 = _mm_cmpeq_epi8(v, all);
+    __m128i is0 = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    // up = (!rnd && v != 255) || (rnd && v == 0)
+    __m128i up = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(rnd, is255), all), _mm_and_si128(rnd, is0));
+    __m128i delta = _mm_sub_epi8(_mm_and_si128(up, two), one);   // +1 or -1
+    return _mm_add_epi8(v, _mm_and_si128(delta, mismatch));
+}
+
+// Two packed bytes as 16 byte masks, MSB first
+STEG_TARGET_SSE2 inline __m128i expandSSE2(const uint8_t* p) {
+    const __m128i bitMask = _mm_setr_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    __m128i b = _mm_cvtsi32_si128(p[0] | (p[1] << 8));
+    b = _mm_unpacklo_epi8(b, b);
+    b = _mm_unpacklo_epi16(b, b);
+    b = _mm_unpacklo_epi32(b, b);   // b0 x8, b1 x8
+    return _mm_cmpeq_epi8(_mm_and_si128(b, bitMask), bitMask);
+}
+
+STEG_TARGET_SSE2 void embedBlocksSSE2(uint8_t* s, size_t blocks, const uint8_t* payload, uint64_t first, uint64_t seed) {
+    uint8_t rnd[8];
+    for (size_t b = 0; b < blocks; ++b, s += 64, payload += 8) {
+        wordBytes(pm1RandomWord(seed, first + b), rnd);
+        for (int k = 0; k < 4; ++k) {
+            __m128i* p = reinterpret_cast<__m128i*>(s + 16 * k);
+            __m128i v = _mm_loadu_si128(p);
+            _mm_storeu_si128(p, stepSSE2(v, expandSSE2(payload + 2 * k), expandSSE2(rnd + 2 * k)));
+        }
+    }
+}
+
+STEG_TARGET_AVX2 inline __m256i stepAVX2(__m256i v, __m256i bits, __m256i rnd) {
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i all = _mm256_set1_epi8((char)0xFF);
+    __m256i odd = _mm256_cmpeq_epi8(_mm256_and_si256(v, one), one);
+    __m256i mismatch = _mm256_xor_si256(odd, bits);
+    __m256i is255 = _mm256_cmpeq_epi8(v, all);
+    __m256i is0 = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+    __m256i up = _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(rnd, is255), all), _mm256_and_si256(rnd, is0));
+    __m256i delta = _mm256_sub_epi8(_mm256_and_si256(up, two), one);
+    return _mm256_add_epi8(v, _mm256_and_si256(delta, mismatch));
+}
+
+// Four packed bytes as 32 byte masks, MSB first
+STEG_TARGET_AVX2 inline __m256i expandAVX2(const uint8_t* p) {
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bitMask = _mm256_set1_epi64x(0x0102040810204080ll);
+    int32_t word;
+    std::memcpy(&word, p, 4);
+    __m256i b = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(b, bitMask), bitMask);
+}
+
+STEG_TARGET_AVX2 void embedBlocksAVX2(uint8_t* s, size_t blocks, const uint8_t* payload, uint64_t first, uint64_t seed) {
+    uint8_t rnd[8];
+    for (size_t b = 0; b < blocks; ++b, s += 64, payload += 8) {
+        wordBytes(pm1RandomWord(seed, first + b), rnd);
+        for (int k = 0; k < 2; ++k) {
+            __m256i* p = reinterpret_cast<__m256i*>(s + 32 * k);
+            __m256i v = _mm256_loadu_si256(p);
+            _mm256_storeu_si256(p, stepAVX2(v, expandAVX2(payload + 4 * k), expandAVX2(rnd + 4 * k)));
+        }
+    }
+}
+#endif
+
+void embedBlocks(uint8_t* s, size_t blocks, const uint8_t* payload, uint64_t first, uint64_t seed) {
+#ifdef STEG_X86
+    switch (activeSimdLevel()) {
+        case SimdLevel::AVX2: embedBlocksAVX2(s, blocks, payload, first, seed); return;
+        case SimdLevel::SSE2: embedBlocksSSE2(s, blocks, payload, first, seed); return;
+        default: break;
+    }
+#endif
+    embedBlocksScalar(s, blocks, payload, first, seed);
+}
+
+}  // namespace
+
+uint64_t pm1RandomWord(uint64_t seed, uint64_t index) {
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void pm1EmbedSpan(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset, uint64_t seed) {
+    size_t i = 0;
+    // Head and tail: one random word per sample is cheap enough for fewer than 64 samples
+    auto embedOne = [&](size_t at) {
+        uint64_t bit = bitOffset + at;
+        uint64_t word = pm1RandomWord(seed, bit >> 6);
+        embedSample(samples[at], (payload[bit >> 3] >> (7 - (bit & 7))) & 1u, static_cast<unsigned>(word >> (63 - (bit & 63))) & 1u);
+    };
+    for (; i < count && ((bitOffset + i) & 63) != 0; ++i)
+        embedOne(i);
+    size_t blocks = (count - i) / 64;
+    embedBlocks(samples + i, blocks, payload + ((bitOffset + i) >> 3), (bitOffset + i) >> 6, seed);
+    i += blocks * 64;
+    for (; i < count; ++i)
+        embedOne(i);
+}
+
+
+// ==== K bits per sample ====
+namespace {
+
+// Nearest value with the given low bits, computed without branches: on image data the direction
+// is unpredictable, and mispredicted jumps cost several times more than the arithmetic
+template <int K>
+inline uint8_t matchBits(uint8_t sample, unsigned bits, unsigned rnd) {
+    constexpr int range = 1 << K, half = range / 2;
+    int d = static_cast<int>((bits - sample) & (range - 1));   // sample + d has the wanted low bits
+    int down = sample + d - range;                              // up is down + range
+    int prefer = (d < half) | ((d == half) & (rnd == 0));       // d == 0 prefers up, the sample itself
+    int useUp = (prefer & (down + range <= 255)) | (down < 0);
+    return static_cast<uint8_t>(down + (useUp << K));
+}
+
+template <int K>
+inline unsigned payloadBits(const uint8_t* payload, uint64_t bit) {
+    const uint8_t* p = payload + (bit >> 3);
+    unsigned shift = static_cast<unsigned>(bit & 7);
+    unsigned window = (p[0] << 8) | (shift + K > 8 ? p[1] : 0);
+    return (window >> (16 - shift - K)) & ((1u << K) - 1);
+}
+
+// Random bits of consecutive stream positions, fetching one word per 64 of them
+class RandomBits {
+public:
+    explicit RandomBits(uint64_t seed) : seed_(seed) {}
+
+    unsigned at(uint64_t index) {
+        if ((index >> 6) != wordIndex_) {
+            wordIndex_ = index >> 6;
+            word_ = pm1RandomWord(seed_, wordIndex_);
+        }
+        return static_cast<unsigned>(word_ >> (63 - (index & 63))) & 1u;
+    }
+
+private:
+    uint64_t seed_;
+    uint64_t wordIndex_ = ~uint64_t(0);
+    uint64_t word_ = 0;
+};
+
+}  // namespace
+
+template <int K>
+void pm1EmbedSpanBits(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset, uint64_t seed, uint64_t randomOffset) {
+    static_assert(K >= 1 && K <= 4, "1 to 4 bits per sample");
+    if (K == 1 && randomOffset == bitOffset) {
+        pm1EmbedSpan(samples, count, payload, bitOffset, seed);
+        return;
+    }
+    constexpr unsigned mask = (1u << K) - 1;
+    RandomBits rnd(seed);
+    size_t i = 0;
+    for (; i < count && ((bitOffset + K * i) & 7) != 0; ++i)
+        samples[i] = matchBits<K>(samples[i], payloadBits<K>(payload, bitOffset + K * i), rnd.at(randomOffset + i));
+    // Body: 8 samples take K whole payload bytes
+    const uint8_t* p = payload + ((bitOffset + K * i) >> 3);
+    for (; i + 8 <= count; i += 8, p += K) {
+        uint32_t word = 0;
+        for (int b = 0; b < K; ++b)
+            word = (word << 8) | p[b];
+        uint8_t* s = samples + i;
+        for (int j = 0; j < 8; ++j)
+            s[j] = matchBits<K>(s[j], (word >> (K * (7 - j))) & mask, rnd.at(randomOffset + i + j));
+    }
+    for (; i < count; ++i)
+        samples[i] = matchBits<K>(samples[i], payloadBits<K>(payload, bitOffset + K * i), rnd.at(randomOffset + i));
+}
+
+template void pm1EmbedSpanBits<1>(uint8_t*, size_t, const uint8_t*, uint64_t, uint64_t, uint64_t);
+template void pm1EmbedSpanBits<2>(uint8_t*, size_t, const uint8_t*, uint64_t, uint64_t, uint64_t);
+template void pm1EmbedSpanBits<3>(uint8_t*, size_t, const uint8_t*, uint64_t, uint64_t, uint64_t);
+template void pm1EmbedSpanBits<4>(uint8_t*, size_t, const uint8_t*, uint64_t, uint64_t, uint64_t);
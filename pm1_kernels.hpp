@@ -0,0 +1,58 @@
+#ifndef STEGO_PM1_KERNELS_HPP
+#define STEGO_PM1_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * \file pm1_kernels.hpp
+ * \brief Row-span kernels for Plus-Minus One embedding with a counter-based random stream
+ *
+ * The direction of each ±1 step is a pure function of the seed and the payload bit index:
+ * random word n is SplitMix64 at counter n, and its bits (MSB first) belong to payload bits
+ * 64n .. 64n + 63. Any split of the image into spans, bands or threads therefore produces the
+ * same stego image for the same seed. Spans and bit order follow lsb_kernels.hpp; the SSE2/AVX2
+ * versions expand a whole random word per 64 samples and produce the same bytes as the scalar one.
+ */
+
+
+
+/**
+ * \brief Random word n of the stream for a seed
+ * \param seed Stream seed
+ * \param index Word counter; covers payload bits [64 * index, 64 * index + 64)
+ */
+uint64_t pm1RandomWord(uint64_t seed, uint64_t index);
+
+/**
+ * \brief Moves each sample whose parity differs from the next payload bit one step up or down
+ *
+ * A random bit 0 steps up and 1 steps down, except at 255 and 0, where the step is reversed.
+ * \param samples Span of channel samples to modify
+ * \param count Number of samples in the span
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the payload bit that goes into samples[0]
+ * \param seed Random stream seed
+ */
+void pm1EmbedSpan(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset, uint64_t seed);
+
+/**
+ * \brief Moves each sample to the nearest value whose K low bits equal the next K payload bits (K = 1..4)
+ *
+ * The generalisation of PM1 to K bits: the change is at most 2^(K-1) (except next to 0 and 255,
+ * where only one neighbour exists), and when both neighbours are equally far the random bit picks
+ * the direction as in pm1EmbedSpan.
+ * K = 1 is pm1EmbedSpan when randomOffset equals bitOffset. Payload bits are laid out as in
+ * lsbEmbedSpanBits, and up to 4 bytes past the last payload bit may be read.
+ * \param samples Span of channel samples to modify
+ * \param count Number of samples in the span
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the first payload bit that goes into samples[0]
+ * \param seed Random stream seed
+ * \param randomOffset Index of the random stream bit used by samples[0]
+ */
+template <int K>
+void pm1EmbedSpanBits(uint8_t* samples, size_t count, const uint8_t* payload, uint64_t bitOffset, uint64_t seed, uint64_t randomOffset);
+
+#endif
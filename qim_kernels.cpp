@@ -0,0 +1,227 @@
+#include "qim_kernels.hpp"
+#include "cpu_dispatch.hpp"
+#include <algorithm>
+#include <cstring>
+#ifdef STEG_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * \file
+ * \brief File, where the table-driven and vectorized QIM span kernels are realised
+ */
+
+
+
+namespace {
+
+inline void embedBit(uint8_t& sample, const QimTable& t, const uint8_t* payload, uint64_t bit) {
+    sample = t.quant[(payload[bit >> 3] >> (7 - (bit & 7))) & 1][sample];
+}
+
+inline void extractBit(uint8_t sample, const QimTable& t, uint8_t* out, uint64_t bit) {
+    uint8_t mask = static_cast<uint8_t>(0x80 >> (bit & 7));
+    out[bit >> 3] = static_cast<uint8_t>((out[bit >> 3] & ~mask) | (t.bit[sample] ? mask : 0));
+}
+
+// Bit-reversal of a byte: movemask puts sample 0 into bit 0, the payload wants it in bit 7
+struct ReverseTable {
+    uint8_t v[256];
+    ReverseTable() {
+        for (int i = 0; i < 256; ++i) {
+            int r = 0;
+            for (int b = 0; b < 8; ++b)
+                r |= ((i >> b) & 1) << (7 - b);
+            v[i] = static_cast<uint8_t>(r);
+        }
+    }
+};
+const ReverseTable kReverse;
+
+// Scalar body on byte-aligned payload: 8 samples per payload byte
+void embedBytesScalar(uint8_t* s, size_t bytes, const QimTable& t, const uint8_t* payload) {
+    for (size_t i = 0; i < bytes; ++i, s += 8) {
+        unsigned b = payload[i];
+        for (int k = 0; k < 8; ++k)
+            s[k] = t.quant[(b >> (7 - k)) & 1][s[k]];
+    }
+}
+
+void extractBytesScalar(const uint8_t* s, size_t bytes, const QimTable& t, uint8_t* out) {
+    for (size_t i = 0; i < bytes; ++i, s += 8) {
+        unsigned b = 0;
+        for (int k = 0; k < 8; ++k)
+            b = (b << 1) | t.bit[s[k]];
+        out[i] = static_cast<uint8_t>(b);
+    }
+}
+
+#ifdef STEG_X86
+// Lattice point below each 16-bit sample: (v * ceil(65536 / q)) >> 16 == v / q for v < 256, q <= 254
+STEG_TARGET_SSE2 inline __m128i latticeSSE2(__m128i v, __m128i recip, __m128i q) {
+    return _mm_mullo_epi16(_mm_mulhi_epu16(v, recip), q);
+}
+
+// 16 samples (2 payload bytes) per step
+STEG_TARGET_SSE2 void embedBytesSSE2(uint8_t* s, size_t bytes, const QimTable& t, const uint8_t* payload) {
+    const __m128i bitMask = _mm_setr_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i recip = _mm_set1_epi16(static_cast<short>(t.recip));
+    const __m128i q = _mm_set1_epi16(static_cast<short>(t.q));
+    const __m128i half = _mm_set1_epi16(static_cast<short>(t.q / 2));
+    size_t i = 0;
+    for (; i + 2 <= bytes; i += 2, s += 16) {
+        __m128i b = _mm_cvtsi32_si128(payload[i] | (payload[i + 1] << 8));
+        b = _mm_unpacklo_epi8(b, b);
+        b = _mm_unpacklo_epi16(b, b);
+        b = _mm_unpacklo_epi32(b, b);   // b0 x8, b1 x8
+        __m128i ones = _mm_cmpeq_epi8(_mm_and_si128(b, bitMask), bitMask);
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i lo = latticeSSE2(_mm_unpacklo_epi8(v, zero), recip, q);
+        __m128i hi = latticeSSE2(_mm_unpackhi_epi8(v, zero), recip, q);
+        lo = _mm_add_epi16(lo, _mm_and_si128(_mm_unpacklo_epi8(ones, ones), half));
+        hi = _mm_add_epi16(hi, _mm_and_si128(_mm_unpackhi_epi8(ones, ones), half));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s), _mm_packus_epi16(lo, hi));   // saturates as the table does
+    }
+    embedBytesScalar(s, bytes - i, t, payload + i);
+}
+
+STEG_TARGET_SSE2 void extractBytesSSE2(const uint8_t* s, size_t bytes, const QimTable& t, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i recip = _mm_set1_epi16(static_cast<short>(t.recip));
+    const __m128i q = _mm_set1_epi16(static_cast<short>(t.q));
+    const __m128i limit = _mm_set1_epi16(static_cast<short>(t.q - 1));
+    size_t i = 0;
+    for (; i + 2 <= bytes; i += 2, s += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        // Bit 1 when the remainder is at least q / 4
+        lo = _mm_cmpgt_epi16(_mm_slli_epi16(_mm_sub_epi16(lo, latticeSSE2(lo, recip, q)), 2), limit);
+        hi = _mm_cmpgt_epi16(_mm_slli_epi16(_mm_sub_epi16(hi, latticeSSE2(hi, recip, q)), 2), limit);
+        int m = _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+        out[i] = kReverse.v[m & 0xFF];
+        out[i + 1] = kReverse.v[(m >> 8) & 0xFF];
+    }
+    extractBytesScalar(s, bytes - i, t, out + i);
+}
+
+STEG_TARGET_AVX2 inline __m256i latticeAVX2(__m256i v, __m256i recip, __m256i q) {
+    return _mm256_mullo_epi16(_mm256_mulhi_epu16(v, recip), q);
+}
+
+// 32 samples (4 payload bytes) per step; unpack and pack both work per 128-bit lane, so sample order is kept
+STEG_TARGET_AVX2 void embedBytesAVX2(uint8_t* s, size_t bytes, const QimTable& t, const uint8_t* payload) {
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bitMask = _mm256_set1_epi64x(0x0102040810204080ll);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i recip = _mm256_set1_epi16(static_cast<short>(t.recip));
+    const __m256i q = _mm256_set1_epi16(static_cast<short>(t.q));
+    const __m256i half = _mm256_set1_epi16(static_cast<short>(t.q / 2));
+    size_t i = 0;
+    for (; i + 4 <= bytes; i += 4, s += 32) {
+        int32_t word;
+        std::memcpy(&word, payload + i, 4);
+        __m256i b = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+        __m256i ones = _mm256_cmpeq_epi8(_mm256_and_si256(b, bitMask), bitMask);
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        __m256i lo = latticeAVX2(_mm256_unpacklo_epi8(v, zero), recip, q);
+        __m256i hi = latticeAVX2(_mm256_unpackhi_epi8(v, zero), recip, q);
+        lo = _mm256_add_epi16(lo, _mm256_and_si256(_mm256_unpacklo_epi8(ones, ones), half));
+        hi = _mm256_add_epi16(hi, _mm256_and_si256(_mm256_unpackhi_epi8(ones, ones), half));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(s), _mm256_packus_epi16(lo, hi));
+    }
+    embedBytesSSE2(s, bytes - i, t, payload + i);
+}
+
+STEG_TARGET_AVX2 void extractBytesAVX2(const uint8_t* s, size_t bytes, const QimTable& t, uint8_t* out) {
+    // Reverse each group of 8 samples so movemask yields payload bytes MSB-first
+    const __m256i reverse = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i recip = _mm256_set1_epi16(static_cast<short>(t.recip));
+    const __m256i q = _mm256_set1_epi16(static_cast<short>(t.q));
+    const __m256i limit = _mm256_set1_epi16(static_cast<short>(t.q - 1));
+    size_t i = 0;
+    for (; i + 4 <= bytes; i += 4, s += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        lo = _mm256_cmpgt_epi16(_mm256_slli_epi16(_mm256_sub_epi16(lo, latticeAVX2(lo, recip, q)), 2), limit);
+        hi = _mm256_cmpgt_epi16(_mm256_slli_epi16(_mm256_sub_epi16(hi, latticeAVX2(hi, recip, q)), 2), limit);
+        __m256i bits = _mm256_shuffle_epi8(_mm256_packs_epi16(lo, hi), reverse);
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(bits));
+        std::memcpy(out + i, &m, 4);
+    }
+    extractBytesSSE2(s, bytes - i, t, out + i);
+}
+#endif
+
+void embedBytes(uint8_t* s, size_t bytes, const QimTable& t, const uint8_t* payload) {
+#ifdef STEG_X86
+    if (t.recip != 0) {
+        switch (activeSimdLevel()) {
+            case SimdLevel::AVX2: embedBytesAVX2(s, bytes, t, payload); return;
+            case SimdLevel::SSE2: embedBytesSSE2(s, bytes, t, payload); return;
+            default: break;
+        }
+    }
+#endif
+    embedBytesScalar(s, bytes, t, payload);
+}
+
+void extractBytes(const uint8_t* s, size_t bytes, const QimTable& t, uint8_t* out) {
+#ifdef STEG_X86
+    if (t.recip != 0) {
+        switch (activeSimdLevel()) {
+            case SimdLevel::AVX2: extractBytesAVX2(s, bytes, t, out); return;
+            case SimdLevel::SSE2: extractBytesSSE2(s, bytes, t, out); return;
+            default: break;
+        }
+    }
+#endif
+    extractBytesScalar(s, bytes, t, out);
+}
+
+}  // namespace
+
+void buildQimTable(int q, QimTable& table) {
+    table.q = q;
+    table.recip = q <= 254 ? static_cast<uint16_t>((65536 + q - 1) / q) : 0;
+    for (int v = 0; v < 256; ++v) {
+        int base = (v / q) * q;
+        int r = v - base;
+        table.quant[0][v] = static_cast<uint8_t>(base);
+        table.quant[1][v] = static_cast<uint8_t>(std::min(base + q / 2, 255));
+        // Not nearer to base than to base + q/2 (same as comparing |v - p0| with |v - p1|, ties give 1)
+        table.bit[v] = static_cast<uint8_t>(4 * r >= q ? 1 : 0);
+    }
+}
+
+void qimEmbedSpan(uint8_t* samples, size_t count, const QimTable& table, const uint8_t* payload, uint64_t bitOffset) {
+    size_t i = 0;
+    // Head: bring the payload position to a byte boundary
+    for (; i < count && ((bitOffset + i) & 7) != 0; ++i)
+        embedBit(samples[i], table, payload, bitOffset + i);
+    size_t bytes = (count - i) / 8;
+    embedBytes(samples + i, bytes, table, payload + ((bitOffset + i) >> 3));
+    i += bytes * 8;
+    for (; i < count; ++i)
+        embedBit(samples[i], table, payload, bitOffset + i);
+}
+
+void qimExtractSpan(const uint8_t* samples, size_t count, const QimTable& table, uint8_t* out, uint64_t bitOffset) {
+    size_t i = 0;
+    for (; i < count && ((bitOffset + i) & 7) != 0; ++i)
+        extractBit(samples[i], table, out, bitOffset + i);
+    size_t bytes = (count - i) / 8;
+    extractBytes(samples + i, bytes, table, out + ((bitOffset + i) >> 3));
+    i += bytes * 8;
+    for (; i < count; ++i)
+        extractBit(samples[i], table, out, bitOffset + i);
+}
@@ -0,0 +1,57 @@
+#ifndef STEGO_QIM_KERNELS_HPP
+#define STEGO_QIM_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * \file qim_kernels.hpp
+ * \brief Table-driven row-span kernels for Quantization Index Modulation
+ *
+ * For a fixed step q both QIM maps depend on the sample value only, so they are
+ * precomputed once per call instead of dividing per sample. Spans and bit order follow
+ * lsb_kernels.hpp. The SSE2/AVX2 versions compute the same maps with a 16-bit
+ * reciprocal multiply (exact for 8-bit samples) and produce the same bytes as the tables.
+ */
+
+
+
+/**
+ * \brief Precomputed QIM maps for one quantization step
+ */
+struct QimTable {
+    int q = 0;
+    uint8_t quant[2][256];   ///< Sample value after embedding bit 0 / bit 1
+    uint8_t bit[256];        ///< Bit decoded from a sample value
+    uint16_t recip = 0;      ///< ceil(65536 / q) for the vector paths, 0 when q > 254
+};
+
+/**
+ * \brief Fills the tables for a quantization step
+ * \param q Quantization step (even, >= 2)
+ * \param table Output tables
+ */
+void buildQimTable(int q, QimTable& table);
+
+/**
+ * \brief Quantizes each sample onto the lattice selected by the next payload bit
+ * \param samples Span of channel samples to modify
+ * \param count Number of samples in the span
+ * \param table Tables for the quantization step
+ * \param payload Packed payload bytes, MSB-first
+ * \param bitOffset Index of the payload bit that goes into samples[0]
+ */
+void qimEmbedSpan(uint8_t* samples, size_t count, const QimTable& table, const uint8_t* payload, uint64_t bitOffset);
+
+/**
+ * \brief Decodes the bit carried by each sample into packed payload bits
+ * \param samples Span of channel samples
+ * \param count Number of samples in the span
+ * \param table Tables for the quantization step
+ * \param out Packed output bytes; bits [bitOffset, bitOffset + count) are overwritten, others kept
+ * \param bitOffset Index of the payload bit taken from samples[0]
+ */
+void qimExtractSpan(const uint8_t* samples, size_t count, const QimTable& table, uint8_t* out, uint64_t bitOffset);
+
+#endif
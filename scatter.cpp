@@ -0,0 +1,74 @@
+#include "scatter.hpp"
+
+/**
+ * \file
+ * \brief File, where the keyed Feistel permutation of sample indices is realised
+ */
+
+
+
+namespace {
+
+// SplitMix64 finalizer: expands the key into round keys
+inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Round function: multiplicative hash of the keyed half, taking the well-mixed top bits of the product
+inline uint64_t roundHash(uint64_t half, uint64_t roundKey, int halfBits) {
+    return ((half ^ roundKey) * 0xD6E8FEB86659FD93ull + roundKey) >> (64 - halfBits);
+}
+
+}  // namespace
+
+Scatter::Scatter(uint64_t domain, uint64_t key) : domain_(domain) {
+    int bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) < domain)
+        ++bits;
+    halfBits_ = bits < 2 ? 1 : (bits + 1) / 2;
+    halfMask_ = (uint64_t(1) << halfBits_) - 1;
+    for (int r = 0; r < kRounds; ++r)
+        roundKey_[r] = mix64(key + (r + 1) * 0x9E3779B97F4A7C15ull);
+}
+
+uint64_t Scatter::encrypt(uint64_t x) const {
+    uint64_t left = x >> halfBits_, right = x & halfMask_;
+    for (int r = 0; r < kRounds; ++r) {
+        uint64_t next = left ^ roundHash(right, roundKey_[r], halfBits_);
+        left = right;
+        right = next;
+    }
+    return (left << halfBits_) | right;
+}
+
+uint64_t Scatter::decrypt(uint64_t x) const {
+    uint64_t left = x >> halfBits_, right = x & halfMask_;
+    for (int r = kRounds - 1; r >= 0; --r) {
+        uint64_t prev = right ^ roundHash(left, roundKey_[r], halfBits_);
+        right = left;
+        left = prev;
+    }
+    return (left << halfBits_) | right;
+}
+
+uint64_t Scatter::map(uint64_t i) const {
+    if (domain_ <= 1)
+        return i;
+    // The network permutes up to 4x the domain; walking the cycle until it re-enters the domain
+    // keeps the map a bijection of [0, domain)
+    uint64_t x = encrypt(i);
+    while (x >= domain_)
+        x = encrypt(x);
+    return x;
+}
+
+uint64_t Scatter::unmap(uint64_t s) const {
+    if (domain_ <= 1)
+        return s;
+    uint64_t x = decrypt(s);
+    while (x >= domain_)
+        x = decrypt(x);
+    return x;
+}
@@ -0,0 +1,56 @@
+#ifndef STEGO_SCATTER_HPP
+#define STEGO_SCATTER_HPP
+
+#include <cstdint>
+
+
+/**
+ * \file scatter.hpp
+ * \brief Keyed pseudo-random permutation of sample indices in constant memory
+ *
+ * A four-round Feistel network over the smallest even number of bits that covers the domain,
+ * with cycle-walking to stay inside it. Both directions cost a few hashes per index and need
+ * no tables, so any range of indices can be mapped independently (and in parallel).
+ */
+
+
+
+/**
+ * \brief Bijection of [0, domain) selected by a key
+ */
+class Scatter {
+public:
+    /**
+     * \brief Creates the permutation
+     * \param domain Number of indices (e.g. channel samples of an image)
+     * \param key Permutation key
+     */
+    Scatter(uint64_t domain, uint64_t key);
+
+    uint64_t domain() const { return domain_; }
+
+    /**
+     * \brief Image position of index i
+     * \param i Index in [0, domain)
+     */
+    uint64_t map(uint64_t i) const;
+
+    /**
+     * \brief Index whose position is s; unmap(map(i)) == i
+     * \param s Position in [0, domain)
+     */
+    uint64_t unmap(uint64_t s) const;
+
+private:
+    static const int kRounds = 4;
+
+    uint64_t encrypt(uint64_t x) const;
+    uint64_t decrypt(uint64_t x) const;
+
+    uint64_t domain_;
+    int halfBits_ = 1;
+    uint64_t halfMask_ = 1;
+    uint64_t roundKey_[kRounds];
+};
+
+#endif
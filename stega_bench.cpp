@@ -0,0 +1,445 @@
+#include "stego_api.hpp"
+#include "instrument.hpp"
+#include "json.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <vector>
+
+/**
+ * \file
+ * \brief Throughput benchmark of embedding and extraction for all four methods
+ *
+ * Usage: stega_bench [--sizes 1,4,16,100] [--reps N] [--bits 1,2,3,4] [--matrix 2,3,4] [--json] [--no-cat] [--codecs] [--compress] [image ...]
+ *
+ * Every size (in megapixels) is benchmarked on three synthetic covers (noise, flat, gradient),
+ * followed by ../cat.png (found from the build directory, as in the console program) and the
+ * given images. Each method embeds a message filling its capacity and extracts it again; the
+ * best of N runs is reported. Image decode/encode (PNG) are timed
+ * separately and are not part of the embed/extract numbers. One CSV row (or JSON line) is printed
+ * per cover and method. Peak RSS is the process high-water mark at the time of the row.
+ * --bits adds rows for LSB and PM1 with several message bits per channel (capacity grows with it).
+ * --matrix adds rows for LSB and PM1 with matrix embedding of the given code sizes. Every row
+ * reports the embedding efficiency: message bits per changed channel sample.
+ *
+ * With --codecs the same covers go through every lossless output setting instead (PNG levels
+ * and strategies, BMP, PPM, PAM, TIFF with and without compression), reporting encode/decode
+ * time, size and whether the round trip is bit-exact.
+ *
+ * With --compress every method embeds JSON records, log lines and random bytes filling its
+ * unpacked capacity, once as is and once packed with LZ4, reporting the packed size, the
+ * embed/extract time (packing and unpacking included) and the samples changed.
+ */
+
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Cover {
+    std::string name;
+    cv::Mat image;
+    double decodeMs = 0;   // 0 for synthetic covers
+};
+
+struct Row {
+    std::string cover;
+    std::string method;
+    int bits = 1;
+    int matrix = 0;
+    int width = 0, height = 0;
+    uint64_t messageBytes = 0;
+    double bitsPerChange = 0;
+    double decodeMs = 0, embedMs = 0, extractMs = 0, encodeMs = 0;
+    bool ok = false;
+};
+
+double elapsedMs(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// Best wall time of reps runs, in milliseconds
+double bestOf(int reps, const std::function<void()>& fn) {
+    double best = 1e300;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = Clock::now();
+        fn();
+        best = std::min(best, elapsedMs(t0));
+    }
+    return best;
+}
+
+// Size in megapixels -> 4:3 image of about that many pixels
+cv::Size sizeForMegapixels(double mp) {
+    int width = std::max(1, static_cast<int>(std::sqrt(mp * 1e6 * 4 / 3)));
+    int height = std::max(1, static_cast<int>(mp * 1e6 / width));
+    return cv::Size(width, height);
+}
+
+cv::Mat noiseCover(cv::Size size) {
+    cv::Mat image(size, CV_8UC3);
+    cv::randu(image, 0, 256);
+    return image;
+}
+
+cv::Mat flatCover(cv::Size size) {
+    return cv::Mat(size, CV_8UC3, cv::Scalar(128, 128, 128));
+}
+
+// Smooth per-channel gradients with mild sensor-like noise: peaked but not degenerate histograms
+cv::Mat gradientCover(cv::Size size) {
+    cv::Mat image(size, CV_8UC3);
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> noise(-2, 2);
+    for (int y = 0; y < size.height; ++y) {
+        uchar* row = image.ptr<uchar>(y);
+        int gy = y * 160 / size.height;
+        for (int x = 0; x < size.width; ++x) {
+            int gx = x * 96 / size.width;
+            row[3 * x + 0] = cv::saturate_cast<uchar>(40 + gy + noise(gen));
+            row[3 * x + 1] = cv::saturate_cast<uchar>(60 + gx + gy / 2 + noise(gen));
+            row[3 * x + 2] = cv::saturate_cast<uchar>(200 - gy / 2 - gx + noise(gen));
+        }
+    }
+    return image;
+}
+
+std::string randomMessage(size_t size) {
+    std::string message(size, '\0');
+    uint64_t s = 0x9E3779B97F4A7C15ull;
+    for (char& c : message) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        c = static_cast<char>(s);
+    }
+    return message;
+}
+
+// Text payloads: records built from a small vocabulary and varying numbers, cut to size
+std::string textMessage(size_t size, bool json) {
+    static const char* levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+    static const char* events[] = {"request served", "cache miss", "retrying upstream", "session opened", "payload stored"};
+    static const char* hosts[] = {"edge-01", "edge-02", "api-7", "worker-3"};
+    std::string message;
+    message.reserve(size + 256);
+    uint64_t s = 0x2545F4914F6CDD1Dull;
+    char line[256];
+    for (unsigned i = 0; message.size() < size; ++i) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        unsigned r = static_cast<unsigned>(s);
+        if (json)
+            std::snprintf(line, sizeof(line), "{\"id\":%u,\"ts\":%u,\"host\":\"%s\",\"level\":\"%s\",\"event\":\"%s\",\"latency_ms\":%u,\"bytes\":%u}\n",
+                          1000000 + i, 1700000000 + i * 3 + (r & 3), hosts[r % 4], levels[(r >> 4) % 4], events[(r >> 8) % 5],
+                          (r >> 12) % 500, (r >> 16) % 65536);
+        else
+            std::snprintf(line, sizeof(line), "2026-10-16T12:%02u:%02u.%03uZ %s [%s] %s id=%u latency=%ums\n",
+                          (i / 600) % 60, (i / 10) % 60, r % 1000, hosts[r % 4], levels[(r >> 4) % 4], events[(r >> 8) % 5],
+                          1000000 + i, (r >> 12) % 500);
+        message += line;
+    }
+    message.resize(size);
+    return message;
+}
+
+Row benchMethod(const Cover& cover, Method method, int bits, int matrix, int reps) {
+    Row row;
+    row.cover = cover.name;
+    row.method = steg::methodName(method);
+    row.bits = bits;
+    row.matrix = matrix;
+    row.width = cover.image.cols;
+    row.height = cover.image.rows;
+    row.decodeMs = cover.decodeMs;
+
+    steg::EmbedOptions eopts;
+    eopts.method = method;
+    eopts.bitsPerChannel = bits;
+    eopts.matrixBits = matrix;
+    steg::CapacityResult cap = steg::capacity(cover.image, eopts);
+    if (cap.status != steg::Status::Ok)
+        return row;
+    const std::string message = randomMessage(static_cast<size_t>(cap.maxBytes));
+    row.messageBytes = message.size();
+
+    steg::EmbedResult emb;
+    row.embedMs = bestOf(reps, [&] { emb = steg::embed(cover.image, message, eopts); });
+    if (emb.status != steg::Status::Ok)
+        return row;
+    int changed = cv::countNonZero((emb.stego != cover.image).reshape(1, 0));
+    row.bitsPerChange = changed > 0 ? static_cast<double>(message.size()) * 8 / changed : 0.0;
+
+    steg::ExtractOptions xopts;
+    xopts.method = method;
+    steg::ExtractResult ext;
+    row.extractMs = bestOf(reps, [&] { ext = steg::extract(emb.stego, xopts); });
+
+    std::vector<uchar> bytes;
+    row.encodeMs = bestOf(1, [&] { steg::encodeImage(emb.stego, ".png", bytes); });
+    row.ok = ext.status == steg::Status::Ok && ext.message == message;
+    return row;
+}
+
+void printRow(const Row& row, bool json) {
+    double mbytes = static_cast<double>(row.width) * row.height * 3 / 1e6;
+    double pixels = static_cast<double>(row.width) * row.height;
+    auto mbps = [&](double ms) { return ms > 0 ? mbytes / (ms / 1e3) : 0.0; };
+    auto nspp = [&](double ms) { return pixels > 0 ? ms * 1e6 / pixels : 0.0; };
+    uint64_t rss = steg::peakRssBytes();
+    if (json) {
+        JsonObject line;
+        line.add("cover", row.cover).add("method", row.method).add("bits", row.bits).add("matrix", row.matrix)
+            .add("width", row.width).add("height", row.height)
+            .add("message_bytes", row.messageBytes).add("bits_per_change", row.bitsPerChange)
+            .add("decode_ms", row.decodeMs).add("embed_ms", row.embedMs)
+            .add("extract_ms", row.extractMs).add("encode_ms", row.encodeMs)
+            .add("embed_mb_s", mbps(row.embedMs)).add("extract_mb_s", mbps(row.extractMs))
+            .add("embed_ns_px", nspp(row.embedMs)).add("extract_ns_px", nspp(row.extractMs))
+            .add("peak_rss_bytes", rss).add("ok", row.ok);
+        std::printf("%s\n", line.str().c_str());
+    } else {
+        std::printf("%s,%s,%d,%d,%d,%d,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f,%.3f,%llu,%d\n",
+                    row.cover.c_str(), row.method.c_str(), row.bits, row.matrix, row.width, row.height,
+                    static_cast<unsigned long long>(row.messageBytes), row.bitsPerChange,
+                    row.decodeMs, row.embedMs, row.extractMs, row.encodeMs,
+                    mbps(row.embedMs), mbps(row.extractMs), nspp(row.embedMs), nspp(row.extractMs),
+                    static_cast<unsigned long long>(rss), row.ok ? 1 : 0);
+    }
+    std::fflush(stdout);
+}
+
+struct Codec {
+    const char* name;
+    const char* ext;
+    steg::EncodeOptions opts;
+};
+
+steg::EncodeOptions pngOptions(int level, steg::PngStrategy strategy = steg::PngStrategy::Default) {
+    steg::EncodeOptions opts;
+    opts.pngCompression = level;
+    opts.pngStrategy = strategy;
+    return opts;
+}
+
+steg::EncodeOptions tiffOptions(bool compressed) {
+    steg::EncodeOptions opts;
+    opts.tiffCompression = compressed;
+    return opts;
+}
+
+// Embeds text and random payloads with and without packing: packed size, time and samples changed
+void benchCompression(const Cover& cover, int reps, bool json) {
+    const Method methods[] = {Method::LSB, Method::HS, Method::QIM, Method::PM1};
+    const char* kinds[] = {"json", "log", "random"};
+    for (Method method : methods) {
+        steg::EmbedOptions eopts;
+        eopts.method = method;
+        steg::CapacityResult cap = steg::capacity(cover.image, eopts);
+        if (cap.status != steg::Status::Ok)
+            continue;
+        for (const char* kind : kinds) {
+            size_t size = static_cast<size_t>(cap.maxBytes);
+            const std::string message = kind[0] == 'r' ? randomMessage(size) : textMessage(size, kind[0] == 'j');
+            for (steg::Codec codec : {steg::Codec::None, steg::Codec::LZ4}) {
+                eopts.codec = codec;
+                steg::EmbedResult emb;
+                double embedMs = bestOf(reps, [&] { emb = steg::embed(cover.image, message, eopts); });
+                uint64_t packed = 0, changed = 0;
+                double extractMs = 0;
+                bool ok = false;
+                if (emb.status == steg::Status::Ok) {
+                    packed = codec == steg::Codec::None ? message.size() : std::min(message.size(), steg::packPayload(message, codec).size());
+                    changed = static_cast<uint64_t>(cv::countNonZero((emb.stego != cover.image).reshape(1, 0)));
+                    steg::ExtractOptions xopts;
+                    xopts.method = method;
+                    steg::ExtractResult ext;
+                    extractMs = bestOf(reps, [&] { ext = steg::extract(emb.stego, xopts); });
+                    ok = ext.status == steg::Status::Ok && ext.message == message;
+                }
+                if (json) {
+                    JsonObject line;
+                    line.add("cover", cover.name).add("method", steg::methodName(method)).add("payload", kind)
+                        .add("codec", steg::codecName(codec)).add("message_bytes", static_cast<uint64_t>(message.size()))
+                        .add("packed_bytes", packed).add("embed_ms", embedMs).add("extract_ms", extractMs)
+                        .add("changed_samples", changed).add("ok", ok);
+                    std::printf("%s\n", line.str().c_str());
+                } else {
+                    std::printf("%s,%s,%s,%s,%llu,%llu,%.3f,%.3f,%llu,%d\n", cover.name.c_str(), steg::methodName(method), kind,
+                                steg::codecName(codec), static_cast<unsigned long long>(message.size()),
+                                static_cast<unsigned long long>(packed), embedMs, extractMs,
+                                static_cast<unsigned long long>(changed), ok ? 1 : 0);
+                }
+                std::fflush(stdout);
+            }
+        }
+    }
+}
+
+// Encodes and decodes the cover with every lossless output setting: time, size and exactness
+void benchCodecs(const Cover& cover, int reps, bool json) {
+    const Codec codecs[] = {
+        {"png", ".png", steg::EncodeOptions()},
+        {"png-0", ".png", pngOptions(0)},
+        {"png-1", ".png", pngOptions(1)},
+        {"png-6", ".png", pngOptions(6)},
+        {"png-9", ".png", pngOptions(9)},
+        {"png-1-rle", ".png", pngOptions(1, steg::PngStrategy::Rle)},
+        {"png-1-huffman", ".png", pngOptions(1, steg::PngStrategy::HuffmanOnly)},
+        {"bmp", ".bmp", steg::EncodeOptions()},
+        {"ppm", ".ppm", steg::EncodeOptions()},
+        {"pam", ".pam", steg::EncodeOptions()},
+        {"tiff", ".tiff", tiffOptions(true)},
+        {"tiff-raw", ".tiff", tiffOptions(false)},
+    };
+    double mbytes = static_cast<double>(cover.image.total()) * 3 / 1e6;
+    auto mbps = [&](double ms) { return ms > 0 ? mbytes / (ms / 1e3) : 0.0; };
+    for (const Codec& codec : codecs) {
+        std::vector<uchar> bytes;
+        steg::Status status = steg::Status::Ok;
+        double encodeMs = bestOf(reps, [&] { status = steg::encodeImage(cover.image, codec.ext, bytes, codec.opts); });
+        cv::Mat decoded;
+        double decodeMs = 0;
+        if (status == steg::Status::Ok)
+            decodeMs = bestOf(reps, [&] { status = steg::decodeImage(bytes, decoded); });
+        bool exact = status == steg::Status::Ok && steg::changedPixels(cover.image, decoded) == 0;
+        double bpp = cover.image.total() ? static_cast<double>(bytes.size()) / cover.image.total() : 0.0;
+        if (json) {
+            JsonObject line;
+            line.add("cover", cover.name).add("format", codec.name)
+                .add("width", cover.image.cols).add("height", cover.image.rows)
+                .add("bytes", static_cast<uint64_t>(bytes.size())).add("bytes_per_pixel", bpp)
+                .add("encode_ms", encodeMs).add("decode_ms", decodeMs)
+                .add("encode_mb_s", mbps(encodeMs)).add("decode_mb_s", mbps(decodeMs))
+                .add("status", steg::statusName(status)).add("exact", exact);
+            std::printf("%s\n", line.str().c_str());
+        } else {
+            std::printf("%s,%s,%d,%d,%llu,%.3f,%.3f,%.3f,%.2f,%.2f,%s,%d\n",
+                        cover.name.c_str(), codec.name, cover.image.cols, cover.image.rows,
+                        static_cast<unsigned long long>(bytes.size()), bpp, encodeMs, decodeMs,
+                        mbps(encodeMs), mbps(decodeMs), steg::statusName(status), exact ? 1 : 0);
+        }
+        std::fflush(stdout);
+    }
+}
+
+bool loadCover(const std::string& path, Cover& cover) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<uchar> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto t0 = Clock::now();
+    if (steg::decodeImage(bytes, cover.image) != steg::Status::Ok)
+        return false;
+    cover.decodeMs = elapsedMs(t0);
+    cover.name = path;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<double> sizes = {1, 4, 16, 100};
+    std::vector<int> bitCounts = {1};
+    std::vector<int> matrixSizes;
+    std::vector<std::string> files;
+    int reps = 3;
+    bool json = false;
+    bool cat = true;
+    bool codecs = false;
+    bool compress = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                if (!item.empty())
+                    sizes.push_back(std::atof(item.c_str()));
+        } else if (arg == "--bits" && i + 1 < argc) {
+            bitCounts.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                if (!item.empty())
+                    bitCounts.push_back(std::min(4, std::max(1, std::atoi(item.c_str()))));
+        } else if (arg == "--matrix" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                if (!item.empty())
+                    matrixSizes.push_back(std::min(7, std::max(2, std::atoi(item.c_str()))));
+        } else if (arg == "--reps" && i + 1 < argc) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg == "--no-cat") {
+            cat = false;
+        } else if (arg == "--codecs") {
+            codecs = true;
+        } else if (arg == "--compress") {
+            compress = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::fprintf(stderr, "Usage: stega_bench [--sizes 1,4,16,100] [--reps N] [--bits 1,2,3,4] [--matrix 2,3,4] [--json] [--no-cat] [--codecs] [--compress] [image ...]\n");
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (cat)
+        files.insert(files.begin(), "../cat.png");
+
+    if (!json && codecs)
+        std::printf("cover,format,width,height,bytes,bytes_per_pixel,encode_ms,decode_ms,encode_mb_s,decode_mb_s,status,exact\n");
+    else if (!json && compress)
+        std::printf("cover,method,payload,codec,message_bytes,packed_bytes,embed_ms,extract_ms,changed_samples,ok\n");
+    else if (!json)
+        std::printf("cover,method,bits,matrix,width,height,message_bytes,bits_per_change,decode_ms,embed_ms,extract_ms,encode_ms,"
+                    "embed_mb_s,extract_mb_s,embed_ns_px,extract_ns_px,peak_rss_bytes,ok\n");
+
+    const Method methods[] = {Method::LSB, Method::HS, Method::QIM, Method::PM1};
+    auto run = [&](const Cover& cover) {
+        if (codecs) {
+            benchCodecs(cover, reps, json);
+            return;
+        }
+        if (compress) {
+            benchCompression(cover, reps, json);
+            return;
+        }
+        for (Method method : methods) {
+            for (int bits : bitCounts)
+                if (bits == 1 || method == Method::LSB || method == Method::PM1)
+                    printRow(benchMethod(cover, method, bits, 0, reps), json);
+            if (method == Method::LSB || method == Method::PM1)
+                for (int k : matrixSizes)
+                    printRow(benchMethod(cover, method, 1, k, reps), json);
+        }
+    };
+
+    for (double mp : sizes) {
+        cv::Size size = sizeForMegapixels(mp);
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%gmp", mp);
+        // One cover at a time keeps the peak RSS of a row attributable to its size
+        run({std::string("noise") + suffix, noiseCover(size)});
+        run({std::string("flat") + suffix, flatCover(size)});
+        run({std::string("gradient") + suffix, gradientCover(size)});
+    }
+    for (const std::string& path : files) {
+        Cover cover;
+        if (!loadCover(path, cover)) {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), steg::statusMessage(steg::Status::ImageLoadError));
+            continue;
+        }
+        run(cover);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include "daemon.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \file
+ * \brief Load generator for the project_steg request server
+ *
+ * Usage: stega_load --socket PATH --image FILE [--command embed|extract|capacity] [--method M]
+ *                   [--message TEXT | --payload-bytes N] [--clients C] [--requests N] [--warmup N]
+ *                   [--ext .png] [--png-level L] [--json]
+ *
+ * Each of C clients opens its own connection and sends N requests one after another, after
+ * --warmup unmeasured ones. extract first embeds the message once and then extracts it from
+ * the returned image. Prints the request count, failures, throughput and the p50/p90/p99/max
+ * client-side latency in milliseconds as one CSV row (or JSON line).
+ */
+
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    std::string socketPath, imagePath, command = "embed", method = "lsb", message = "load test message";
+    std::string ext = ".png";
+    int pngLevel = -1;
+    int clients = 4, requests = 200, warmup = 5;
+    bool json = false;
+};
+
+bool parseArgs(int argc, char** argv, Settings& s) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            s.json = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        std::string v = argv[++i];
+        if (arg == "--socket") s.socketPath = v;
+        else if (arg == "--image") s.imagePath = v;
+        else if (arg == "--command") s.command = v;
+        else if (arg == "--method") s.method = v;
+        else if (arg == "--message") s.message = v;
+        else if (arg == "--payload-bytes") s.message.assign(std::strtoull(v.c_str(), nullptr, 10), 'x');
+        else if (arg == "--clients") s.clients = std::max(1, std::atoi(v.c_str()));
+        else if (arg == "--requests") s.requests = std::max(1, std::atoi(v.c_str()));
+        else if (arg == "--warmup") s.warmup = std::max(0, std::atoi(v.c_str()));
+        else if (arg == "--ext") s.ext = v;
+        else if (arg == "--png-level") s.pngLevel = std::atoi(v.c_str());
+        else return false;
+    }
+    return !s.socketPath.empty() && !s.imagePath.empty() &&
+           (s.command == "embed" || s.command == "extract" || s.command == "capacity");
+}
+
+// Sends one request and waits for the answer; false if the connection failed or the status is not ok
+bool roundTrip(DaemonStream& stream, const std::string& line, const std::string& payload,
+               const std::vector<uint8_t>& image, DaemonFrame& response) {
+    if (!stream.write(line, reinterpret_cast<const uint8_t*>(payload.data()), payload.size(), image.data(), image.size()))
+        return false;
+    if (!stream.readResponse(response))
+        return false;
+    return response.line.find("\"status\":\"ok\"") != std::string::npos;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Settings s;
+    if (!parseArgs(argc, argv, s)) {
+        std::cerr << "Usage: stega_load --socket PATH --image FILE [--command embed|extract|capacity] [--method M]\n"
+                     "                  [--message TEXT | --payload-bytes N] [--clients C] [--requests N]\n"
+                     "                  [--warmup N] [--ext .png] [--png-level L] [--json]\n";
+        return 2;
+    }
+    std::ifstream in(s.imagePath, std::ios::binary);
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (image.empty()) {
+        std::cerr << "cannot read " << s.imagePath << "\n";
+        return 2;
+    }
+
+    std::string options = " method=" + s.method + " ext=" + s.ext;
+    if (s.pngLevel >= 0)
+        options += " png-level=" + std::to_string(s.pngLevel);
+    std::string payload = s.command == "embed" ? s.message : std::string();
+    if (s.command == "extract") {
+        // The clients extract from a stego image made by the server itself
+        int fd = connectDaemon(s.socketPath);
+        DaemonStream stream(fd, fd);
+        DaemonFrame response;
+        std::string line = "embed" + options + " payload=" + std::to_string(s.message.size()) +
+                           " image=" + std::to_string(image.size());
+        bool ok = fd >= 0 && roundTrip(stream, line, s.message, image, response);
+        closeDaemon(fd);
+        if (!ok) {
+            std::cerr << "cannot prepare the stego image: " << response.line << "\n";
+            return 1;
+        }
+        image = response.data;
+    }
+    std::string line = s.command + options + " payload=" + std::to_string(payload.size()) +
+                       " image=" + std::to_string(image.size());
+
+    std::vector<double> latencies;
+    std::mutex mutex;
+    uint64_t failures = 0;
+    auto t0 = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < s.clients; ++c) {
+        clients.emplace_back([&] {
+            std::vector<double> mine;
+            uint64_t failed = 0;
+            int fd = connectDaemon(s.socketPath);
+            if (fd < 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failures += s.requests;
+                return;
+            }
+            DaemonStream stream(fd, fd);
+            DaemonFrame response;
+            for (int r = 0; r < s.warmup + s.requests; ++r) {
+                auto start = Clock::now();
+                bool ok = roundTrip(stream, line, payload, image, response);
+                if (r < s.warmup)
+                    continue;
+                if (ok)
+                    mine.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                else
+                    ++failed;
+            }
+            closeDaemon(fd);
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+            failures += failed;
+        });
+    }
+    for (std::thread& t : clients)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    std::sort(latencies.begin(), latencies.end());
+    // Warm-up requests run inside the timed window too, so they count towards throughput
+    double rps = (latencies.size() + failures + static_cast<double>(s.warmup) * s.clients) / std::max(seconds, 1e-9);
+
+    if (s.json) {
+        JsonObject out;
+        out.add("command", s.command).add("method", s.method).add("clients", s.clients)
+           .add("requests", static_cast<uint64_t>(latencies.size())).add("failures", failures)
+           .add("rps", rps).add("p50_ms", percentile(latencies, 0.50)).add("p90_ms", percentile(latencies, 0.90))
+           .add("p99_ms", percentile(latencies, 0.99)).add("max_ms", latencies.empty() ? 0.0 : latencies.back());
+        std::cout << out.str() << "\n";
+    } else {
+        std::printf("command,method,clients,requests,failures,rps,p50_ms,p90_ms,p99_ms,max_ms\n");
+        std::printf("%s,%s,%d,%zu,%llu,%.1f,%.3f,%.3f,%.3f,%.3f\n", s.command.c_str(), s.method.c_str(), s.clients,
+                    latencies.size(), static_cast<unsigned long long>(failures), rps, percentile(latencies, 0.50),
+                    percentile(latencies, 0.90), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,32 +1,20 @@
 #ifndef HS_STEGANOGRAPHY_HPP
 #define HS_STEGANOGRAPHY_HPP
 
+#include "stego_api.hpp"
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include <string>
 #include <vector>
 
 
 /**
  * \file steganography.hpp
- * \brief Header file containing declarations for steganography functions
+ * \brief Header file containing declarations for file-based and interactive steganography functions
  */
 
 
 
-/**
- * \brief Converts a string message into a vector of bits
- * \param message The input string message to convert
- * \return Vector of boolean values representing the message in binary form
- */
-std::vector<bool> messageToBits(const std::string& message);
-
-/**
- * \brief Converts a vector of bits back into a string message
- * \param bits Vector of boolean values representing the message in binary form
- * \return The reconstructed string message
- */
-std::string bitsToMessage(const std::vector<bool>& bits);
-
 /**
  * \brief Embeds a message into an image using LSB (Least Significant Bit) method
  * \param imagePath Path to the input image
@@ -43,10 +31,11 @@ void embedLSB(const std::string& imagePath, const std::string& message, const st
 void extractLSB(const std::string& imagePath, size_t msgLen);
 
 /**
- * \addindex Calculates and displays the maximum message capacity for LSB method
+ * \brief Calculates the maximum message capacity for LSB method from the image header alone
  * \param imagePath Path to the input image
+ * \return Capacity in bytes and status
  */
-void maxCapacityLSB(const std::string& imagePath);
+steg::CapacityResult maxCapacityLSB(const std::string& imagePath);
 
 /**
  * \brief Embeds a message into an image using QIM (Quantization Index Modulation) method
@@ -65,35 +54,12 @@ void embedQIM(const std::string& imagePath, const std::string& message, int q, c
 void extractQIM(const std::string& imagePath, int q);
 
 /**
- * \brief Calculates and displays the maximum message capacity for QIM method
+ * \brief Calculates the maximum message capacity for QIM method from the image header alone
  * \param imagePath Path to the input image
  * \param q Quantization step size
+ * \return Capacity in bytes and status
  */
-void maxCapacityQIM(const std::string& imagePath, int q);
-
-/**
- * \brief Finds P (peak) and Z (zero) points in a channel's histogram
- * \param channel Input image channel
- * \param P Reference to store the peak point
- * \param Z Reference to store the zero point
- */
-void findPZ(const cv::Mat& channel, int& P, int& Z);
-
-/**
- * \brief Shifts the histogram of a channel for embedding
- * \param channel Image channel to modify
- * \param P Peak point
- * \param Z Zero point
- */
-void shiftHistogram(cv::Mat& channel, int P, int Z);
-
-/**
- * \brief Reverses the histogram shift for extraction
- * \param channel Image channel to modify
- * \param P Peak point
- * \param Z Zero point
- */
-void unshiftHistogram(cv::Mat& channel, int P, int Z);
+steg::CapacityResult maxCapacityQIM(const std::string& imagePath, int q);
 
 /**
  * \brief Embeds a message into an image using Histogram Shifting method
@@ -116,10 +82,12 @@ void embedHS(const std::string& imagePath, const std::string& message, const std
 void extractHS(const std::string& imagePath, int P_r, int Z_r, int P_g, int Z_g, int P_b, int Z_b);
 
 /**
- * \brief Calculates and displays the maximum message capacity for Histogram Shifting method
- * \param imagePath Path to the input image
+ * \brief Calculates the maximum message capacity for Histogram Shifting method
+ * \param imagePath Path to the input image; its histograms are collected band by band
+ * \param cacheDir Cover statistics cache to reuse and fill ("" for a sidecar file), none by default
+ * \return Capacity in bytes and status
  */
-void maxCapacityHS(const std::string& imagePath);
+steg::CapacityResult maxCapacityHS(const std::string& imagePath, const std::optional<std::string>& cacheDir = std::nullopt);
 
 /**
  * \brief Embeds a message into an image using PM1 (Plus-Minus One) method
@@ -137,10 +105,29 @@ void embedPM1(const std::string& imagePath, const std::string& message, const st
 void extractPM1(const std::string& imagePath, size_t msgLen);
 
 /**
- * \brief Calculates and displays the maximum message capacity for PM1 method
+ * \brief Calculates the maximum message capacity for PM1 method from the image header alone
  * \param imagePath Path to the input image
+ * \return Capacity in bytes and status
+ */
+steg::CapacityResult maxCapacityPM1(const std::string& imagePath);
+
+/**
+ * \brief Calculates the maximum message capacity of many images at once
+ * \param imagePaths Paths to the input images
+ * \param method Steganography method
+ * \param q Quantization step size (QIM only)
+ * \return One result per path, in the same order
  */
-void maxCapacityPM1(const std::string& imagePath);
+std::vector<steg::CapacityResult> maxCapacities(const std::vector<std::string>& imagePaths, Method method, int q = 4);
+
+/**
+ * \brief Extracts and displays a message that carries the self-describing header
+ * \param imagePath Path to the stego image as passed to cv::imread
+ * \param method Steganography method used for embedding
+ * \param q Quantization step size (QIM only)
+ * \return false if the image has no header (the message uses the old format), true otherwise
+ */
+bool extractWithHeader(const std::string& imagePath, Method method, int q = 4);
 
 /**
  * \brief Prompts user to input an image path
@@ -171,11 +158,6 @@ void inputOutputFileName(std::string& fileName);
  */
 void inputHSParams(int& P_r, int& Z_r, int& P_g, int& Z_g, int& P_b, int& Z_b);
 
-/**
- * \brief Enumeration of available steganography methods
- */
-enum class Method { LSB = 1, HS = 2, QIM = 3, PM1 = 4 };
-
 /**
  * \brief Runs the LSB steganography workflow
  */
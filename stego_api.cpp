@@ -0,0 +1,2045 @@
+#include "stego_api.hpp"
+#include "bitstream.hpp"
+#include "histogram.hpp"
+#include "hs_engine.hpp"
+#include "instrument.hpp"
+#include "lsb_kernels.hpp"
+#include "matrix_kernels.hpp"
+#include "parallel.hpp"
+#include "pm1_kernels.hpp"
+#include "qim_kernels.hpp"
+#include "scatter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+
+/**
+ * \file
+ * \brief File, where the in-memory steganography library is realised
+ */
+
+
+
+std::vector<bool> messageToBits(const std::string& message) {
+    std::vector<bool> bits(message.size() * 8);
+    BitReader reader(message);
+    for (size_t i = 0; i < bits.size(); ++i)
+        bits[i] = reader.readBit();
+    return bits;
+}
+
+std::string bitsToMessage(const std::vector<bool>& bits) {
+    std::string message;
+    message.reserve(bits.size() / 8);
+    BitWriter writer(message);
+    size_t whole = bits.size() / 8 * 8;
+    for (size_t i = 0; i < whole; ++i)
+        writer.writeBit(bits[i]);
+    writer.flush();
+    return message;
+}
+
+
+// ==== Histogram Shifting helpers ====
+bool findPZ(const cv::Mat& channel, int& P, int& Z) {
+    CV_Assert(channel.type() == CV_8UC1);
+    if (channel.empty()) {
+        P = 0; Z = 0;
+        return false;
+    }
+    uint64_t hist[1][256];
+    buildHistograms(channel, hist);
+    findPZFromHistogram(hist[0], P, Z);
+    return true;
+}
+
+void shiftHistogram(cv::Mat& channel, int P, int Z) {
+    CV_Assert(channel.type() == CV_8UC1);
+    if (P == Z) return;
+    if (P < Z) {
+        for (int y = 0; y < channel.rows; ++y)
+            for (int x = 0; x < channel.cols; ++x) {
+                uchar& pix = channel.at<uchar>(y, x);
+                if (pix > P && pix < Z && pix < 255)
+                    ++pix;
+            }
+    } else {
+        for (int y = 0; y < channel.rows; ++y)
+            for (int x = 0; x < channel.cols; ++x) {
+                uchar& pix = channel.at<uchar>(y, x);
+                if (pix > Z && pix < P && pix > 0)
+                    --pix;
+            }
+    }
+}
+
+void unshiftHistogram(cv::Mat& channel, int P, int Z) {
+    CV_Assert(channel.type() == CV_8UC1);
+    if (P == Z) return;
+    if (P < Z) {
+        for (int y = 0; y < channel.rows; ++y)
+            for (int x = 0; x < channel.cols; ++x) {
+                uchar& pix = channel.at<uchar>(y, x);
+                if (pix > P && pix <= Z && pix > 0)
+                    --pix;
+            }
+    } else {
+        for (int y = 0; y < channel.rows; ++y)
+            for (int x = 0; x < channel.cols; ++x) {
+                uchar& pix = channel.at<uchar>(y, x);
+                if (pix >= Z && pix < P && pix < 255)
+                    ++pix;
+            }
+    }
+}
+
+
+namespace steg {
+
+namespace {
+
+Status checkImage(const cv::Mat& image) {
+    if (image.empty())
+        return Status::ImageLoadError;
+    if (image.type() != CV_8UC3)
+        return Status::InvalidImage;
+    return Status::Ok;
+}
+
+bool validQ(int q) {
+    return q % 2 == 0 && q >= 2;
+}
+
+// More than one bit per sample is only defined for the methods that replace low bits
+bool validBits(Method method, int bits) {
+    return bits == 1 || (bits >= 2 && bits <= 4 && (method == Method::LSB || method == Method::PM1));
+}
+
+// Other methods ignore the Histogram Shifting pair count
+bool validPairs(Method method, int pairs) {
+    return method != Method::HS || (pairs >= 1 && pairs <= kMaxHSPairs);
+}
+
+// Matrix embedding codes one-bit LSB and PM1 steps; 0 turns it off
+bool validMatrix(Method method, int bits, int matrixBits) {
+    return matrixBits == 0 || (matrixBits >= 2 && matrixBits <= kMaxMatrixBits && bits == 1 &&
+                               (method == Method::LSB || method == Method::PM1));
+}
+
+// A packed message is named by the header, so it needs the framed layout
+bool validCodec(Codec codec, bool framed) {
+    return codec == Codec::None || (codec == Codec::LZ4 && framed);
+}
+
+}  // namespace
+
+bool validEmbedOptions(const EmbedOptions& opts) {
+    return (opts.method != Method::QIM || validQ(opts.q)) && validBits(opts.method, opts.bitsPerChannel) &&
+           validPairs(opts.method, opts.hsPairs) && validMatrix(opts.method, opts.bitsPerChannel, opts.matrixBits) &&
+           validCodec(opts.codec, opts.framed);
+}
+
+namespace {
+
+uint64_t sampleCount(const cv::Mat& image) {
+    return static_cast<uint64_t>(image.rows) * image.cols * image.channels();
+}
+
+// Matrix embedding layout: groups of n samples from image sample `start` on, as many as fit
+// in each row without crossing its end (see PayloadHeader)
+struct MatrixRows {
+    uint64_t start = 0;
+    uint64_t rowSamples = 1;
+    uint64_t n = 1;
+
+    // Groups in the rows before row y
+    uint64_t groupsBefore(uint64_t y) const {
+        uint64_t first = start / rowSamples;
+        if (y <= first)
+            return 0;
+        return (rowSamples - start % rowSamples) / n + (y - first - 1) * (rowSamples / n);
+    }
+
+    // Image sample of the first sample of group g, which must exist
+    uint64_t groupSample(uint64_t g) const {
+        uint64_t first = start / rowSamples;
+        uint64_t head = (rowSamples - start % rowSamples) / n;
+        if (g < head)
+            return start + g * n;
+        uint64_t perRow = rowSamples / n;
+        g -= head;
+        return (first + 1 + g / perRow) * rowSamples + (g % perRow) * n;
+    }
+
+    // Image sample just past the first `groups` groups
+    uint64_t samplesFor(uint64_t groups) const {
+        return groups == 0 ? start : groupSample(groups - 1) + n;
+    }
+};
+
+MatrixRows matrixRows(uint64_t start, uint64_t rowSamples, int matrixBits) {
+    MatrixRows rows;
+    rows.start = start;
+    rows.rowSamples = std::max<uint64_t>(rowSamples, 1);
+    rows.n = (uint64_t(1) << matrixBits) - 1;
+    return rows;
+}
+
+// Visits the channel samples in raster order as few contiguous spans as possible;
+// fn(samples, count) returns false to stop early
+template <typename T, typename Fn>
+void forEachSpan(T& image, Fn&& fn) {
+    size_t rowSamples = static_cast<size_t>(image.cols) * image.channels();
+    if (image.isContinuous()) {
+        fn(image.data, rowSamples * image.rows);
+        return;
+    }
+    for (int y = 0; y < image.rows; ++y)
+        if (!fn(image.data + y * image.step, rowSamples))
+            return;
+}
+
+// Message bytes an extractor with a sink collects before it writes them out
+const size_t kSinkChunk = size_t(1) << 16;
+
+// QIM: collects the length header (16-bit raw, or the framed header) and the message that follows it, span by span.
+// With a sink, the message is kept one chunk at a time and written out as each chunk fills.
+class QIMDecoder {
+public:
+    QIMDecoder(int q, bool framed, uint64_t maxBits, PayloadSink* sink = nullptr)
+        : framed_(framed), maxBits_(maxBits), total_bits_(framed ? headerSize(Method::QIM) * 8 : 16), sink_(sink) {
+        if (validQ(q))
+            buildQimTable(q, table_);
+        payload_.assign(total_bits_ / 8, '\0');
+    }
+
+    // Returns true once the whole message has been read or the header turned out to be invalid
+    bool pushRow(const uchar* row, size_t n) {
+        while (n > 0 && !done_) {
+            uint64_t end = streaming() ? std::min(total_bits_, (base_ + payload_.size()) * 8) : total_bits_;
+            size_t k = static_cast<size_t>(std::min<uint64_t>(n, end - pos_));
+            qimExtractSpan(row, k, table_, reinterpret_cast<uint8_t*>(&payload_[0]), pos_ - base_ * 8);
+            pos_ += k;
+            row += k;
+            n -= k;
+            if (pos_ < end)
+                break;
+            if (pos_ < total_bits_) {
+                if (!writeChunk(payload_.size()))
+                    return done_ = true;
+                payload_.assign(static_cast<size_t>(std::min<uint64_t>(kSinkChunk, total_bits_ / 8 - base_)), '\0');
+                continue;
+            }
+            if (!haveHeader_) {
+                haveHeader_ = true;
+                if (!parseHeader())
+                    return done_ = true;
+                if (pos_ < total_bits_)
+                    continue;
+            }
+            done_ = found_ = true;
+        }
+        return done_;
+    }
+
+    bool done() const { return done_; }
+    bool found() const { return found_; }
+    bool sinkFailed() const { return sinkFailed_; }
+    bool corrupt() const { return unpack_ && unpack_->corrupt(); }
+    Codec codec() const { return codec_; }
+    uint64_t bitsRead() const { return pos_; }
+    std::string message() const { return payload_.substr(headerBytes_); }
+
+    // With a sink: writes the rest of a complete message
+    bool finishSink() {
+        return writeChunk(static_cast<size_t>(total_bits_ / 8 - base_)) && (!unpack_ || unpack_->finish());
+    }
+
+private:
+    bool streaming() const { return sink_ && haveHeader_; }
+
+    bool writeChunk(size_t n) {
+        if (n > 0 && !sink_->write(reinterpret_cast<const uint8_t*>(payload_.data()), n))
+            sinkFailed_ = true;
+        base_ += n;
+        return !sinkFailed_;
+    }
+
+    bool parseHeader() {
+        uint64_t msg_len;
+        if (framed_) {
+            PayloadHeader header;
+            if (decodeHeader(reinterpret_cast<const uint8_t*>(payload_.data()), payload_.size(), header) != Status::Ok ||
+                header.method != Method::QIM)
+                return false;
+            msg_len = header.length;
+            codec_ = header.codec;
+            if (sink_ && codec_ != Codec::None) {
+                unpack_ = std::make_unique<UnpackSink>(*sink_, codec_);
+                sink_ = unpack_.get();
+            }
+        } else {
+            msg_len = (static_cast<uchar>(payload_[0]) << 8) | static_cast<uchar>(payload_[1]);
+        }
+        headerBytes_ = payload_.size();
+        if (msg_len > (maxBits_ - total_bits_) / 8)
+            return false;
+        total_bits_ += msg_len * 8;
+        if (sink_) {
+            base_ = headerBytes_;
+            payload_.assign(static_cast<size_t>(std::min<uint64_t>(kSinkChunk, msg_len)), '\0');
+        } else {
+            payload_.resize(total_bits_ / 8);
+        }
+        return true;
+    }
+
+    QimTable table_;
+    bool framed_;
+    uint64_t maxBits_;
+    std::string payload_;
+    uint64_t pos_ = 0;
+    uint64_t total_bits_;
+    size_t headerBytes_ = 0;
+    bool haveHeader_ = false;
+    bool done_ = false;
+    bool found_ = false;
+    PayloadSink* sink_;
+    uint64_t base_ = 0;          // stream byte index of payload_[0]
+    bool sinkFailed_ = false;
+    Codec codec_ = Codec::None;
+    std::unique_ptr<UnpackSink> unpack_;   // with a sink and a packed message: unpacks it into the caller's sink
+};
+
+// Seed of the PM1 random stream: the caller's, or a fresh one from the OS when unset
+uint64_t resolveSeed(const std::optional<uint64_t>& seed) {
+    if (seed)
+        return *seed;
+    std::random_device rd;
+    return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+}
+
+// PM1 over the rows of an image (or band) whose first sample carries payload bit firstBit.
+// The random stream is indexed by payload bit, so splitting rows across threads cannot change the result.
+void pm1EmbedRows(cv::Mat& image, const uint8_t* payload, uint64_t firstBit, uint64_t total_bits, uint64_t seed) {
+    if (firstBit >= total_bits || image.empty())
+        return;
+    uint64_t rowSamples = static_cast<uint64_t>(image.cols) * image.channels();
+    int rows = static_cast<int>(std::min<uint64_t>(image.rows, (total_bits - firstBit + rowSamples - 1) / rowSamples));
+    parallelForBands(rows, bandCount(rows, rowSamples), [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            uint64_t bit = firstBit + y * rowSamples;
+            size_t n = static_cast<size_t>(std::min<uint64_t>(rowSamples, total_bits - bit));
+            pm1EmbedSpan(image.ptr<uchar>(y), n, payload, bit, seed);
+        }
+    });
+}
+
+using LsbBitsEmbed = void (*)(uint8_t*, size_t, const uint8_t*, uint64_t);
+using LsbBitsExtract = void (*)(const uint8_t*, size_t, uint8_t*, uint64_t);
+using Pm1BitsEmbed = void (*)(uint8_t*, size_t, const uint8_t*, uint64_t, uint64_t, uint64_t);
+
+// The K-bit kernels are compiled per K; these pick the instance for a bit count checked by validBits
+LsbBitsEmbed lsbEmbedKernel(int bits) {
+    switch (bits) {
+        case 2:  return lsbEmbedSpanBits<2>;
+        case 3:  return lsbEmbedSpanBits<3>;
+        case 4:  return lsbEmbedSpanBits<4>;
+        default: return lsbEmbedSpanBits<1>;
+    }
+}
+
+LsbBitsExtract lsbExtractKernel(int bits) {
+    switch (bits) {
+        case 2:  return lsbExtractSpanBits<2>;
+        case 3:  return lsbExtractSpanBits<3>;
+        case 4:  return lsbExtractSpanBits<4>;
+        default: return lsbExtractSpanBits<1>;
+    }
+}
+
+Pm1BitsEmbed pm1EmbedKernel(int bits) {
+    switch (bits) {
+        case 2:  return pm1EmbedSpanBits<2>;
+        case 3:  return pm1EmbedSpanBits<3>;
+        case 4:  return pm1EmbedSpanBits<4>;
+        default: return pm1EmbedSpanBits<1>;
+    }
+}
+
+// Longest message the 16-bit length of the raw QIM layout can describe
+const size_t kQimRawMaxLength = 0xFFFF;
+
+// QIM payload: 16-bit big-endian length header followed by the message bytes
+std::string qimLengthPrefix(uint64_t length) {
+    std::string prefix;
+    prefix += static_cast<char>((length >> 8) & 0xFF);
+    prefix += static_cast<char>(length & 0xFF);
+    return prefix;
+}
+
+std::string qimPayload(const std::string& message) {
+    return qimLengthPrefix(message.size()) + message;
+}
+
+// Sequential view of a prefix followed by the bytes of a source. It holds only the bytes from
+// the first one still needed to the last one requested, so a band costs memory for its own
+// payload bits whatever the message size. Bytes past the end read as zero.
+class PayloadWindow {
+public:
+    void reset(std::string prefix, PayloadSource* source, uint64_t sourceBytes) {
+        prefix_ = std::move(prefix);
+        source_ = source;
+        sourceBytes_ = source ? sourceBytes : 0;
+    }
+
+    uint64_t size() const {
+        return prefix_.size() + sourceBytes_;
+    }
+
+    // Bytes [first, end) of the stream; first must not decrease from one call to the next
+    const uint8_t* bytes(uint64_t first, uint64_t end) {
+        uint64_t realEnd = std::min(end, size());
+        if (realEnd > filled_) {
+            buf_.resize(std::max<size_t>(buf_.size(), static_cast<size_t>(realEnd - base_)));
+            uint8_t* dst = buf_.data() + (filled_ - base_);
+            if (filled_ < prefix_.size()) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(realEnd, prefix_.size()) - filled_);
+                std::memcpy(dst, prefix_.data() + filled_, n);
+                filled_ += n;
+                dst += n;
+            }
+            if (filled_ < realEnd) {
+                size_t n = static_cast<size_t>(realEnd - filled_);
+                if (source_->read(dst, n) != n)
+                    failed_ = true;
+                filled_ = realEnd;
+            }
+        }
+        if (end - base_ > buf_.size())
+            buf_.resize(static_cast<size_t>(end - base_), 0);   // past the end of the stream
+        if (first > base_) {
+            buf_.erase(buf_.begin(), buf_.begin() + static_cast<ptrdiff_t>(std::min<uint64_t>(first - base_, buf_.size())));
+            base_ = first;
+        }
+        return buf_.data();
+    }
+
+    bool failed() const {
+        return failed_;
+    }
+
+private:
+    std::string prefix_;
+    PayloadSource* source_ = nullptr;
+    uint64_t sourceBytes_ = 0;
+    std::vector<uint8_t> buf_;
+    uint64_t base_ = 0;     // stream index of buf_[0]
+    uint64_t filled_ = 0;   // stream bytes read into buf_ so far
+    bool failed_ = false;
+};
+
+}  // namespace
+
+const char* statusMessage(Status status) {
+    switch (status) {
+        case Status::Ok:               return "Успешно";
+        case Status::ImageLoadError:   return "Ошибка загрузки изображения!";
+        case Status::InvalidImage:     return "Ошибка: изображение не содержит 3 цветовых каналов!";
+        case Status::MessageTooLong:   return "Сообщение слишком длинное для этого изображения!";
+        case Status::InvalidParameter: return "Недопустимый параметр: шаг квантования (q) должен быть чётным и >= 2, бит на канал — от 1 до 4 (больше 1 только для lsb и pm1)!";
+        case Status::EncodeError:      return "Ошибка при сохранении изображения!";
+        case Status::MessageNotFound:  return "Сообщение не найдено или изображение повреждено!";
+        case Status::LossyFormat:      return "Формат с потерями (например, JPEG) разрушит сообщение! Используйте PNG, BMP, PPM, PAM или TIFF.";
+        case Status::PayloadError:     return "Ошибка чтения или записи сообщения!";
+    }
+    return "Неизвестная ошибка";
+}
+
+const char* statusName(Status status) {
+    switch (status) {
+        case Status::Ok:               return "ok";
+        case Status::ImageLoadError:   return "image_load_error";
+        case Status::InvalidImage:     return "invalid_image";
+        case Status::MessageTooLong:   return "message_too_long";
+        case Status::InvalidParameter: return "invalid_parameter";
+        case Status::EncodeError:      return "encode_error";
+        case Status::MessageNotFound:  return "message_not_found";
+        case Status::LossyFormat:      return "lossy_format";
+        case Status::PayloadError:     return "payload_error";
+    }
+    return "unknown";
+}
+
+const char* methodName(Method method) {
+    switch (method) {
+        case Method::LSB: return "lsb";
+        case Method::HS:  return "hs";
+        case Method::QIM: return "qim";
+        case Method::PM1: return "pm1";
+    }
+    return "unknown";
+}
+
+bool parseMethod(const std::string& name, Method& method) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (Method m : {Method::LSB, Method::HS, Method::QIM, Method::PM1}) {
+        if (lower == methodName(m)) {
+            method = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseHSKey(const std::string& text, HSKey& key) {
+    std::string s = text;
+    std::replace(s.begin(), s.end(), ',', ' ');
+    std::istringstream iss(s);
+    HSKey parsed;
+    std::string channel;
+    for (int c = 0; c < 3; ++c) {
+        if (!(iss >> channel))
+            return false;
+        std::replace(channel.begin(), channel.end(), '+', ' ');
+        std::replace(channel.begin(), channel.end(), '/', ' ');
+        std::istringstream pairs(channel);
+        int i = 0, P, Z;
+        for (; pairs >> P >> Z; ++i) {
+            if (i >= kMaxHSPairs || P < 0 || P > 255 || Z < 0 || Z > 255)
+                return false;
+            (i == 0 ? parsed.P[2 - c] : parsed.moreP[2 - c][i - 1]) = P;
+            (i == 0 ? parsed.Z[2 - c] : parsed.moreZ[2 - c][i - 1]) = Z;
+        }
+        if (i == 0 || !pairs.eof() || (c > 0 && i != parsed.pairs))
+            return false;
+        parsed.pairs = i;
+    }
+    if (iss >> channel)
+        return false;
+    key = parsed;
+    return true;
+}
+
+std::string formatHSKey(const HSKey& key) {
+    std::ostringstream oss;
+    for (int c = 2; c >= 0; --c) {
+        for (int i = 0; i < key.pairs; ++i) {
+            int P, Z;
+            hsPair(key, c, i, P, Z);
+            oss << (i > 0 ? "+" : "") << P << "/" << Z;
+        }
+        if (c > 0)
+            oss << ",";
+    }
+    return oss.str();
+}
+
+Status decodeImage(const uchar* data, size_t size, cv::Mat& image) {
+    if (data == nullptr || size == 0)
+        return Status::ImageLoadError;
+    PhaseTimer timer(Phase::Decode);
+    countBytesRead(size);
+    cv::Mat buf(1, static_cast<int>(size), CV_8UC1, const_cast<uchar*>(data));
+    image = cv::imdecode(buf, cv::IMREAD_COLOR);
+    return image.empty() ? Status::ImageLoadError : Status::Ok;
+}
+
+Status decodeImage(const std::vector<uchar>& bytes, cv::Mat& image) {
+    return decodeImage(bytes.data(), bytes.size(), image);
+}
+
+Status decodeImageInto(const std::vector<uchar>& bytes, cv::Mat& image) {
+    if (bytes.empty())
+        return Status::ImageLoadError;
+    PhaseTimer timer(Phase::Decode);
+    countBytesRead(bytes.size());
+    cv::Mat buf(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<uchar*>(bytes.data()));
+    cv::imdecode(buf, cv::IMREAD_COLOR, &image);
+    return image.empty() ? Status::ImageLoadError : Status::Ok;
+}
+
+bool isLosslessFormat(const std::string& ext) {
+    static const char* lossless[] = {".png", ".bmp", ".dib", ".ppm", ".pnm", ".pam", ".tif", ".tiff"};
+    std::string e = ext;
+    std::transform(e.begin(), e.end(), e.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return std::find(std::begin(lossless), std::end(lossless), e) != std::end(lossless);
+}
+
+Status encodeImage(const cv::Mat& image, const std::string& ext, std::vector<uchar>& bytes, const EncodeOptions& opts) {
+    if (!isLosslessFormat(ext))
+        return Status::LossyFormat;
+    if (image.empty())
+        return Status::EncodeError;
+    std::vector<int> params;
+    if (opts.pngCompression >= 0)
+        params.insert(params.end(), {cv::IMWRITE_PNG_COMPRESSION, std::min(opts.pngCompression, 9)});
+    // Setting the level resets the strategy, so the strategy goes second
+    if (opts.pngStrategy != PngStrategy::Default)
+        params.insert(params.end(), {cv::IMWRITE_PNG_STRATEGY, static_cast<int>(opts.pngStrategy)});
+    if (!opts.tiffCompression)
+        params.insert(params.end(), {cv::IMWRITE_TIFF_COMPRESSION, 1});   // COMPRESSION_NONE
+    PhaseTimer timer(Phase::Encode);
+    try {
+        if (!cv::imencode(ext, image, bytes, params))
+            return Status::EncodeError;
+    } catch (const cv::Exception&) {
+        return Status::EncodeError;
+    }
+    countBytesWritten(bytes.size());
+    return Status::Ok;
+}
+
+
+// ==== LSB ====
+EmbedResult embedLSB(const cv::Mat& cover, const std::string& message) {
+    EmbedResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    uint64_t total_bits = static_cast<uint64_t>(message.size()) * 8;
+    if (total_bits > sampleCount(cover)) {
+        res.status = Status::MessageTooLong;
+        return res;
+    }
+
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(total_bits);
+    cv::Mat stego = cover.clone();
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(message.data());
+    uint64_t pos = 0;
+    forEachSpan(stego, [&](uchar* samples, size_t count) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(count, total_bits - pos));
+        lsbEmbedSpan(samples, n, payload, pos);
+        pos += n;
+        return pos < total_bits;
+    });
+    res.stego = stego;
+    return res;
+}
+
+ExtractResult extractLSB(const cv::Mat& stego, size_t msgLen) {
+    ExtractResult res;
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+    uint64_t total_bits = std::min<uint64_t>(static_cast<uint64_t>(msgLen) * 8, sampleCount(stego) / 8 * 8);
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(total_bits);
+    res.message.assign(total_bits / 8, '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&res.message[0]);
+    uint64_t pos = 0;
+    forEachSpan(stego, [&](const uchar* samples, size_t count) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(count, total_bits - pos));
+        lsbExtractSpan(samples, n, out, pos);
+        pos += n;
+        return pos < total_bits;
+    });
+    return res;
+}
+
+CapacityResult capacityLSB(const cv::Mat& cover) {
+    CapacityResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    res.maxBytes = sampleCount(cover) / 8;
+    return res;
+}
+
+
+// ==== QIM ====
+EmbedResult embedQIM(const cv::Mat& cover, const std::string& message, int q) {
+    EmbedResult res;
+    if (!validQ(q)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+
+    // The raw layout has only 16 bits for the length; longer messages need the framed header
+    std::string payload = qimPayload(message);
+    uint64_t total_bits = static_cast<uint64_t>(payload.size()) * 8;
+    if (message.size() > kQimRawMaxLength || total_bits > sampleCount(cover)) {
+        res.status = Status::MessageTooLong;
+        return res;
+    }
+
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(total_bits);
+    QimTable table;
+    buildQimTable(q, table);
+    cv::Mat stego = cover.clone();
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload.data());
+    uint64_t pos = 0;
+    forEachSpan(stego, [&](uchar* samples, size_t count) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(count, total_bits - pos));
+        qimEmbedSpan(samples, n, table, bytes, pos);
+        pos += n;
+        return pos < total_bits;
+    });
+    res.stego = stego;
+    return res;
+}
+
+ExtractResult extractQIM(const cv::Mat& stego, int q) {
+    ExtractResult res;
+    if (!validQ(q)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+
+    PhaseTimer timer(Phase::Kernel);
+    QIMDecoder decoder(q, false, sampleCount(stego));
+    for (int y = 0; y < stego.rows && !decoder.done(); ++y)
+        decoder.pushRow(stego.ptr<uchar>(y), static_cast<size_t>(stego.cols) * 3);
+    countSamplesTouched(decoder.bitsRead());
+    if (!decoder.found()) {
+        res.status = Status::MessageNotFound;
+        return res;
+    }
+    res.message = decoder.message();
+    return res;
+}
+
+CapacityResult capacityQIM(const cv::Mat& cover, int q) {
+    CapacityResult res;
+    if (!validQ(q)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    uint64_t capacity = sampleCount(cover);
+    res.maxBytes = capacity < 16 ? 0 : std::min<uint64_t>((capacity - 16) / 8, kQimRawMaxLength);
+    return res;
+}
+
+
+// ==== Histogram Shifting ====
+EmbedResult embedHS(const cv::Mat& cover, const std::string& message) {
+    EmbedResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+
+    PhaseTimer timer(Phase::Kernel);
+    ChannelHistograms hist;
+    buildChannelHistograms(cover, hist);
+    uint64_t peakCount[3];
+    chooseHSKey(hist, res.hs, peakCount);
+
+    uint64_t total_bits = static_cast<uint64_t>(message.size()) * 8;
+    if (total_bits > peakCount[0] + peakCount[1] + peakCount[2]) {
+        res.status = Status::MessageTooLong;
+        return res;
+    }
+
+    countSamplesTouched(sampleCount(cover));
+    embedHSPass(cover, res.stego, res.hs, peakCount, reinterpret_cast<const uint8_t*>(message.data()), total_bits);
+    return res;
+}
+
+namespace {
+
+// Joins the per-channel bit strings in channel order into the first nbits bits of out
+void joinHSChannels(std::string channelBits[3], BitWriter channel[3], uint64_t nbits, std::string& out) {
+    BitWriter writer(out);
+    for (int c = 0; c < 3 && writer.bitCount() < nbits; ++c) {
+        uint64_t n = std::min(channel[c].bitCount(), nbits - writer.bitCount());
+        channel[c].writeBits(0, 7);   // pushes the trailing partial byte out
+        channel[c].flush();
+        appendBits(writer, reinterpret_cast<const uint8_t*>(channelBits[c].data()), n);
+    }
+}
+
+}  // namespace
+
+uint64_t embeddedBitsHS(const cv::Mat& stego, const HSKey& key) {
+    if (checkImage(stego) != Status::Ok)
+        return 0;
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(sampleCount(stego));
+    // Every peak and neighbour sample carries one bit, so the histogram has the count
+    ChannelHistograms hist;
+    buildChannelHistograms(stego, hist);
+    uint8_t code[3][256];
+    bool active[3];
+    hsCarrierCodes(key, code, active);
+    uint64_t count = 0;
+    for (int c = 0; c < 3; ++c)
+        for (int v = 0; v < 256; ++v)
+            count += code[c][v] != 0 ? hist.h[c][v] : 0;
+    return count;
+}
+
+ExtractResult extractHS(const cv::Mat& stego, const HSKey& key, size_t msgLen) {
+    ExtractResult res;
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+    uint64_t total_bits = static_cast<uint64_t>(msgLen) * 8;
+    if (total_bits == 0)
+        return res;
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(sampleCount(stego));
+    uint8_t code[3][256];
+    bool active[3];
+    hsCarrierCodes(key, code, active);
+    // Every channel is read on its own in parallel bands; a channel never holds more than the message
+    std::string channelBits[3];
+    BitWriter channel[3] = {BitWriter(channelBits[0]), BitWriter(channelBits[1]), BitWriter(channelBits[2])};
+    BitWriter* out[3] = {&channel[0], &channel[1], &channel[2]};
+    uint64_t limit[3];
+    for (int c = 0; c < 3; ++c)
+        limit[c] = active[c] ? total_bits : 0;
+    readHSBits(stego, code, limit, out);
+    std::string message;
+    joinHSChannels(channelBits, channel, total_bits, message);
+    if (message.size() < msgLen) {
+        res.status = Status::MessageTooLong;
+        return res;
+    }
+    res.message = std::move(message);
+    return res;
+}
+
+CapacityResult capacityHS(const cv::Mat& cover) {
+    CapacityResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    ChannelHistograms hist;
+    buildChannelHistograms(cover, hist);
+    HSKey key;
+    uint64_t peakCount[3];
+    chooseHSKey(hist, key, peakCount);
+    res.maxBytes = (peakCount[0] + peakCount[1] + peakCount[2]) / 8;
+    return res;
+}
+
+HSLayersResult embedHSLayers(const cv::Mat& cover, const std::string& message, int pairs, int maxLayers) {
+    HSLayersResult res;
+    if (pairs < 1 || pairs > kMaxHSPairs || maxLayers < 1) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+
+    PhaseTimer timer(Phase::Kernel);
+    ChannelHistograms hist;
+    buildChannelHistograms(cover, hist);
+    cv::Mat stego = cover.clone();
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(message.data());
+    uint64_t total_bits = static_cast<uint64_t>(message.size()) * 8;
+    uint64_t pos = 0;
+    for (int layer = 0; layer < maxLayers && pos < total_bits; ++layer) {
+        HSLayer next;
+        uint64_t peakCount[3];
+        chooseHSPairs(hist, pairs, next.key, peakCount);
+        // A single pair may fall back to a non-empty zero point, which cannot be undone under
+        // later layers; such channels sit this layer out
+        for (int c = 0; c < 3; ++c) {
+            if (next.key.P[c] != next.key.Z[c] && hist.h[c][next.key.Z[c]] != 0) {
+                next.key.Z[c] = next.key.P[c];
+                peakCount[c] = 0;
+            }
+        }
+        uint64_t n = std::min(peakCount[0] + peakCount[1] + peakCount[2], total_bits - pos);
+        if (n == 0)
+            break;
+        countSamplesTouched(sampleCount(cover));
+        HSBandEmbedder embedder(next.key, peakCount, payload, n, pos);
+        embedder.process(stego, stego);
+        embedder.updateHistograms(hist);
+        for (int c = 0; c < 3; ++c)
+            next.bits[c] = embedder.channelBits(c);
+        res.layers.push_back(next);
+        pos += n;
+    }
+    if (pos < total_bits) {
+        res.status = Status::MessageTooLong;
+        res.layers.clear();
+        return res;
+    }
+    res.stego = stego;
+    return res;
+}
+
+ExtractResult extractHSLayers(const cv::Mat& stego, const std::vector<HSLayer>& layers, cv::Mat* cover) {
+    ExtractResult res;
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+    std::vector<uint64_t> firstBit(layers.size() + 1, 0);
+    bool valid = true;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const HSKey& key = layers[i].key;
+        valid = valid && key.pairs >= 1 && key.pairs <= kMaxHSPairs;
+        for (int c = 0; c < 3 && valid; ++c) {
+            for (int j = 0; j < key.pairs; ++j) {
+                int P, Z;
+                hsPair(key, c, j, P, Z);
+                valid = valid && P >= 0 && P <= 255 && Z >= 0 && Z <= 255;
+            }
+            valid = valid && layers[i].bits[c] <= sampleCount(stego);
+        }
+        firstBit[i + 1] = firstBit[i] + layers[i].bits[0] + layers[i].bits[1] + layers[i].bits[2];
+    }
+    if (!valid) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+
+    PhaseTimer timer(Phase::Kernel);
+    cv::Mat image = stego.clone();
+    std::string message((firstBit.back() + 7) / 8, '\0');
+    for (size_t i = layers.size(); i-- > 0;) {
+        countSamplesTouched(sampleCount(stego));
+        restoreHSPass(image, layers[i].key, layers[i].bits, reinterpret_cast<uint8_t*>(&message[0]), firstBit[i]);
+    }
+    message.resize(firstBit.back() / 8);
+    res.message = std::move(message);
+    if (cover)
+        *cover = image;
+    return res;
+}
+
+
+// ==== PM1 (Plus-Minus One) ====
+EmbedResult embedPM1(const cv::Mat& cover, const std::string& message, std::optional<uint64_t> seed) {
+    EmbedResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    uint64_t total_bits = static_cast<uint64_t>(message.size()) * 8;
+    if (total_bits > sampleCount(cover)) {
+        res.status = Status::MessageTooLong;
+        return res;
+    }
+
+    PhaseTimer timer(Phase::Kernel);
+    countSamplesTouched(total_bits);
+    cv::Mat stego = cover.clone();
+    pm1EmbedRows(stego, reinterpret_cast<const uint8_t*>(message.data()), 0, total_bits, resolveSeed(seed));
+    res.stego = stego;
+    return res;
+}
+
+ExtractResult extractPM1(const cv::Mat& stego, size_t msgLen) {
+    // PM1 keeps the message in the parity of each sample, exactly like LSB
+    return extractLSB(stego, msgLen);
+}
+
+CapacityResult capacityPM1(const cv::Mat& cover) {
+    return capacityLSB(cover);
+}
+
+
+// ==== Self-describing header ====
+namespace {
+
+const size_t kHeaderBase = 13;
+
+// Pixels at the start of the image whose LSBs carry a Histogram Shifting header of the given size
+uint64_t hsHeaderPixels(size_t headerBytes) {
+    return (headerBytes * 8 + 2) / 3;
+}
+
+// Calls fn(part) for the parts of a band that lie at or after pixel index `from` of the image,
+// in raster order; bandStart is the image pixel index of the band's first pixel
+template <typename M, typename Fn>
+void forEachPartFrom(M& band, uint64_t bandStart, uint64_t from, Fn&& fn) {
+    uint64_t pixels = static_cast<uint64_t>(band.rows) * band.cols;
+    uint64_t skip = from > bandStart ? std::min(from - bandStart, pixels) : 0;
+    if (skip == pixels)
+        return;
+    if (skip == 0) {
+        fn(band);
+        return;
+    }
+    int r = static_cast<int>(skip / band.cols), c = static_cast<int>(skip % band.cols);
+    if (c > 0) {
+        M part = band(cv::Range(r, r + 1), cv::Range(c, band.cols));
+        fn(part);
+        ++r;
+    }
+    if (r < band.rows) {
+        M part = band(cv::Range(r, band.rows), cv::Range::all());
+        fn(part);
+    }
+}
+
+}  // namespace
+
+size_t headerSize(Method method, int hsPairs) {
+    return method == Method::HS ? kHeaderBase + 6 * std::max(hsPairs, 1) : kHeaderBase;
+}
+
+size_t coverHeadSamples() {
+    return static_cast<size_t>(hsHeaderPixels(headerSize(Method::HS, kMaxHSPairs))) * 3;
+}
+
+std::string encodeHeader(const PayloadHeader& header) {
+    std::string out = "SG";
+    out += static_cast<char>(kHeaderVersion);
+    out += static_cast<char>(static_cast<int>(header.method));
+    // Flags: bits per sample - 1 and the matrix code size, or pairs per channel - 1 for Histogram Shifting, then the codec
+    int flags = header.method == Method::HS ? header.hs.pairs - 1 : (header.bitsPerChannel - 1) | (header.matrixBits << 2);
+    out += static_cast<char>(flags | (static_cast<int>(header.codec) << 5));
+    for (int i = 7; i >= 0; --i)
+        out += static_cast<char>((header.length >> (8 * i)) & 0xFF);
+    if (header.method == Method::HS) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < header.hs.pairs; ++i) {
+                int P, Z;
+                hsPair(header.hs, c, i, P, Z);
+                out += static_cast<char>(P);
+                out += static_cast<char>(Z);
+            }
+        }
+    }
+    return out;
+}
+
+Status decodeHeader(const uint8_t* data, size_t size, PayloadHeader& header) {
+    if (size < kHeaderBase || data[0] != 'S' || data[1] != 'G' || data[2] != kHeaderVersion || (data[4] & 0x80) != 0)
+        return Status::MessageNotFound;
+    if (data[3] < static_cast<int>(Method::LSB) || data[3] > static_cast<int>(Method::PM1))
+        return Status::MessageNotFound;
+    header.method = static_cast<Method>(data[3]);
+    header.bitsPerChannel = header.method == Method::HS ? 1 : (data[4] & 0x03) + 1;
+    header.matrixBits = (data[4] >> 2) & 0x07;
+    header.codec = static_cast<Codec>((data[4] >> 5) & 0x03);
+    if (!validBits(header.method, header.bitsPerChannel) || !validMatrix(header.method, header.bitsPerChannel, header.matrixBits) ||
+        !validCodec(header.codec, true) || (header.method == Method::QIM && (data[4] & 0x1F) != 0))
+        return Status::MessageNotFound;
+    header.length = 0;
+    for (int i = 0; i < 8; ++i)
+        header.length = (header.length << 8) | data[5 + i];
+    if (header.method == Method::HS) {
+        header.hs = HSKey();
+        header.hs.pairs = (data[4] & 0x03) + 1;
+        if (size < headerSize(Method::HS, header.hs.pairs))
+            return Status::MessageNotFound;
+        const uint8_t* pz = data + kHeaderBase;
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < header.hs.pairs; ++i, pz += 2) {
+                (i == 0 ? header.hs.P[c] : header.hs.moreP[c][i - 1]) = pz[0];
+                (i == 0 ? header.hs.Z[c] : header.hs.moreZ[c][i - 1]) = pz[1];
+            }
+        }
+    }
+    return Status::Ok;
+}
+
+
+// ==== Generic entry points ====
+namespace {
+
+// Framed and multi-bit layouts go through BandEmbedder with the whole image as a single band;
+// in place, the stego image is the cover itself rather than a copy of it
+EmbedResult embedWhole(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts, bool inPlace) {
+    EmbedResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    BandEmbedder embedder(message, opts);
+    if (embedder.needsScan())
+        embedder.scanBand(cover);
+    if ((res.status = embedder.prepare(cover.cols, cover.rows)) != Status::Ok)
+        return res;
+    res.stego = inPlace ? cover : cover.clone();
+    embedder.embedBand(res.stego);
+    res.hs = embedder.hsKey();
+    return res;
+}
+
+// Rows of the scattered view gathered at a time: sample k of the view is image sample scatter.map(k)
+int scatterBandRows(int width) {
+    return std::max(1, (1 << 18) / std::max(width * 3, 1));
+}
+
+// Image addresses of view samples [0, count), where view sample j is index first + j
+void mapSamples(const cv::Mat& image, const Scatter& scatter, uint64_t first, uint64_t count, std::vector<uchar*>& where) {
+    uint64_t rowSamples = static_cast<uint64_t>(image.cols) * 3;
+    where.resize(count);
+    parallelForRange(count, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = begin; j < end; ++j) {
+            uint64_t s = scatter.map(first + j);
+            where[j] = image.isContinuous() ? image.data + s : image.data + (s / rowSamples) * image.step + s % rowSamples;
+        }
+    });
+}
+
+void gatherSamples(const std::vector<uchar*>& where, cv::Mat& view) {
+    uchar* out = view.data;
+    parallelForRange(where.size(), [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = begin; j < end; ++j)
+            out[j] = *where[j];
+    });
+}
+
+void scatterSamples(const std::vector<uchar*>& where, const cv::Mat& view) {
+    const uchar* in = view.data;
+    parallelForRange(where.size(), [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = begin; j < end; ++j)
+            *where[j] = in[j];
+    });
+}
+
+// Embeds into the image seen through the keyed permutation: the view is gathered band by band
+// (only as far as the payload reaches), embedded with the sequential kernels and written back
+EmbedResult embedScattered(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts, bool inPlace) {
+    EmbedResult res;
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    if (opts.method == Method::HS) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    BandEmbedder embedder(message, opts);
+    if ((res.status = embedder.prepare(cover.cols, cover.rows)) != Status::Ok)
+        return res;
+    res.stego = inPlace ? cover : cover.clone();
+    Scatter scatter(sampleCount(cover), *opts.scatterKey);
+    uint64_t rowSamples = static_cast<uint64_t>(cover.cols) * 3;
+    uint64_t needed = embedder.payloadSamples();
+    int bandRows = scatterBandRows(cover.cols);
+    PhaseTimer timer(Phase::Kernel);
+    cv::Mat view;
+    std::vector<uchar*> where;
+    for (int y = 0; y < cover.rows && static_cast<uint64_t>(y) * rowSamples < needed; y += bandRows) {
+        int rows = std::min(bandRows, cover.rows - y);
+        uint64_t first = static_cast<uint64_t>(y) * rowSamples;
+        view.create(rows, cover.cols, CV_8UC3);
+        mapSamples(res.stego, scatter, first, std::min<uint64_t>(rowSamples * rows, needed - first), where);
+        gatherSamples(where, view);
+        embedder.embedBand(view);
+        scatterSamples(where, view);
+    }
+    return res;
+}
+
+ExtractResult extractScattered(const cv::Mat& stego, const ExtractOptions& opts) {
+    ExtractResult res;
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+    if (opts.method == Method::HS) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    BandExtractor extractor(opts, stego.cols, stego.rows);
+    Scatter scatter(sampleCount(stego), *opts.scatterKey);
+    uint64_t rowSamples = static_cast<uint64_t>(stego.cols) * 3;
+    // Small first bands keep short messages cheap, as in extractFile
+    PhaseTimer timer(Phase::Kernel);
+    cv::Mat view;
+    std::vector<uchar*> where;
+    for (int y = 0, rows = 1; y < stego.rows; y += rows, rows = std::min(rows * 2, scatterBandRows(stego.cols))) {
+        rows = std::min(rows, stego.rows - y);
+        view.create(rows, stego.cols, CV_8UC3);
+        mapSamples(stego, scatter, static_cast<uint64_t>(y) * rowSamples, rowSamples * rows, where);
+        gatherSamples(where, view);
+        if (!extractor.extractBand(view))
+            break;
+    }
+    return extractor.finish();
+}
+
+EmbedResult embedRaw(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts) {
+    switch (opts.method) {
+        case Method::LSB: return embedLSB(cover, message);
+        case Method::HS:  return embedHS(cover, message);
+        case Method::QIM: return embedQIM(cover, message, opts.q);
+        case Method::PM1: return embedPM1(cover, message, opts.seed);
+    }
+    EmbedResult res;
+    res.status = Status::InvalidParameter;
+    return res;
+}
+
+// In place, the raw layouts go through BandEmbedder as well, which writes them into the cover's buffer
+EmbedResult embedAny(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts, bool inPlace) {
+    if (opts.scatterKey)
+        return embedScattered(cover, message, opts, inPlace);
+    if (inPlace || opts.framed || opts.bitsPerChannel != 1 || opts.matrixBits != 0 || opts.codec != Codec::None ||
+        (opts.method == Method::HS && opts.hsPairs != 1))
+        return embedWhole(cover, message, opts, inPlace);
+    return embedRaw(cover, message, opts);
+}
+
+}  // namespace
+
+uint64_t changedPixels(const cv::Mat& a, const cv::Mat& b) {
+    if (a.size() != b.size() || a.type() != b.type() || a.empty())
+        return 0;
+    size_t rowBytes = static_cast<size_t>(a.cols) * a.elemSize();
+    size_t pixelBytes = a.elemSize();
+    uint64_t count = 0;
+    for (int y = 0; y < a.rows; ++y) {
+        const uchar* pa = a.ptr<uchar>(y);
+        const uchar* pb = b.ptr<uchar>(y);
+        if (std::memcmp(pa, pb, rowBytes) == 0)
+            continue;
+        for (size_t i = 0; i < rowBytes; i += pixelBytes)
+            count += std::memcmp(pa + i, pb + i, pixelBytes) != 0;
+    }
+    return count;
+}
+
+EmbedResult embed(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts) {
+    EmbedResult res = embedAny(cover, message, opts, false);
+    // Costs an extra comparison pass, so it only runs when statistics are collected
+    if (res.status == Status::Ok && activeStats())
+        countPixelsChanged(changedPixels(cover, res.stego));
+    return res;
+}
+
+EmbedResult embedInPlace(cv::Mat& image, const std::string& message, const EmbedOptions& opts) {
+    // The comparison needs the cover, which embedding overwrites
+    cv::Mat cover = activeStats() ? image.clone() : cv::Mat();
+    EmbedResult res = embedAny(image, message, opts, true);
+    if (res.status != Status::Ok)
+        return res;
+    if (activeStats())
+        countPixelsChanged(changedPixels(cover, res.stego));
+    image = res.stego;
+    return res;
+}
+
+ExtractResult extract(const cv::Mat& stego, const ExtractOptions& opts) {
+    if (opts.scatterKey)
+        return extractScattered(stego, opts);
+    if (!opts.framed && opts.bitsPerChannel == 1 && opts.matrixBits == 0) {
+        switch (opts.method) {
+            case Method::LSB: return extractLSB(stego, opts.msgLen);
+            case Method::HS:  return extractHS(stego, opts.hs, opts.msgLen);
+            case Method::QIM: return extractQIM(stego, opts.q);
+            case Method::PM1: return extractPM1(stego, opts.msgLen);
+        }
+    }
+    ExtractResult res;
+    if ((res.status = checkImage(stego)) != Status::Ok)
+        return res;
+    BandExtractor extractor(opts, stego.cols, stego.rows);
+    extractor.extractBand(stego);
+    return extractor.finish();
+}
+
+CapacityResult capacity(const cv::Mat& cover, Method method, int q, int bitsPerChannel) {
+    EmbedOptions opts;
+    opts.method = method;
+    opts.q = q;
+    opts.bitsPerChannel = bitsPerChannel;
+    return capacity(cover, opts);
+}
+
+CapacityResult capacity(const cv::Mat& cover, const EmbedOptions& opts) {
+    CapacityResult res;
+    if (!validEmbedOptions(opts)) {
+        res.status = Status::InvalidParameter;
+        return res;
+    }
+    if ((res.status = checkImage(cover)) != Status::Ok)
+        return res;
+    BandEmbedder embedder(std::string(), opts);
+    if (embedder.needsScan())
+        embedder.scanBand(cover);
+    res.maxBytes = embedder.capacityBytes(cover.cols, cover.rows);
+    return res;
+}
+
+EncodedEmbedResult embedEncoded(const std::vector<uchar>& cover, const std::string& message, const EmbedOptions& opts) {
+    EncodedEmbedResult res;
+    cv::Mat image;
+    if ((res.status = decodeImage(cover, image)) != Status::Ok)
+        return res;
+    EmbedResult emb = embed(image, message, opts);
+    res.hs = emb.hs;
+    if ((res.status = emb.status) != Status::Ok)
+        return res;
+    res.status = encodeImage(emb.stego, opts.ext, res.bytes, opts.encode);
+    return res;
+}
+
+ExtractResult extractEncoded(const std::vector<uchar>& stego, const ExtractOptions& opts) {
+    ExtractResult res;
+    cv::Mat image;
+    if ((res.status = decodeImage(stego, image)) != Status::Ok)
+        return res;
+    return extract(image, opts);
+}
+
+
+// ==== Row-band streaming ====
+struct BandEmbedder::Impl {
+    Impl(PayloadSource& src, const EmbedOptions& o)
+        : opts(o), source(&src), messageSize(src.size()), seed(o.method == Method::PM1 ? resolveSeed(o.seed) : 0) {
+        // With several bits per sample or matrix embedding the message goes into `body`, after the
+        // one-bit header; the window pads it with the zero bytes the K-bit kernels may read past the last bit
+        bool multiBit = opts.bitsPerChannel > 1 || opts.matrixBits > 0;
+        if (multiBit)
+            body.reset(std::string(), source, messageSize);
+        if (!opts.framed) {
+            if (opts.method == Method::QIM)
+                head.reset(qimLengthPrefix(messageSize), source, messageSize);
+            else if (!multiBit)
+                head.reset(std::string(), source, messageSize);
+        } else if (opts.method == Method::HS) {
+            reservedLsb.assign(headerSize(Method::HS, opts.hsPairs), '\0');
+        } else {
+            PayloadHeader header;
+            header.method = opts.method;
+            header.length = messageSize;
+            header.bitsPerChannel = opts.bitsPerChannel;
+            header.matrixBits = opts.matrixBits;
+            header.codec = opts.codec;
+            head.reset(encodeHeader(header), multiBit ? nullptr : source, multiBit ? 0 : messageSize);
+        }
+    }
+
+    uint64_t reservedPixels() const {
+        return opts.framed && opts.method == Method::HS ? hsHeaderPixels(reservedLsb.size()) : 0;
+    }
+
+    // LSB and PM1: samples [0, H) carry `head` one bit each and the next bodySamples carry
+    // `body` bitsPerChannel bits each, or k bits per matrix group; rows are independent, so they run in parallel
+    void embedBits(cv::Mat& band, uint64_t bandStart) {
+        uint64_t headSamples = head.size() * 8;
+        uint64_t end = headSamples + bodySamples;
+        if (bandStart >= end)
+            return;
+        int bits = opts.bitsPerChannel;
+        uint64_t rowSamples = static_cast<uint64_t>(band.cols) * 3;
+        int rows = static_cast<int>(std::min<uint64_t>(band.rows, (end - bandStart + rowSamples - 1) / rowSamples));
+        // The payload bytes of this band, pulled from the source before the rows run in parallel
+        uint64_t bandEnd = std::min(end, bandStart + rows * rowSamples);
+        uint64_t headFirst = std::min(bandStart, headSamples) / 8;
+        const uint8_t* headBytes = head.bytes(headFirst, (std::min(bandEnd, headSamples) + 7) / 8);
+        uint64_t bodyFirst = (std::max(bandStart, headSamples) - headSamples) * bits / 8;
+        uint64_t bodyEnd = ((bandEnd - std::min(bandEnd, headSamples)) * bits + 7) / 8 + 4;
+        if (opts.matrixBits > 0) {
+            uint64_t y = bandStart / rowSamples;
+            bodyFirst = layout.groupsBefore(y) * opts.matrixBits / 8;
+            bodyEnd = (std::min(groups, layout.groupsBefore(y + band.rows)) * opts.matrixBits + 7) / 8 + 4;
+        }
+        const uint8_t* bodyBytes = bandEnd > headSamples ? body.bytes(bodyFirst, bodyEnd) : nullptr;
+        bool pm1 = opts.method == Method::PM1;
+        LsbBitsEmbed lsbBody = lsbEmbedKernel(bits);
+        Pm1BitsEmbed pm1Body = pm1EmbedKernel(bits);
+        parallelForBands(rows, bandCount(rows, rowSamples), [&](int, int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                uchar* row = band.ptr<uchar>(y);
+                uint64_t first = bandStart + y * rowSamples;
+                size_t n = static_cast<size_t>(std::min<uint64_t>(rowSamples, end - first));
+                size_t h = first < headSamples ? static_cast<size_t>(std::min<uint64_t>(n, headSamples - first)) : 0;
+                if (h > 0) {
+                    if (pm1)
+                        pm1EmbedSpanBits<1>(row, h, headBytes, first - headFirst * 8, seed, first);
+                    else
+                        lsbEmbedSpan(row, h, headBytes, first - headFirst * 8);
+                }
+                if (n > h && opts.matrixBits > 0) {
+                    uint64_t g = layout.groupsBefore(first / rowSamples);
+                    uint64_t gEnd = std::min(groups, layout.groupsBefore(first / rowSamples + 1));
+                    if (gEnd > g) {
+                        uint64_t at = layout.groupSample(g);
+                        uint64_t bit = g * opts.matrixBits - bodyFirst * 8;
+                        if (pm1)
+                            pm1MatrixEmbedSpan(row + (at - first), gEnd - g, matrix, bodyBytes, bit, seed, at);
+                        else
+                            matrixEmbedSpan(row + (at - first), gEnd - g, matrix, bodyBytes, bit);
+                    }
+                } else if (n > h) {
+                    uint64_t sample = first + h;
+                    uint64_t bit = (sample - headSamples) * bits - bodyFirst * 8;
+                    if (pm1)
+                        pm1Body(row + h, n - h, bodyBytes, bit, seed, sample);
+                    else
+                        lsbBody(row + h, n - h, bodyBytes, bit);
+                }
+            }
+        });
+    }
+
+    EmbedOptions opts;
+    std::shared_ptr<std::string> ownedMessage;   // the string constructor's copy of the message
+    std::unique_ptr<PayloadSource> owned;        // and its source, or the packed message
+    bool packFailed = false;   // the source ended early or could not be packed
+    PayloadSource* source;
+    uint64_t messageSize;
+    PayloadWindow head;        // bits embedded one per sample: header and/or message
+    PayloadWindow body;        // LSB and PM1 with several bits per sample: the message
+    uint64_t bodySamples = 0;  // samples that carry body
+    MatrixCode matrix;         // matrix embedding: syndrome tables,
+    MatrixRows layout;         // the group layout
+    uint64_t groups = 0;       // and the groups that carry body
+    std::string payload;       // HS: the reserved LSBs and the whole message, split over the channels
+    std::string header;        // framed HS: header written into the LSBs of the reserved pixels
+    std::string reservedLsb;   // framed HS: original LSBs of those samples, carried in front of the message
+    QimTable qim;
+    ChannelHistograms hist;
+    HSKey key;
+    std::unique_ptr<HSBandEmbedder> hs;
+    uint64_t seed;             // PM1 random stream
+    uint64_t scanned = 0;      // samples passed to scanBand
+    uint64_t embedded = 0;     // samples passed to embedBand
+    uint64_t pos = 0;          // QIM: payload bits embedded
+    int width = 0;
+    bool prepared = false;
+};
+
+BandEmbedder::BandEmbedder(const std::string& message, const EmbedOptions& opts) {
+    PhaseTimer timer(Phase::Payload);
+    // The message is copied, so the caller's string may go away; a packed copy is kept only if it is smaller
+    EmbedOptions o = opts;
+    std::shared_ptr<std::string> copy;
+    if (o.codec != Codec::None && o.framed) {
+        copy = std::make_shared<std::string>(packPayload(message, o.codec));
+        if (copy->size() >= message.size()) {
+            *copy = message;
+            o.codec = Codec::None;
+        }
+    } else {
+        copy = std::make_shared<std::string>(message);
+    }
+    auto source = std::make_unique<MemorySource>(*copy);
+    impl_ = std::make_unique<Impl>(*source, o);
+    impl_->owned = std::move(source);
+    impl_->ownedMessage = std::move(copy);
+}
+
+BandEmbedder::BandEmbedder(PayloadSource& source, const EmbedOptions& opts) {
+    PhaseTimer timer(Phase::Payload);
+    if (opts.codec == Codec::None || !opts.framed) {
+        impl_ = std::make_unique<Impl>(source, opts);
+        return;
+    }
+    // The packed size goes into the header, so the whole source is packed before the first band
+    std::unique_ptr<PayloadSource> packed = packSource(source, opts.codec);
+    bool failed = !packed;
+    if (failed)
+        packed = std::make_unique<MemorySource>(nullptr, 0);
+    impl_ = std::make_unique<Impl>(*packed, opts);
+    impl_->owned = std::move(packed);
+    impl_->packFailed = failed;
+}
+
+BandEmbedder::~BandEmbedder() = default;
+
+bool BandEmbedder::needsScan() const {
+    return impl_->opts.method == Method::HS;
+}
+
+void BandEmbedder::scanBand(const cv::Mat& band) {
+    Impl& d = *impl_;
+    CV_Assert(band.type() == CV_8UC3);
+    PhaseTimer timer(Phase::Histogram);
+    forEachPartFrom(band, d.scanned / 3, d.reservedPixels(), [&](const cv::Mat& part) {
+        uint64_t hist[3][256];
+        buildHistograms(part, hist);
+        for (int c = 0; c < 3; ++c)
+            for (int v = 0; v < 256; ++v)
+                d.hist.h[c][v] += hist[c][v];
+    });
+    uint64_t reservedBits = static_cast<uint64_t>(d.reservedLsb.size()) * 8;
+    uint64_t off = d.scanned;
+    if (off < reservedBits) {
+        forEachSpan(band, [&](const uchar* samples, size_t count) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(count, reservedBits - off));
+            lsbExtractSpan(samples, n, reinterpret_cast<uint8_t*>(&d.reservedLsb[0]), off);
+            off += n;
+            return off < reservedBits;
+        });
+    }
+    d.scanned += static_cast<uint64_t>(band.rows) * band.cols * 3;
+}
+
+void BandEmbedder::setStats(const uint64_t hist[3][256], const uint8_t* head, size_t headSamples) {
+    Impl& d = *impl_;
+    PhaseTimer timer(Phase::Histogram);
+    std::memcpy(d.hist.h, hist, sizeof(d.hist.h));
+    // The reserved header pixels are not carriers, as in scanBand
+    size_t reserved = static_cast<size_t>(std::min<uint64_t>(d.reservedPixels() * 3, headSamples));
+    for (size_t i = 0; i < reserved; ++i)
+        --d.hist.h[i % 3][head[i]];
+    size_t reservedBits = std::min(d.reservedLsb.size() * 8, headSamples);
+    if (reservedBits > 0)
+        lsbExtractSpan(head, reservedBits, reinterpret_cast<uint8_t*>(&d.reservedLsb[0]), 0);
+    d.scanned = headSamples;
+}
+
+uint64_t BandEmbedder::capacityBytes(int width, int height) const {
+    const Impl& d = *impl_;
+    uint64_t samples = static_cast<uint64_t>(std::max(width, 0)) * std::max(height, 0) * 3;
+    if (!validEmbedOptions(d.opts))
+        return 0;
+    uint64_t bytes = 0;
+    switch (d.opts.method) {
+        case Method::LSB:
+        case Method::PM1: {
+            // The header always takes one bit per sample
+            uint64_t headerSamples = d.opts.framed ? headerSize(d.opts.method) * 8 : 0;
+            if (samples <= headerSamples)
+                return 0;
+            if (d.opts.matrixBits > 0) {
+                MatrixRows rows = matrixRows(headerSamples, static_cast<uint64_t>(width) * 3, d.opts.matrixBits);
+                return rows.groupsBefore(height) * d.opts.matrixBits / 8;
+            }
+            return (samples - headerSamples) * d.opts.bitsPerChannel / 8;
+        }
+        case Method::QIM:
+            bytes = d.opts.framed ? samples / 8 : (samples < 16 ? 0 : std::min<uint64_t>((samples - 16) / 8, kQimRawMaxLength));
+            break;
+        case Method::HS: {
+            HSKey key;
+            uint64_t peakCount[3];
+            chooseHSPairs(d.hist, d.opts.hsPairs, key, peakCount);
+            bytes = (peakCount[0] + peakCount[1] + peakCount[2]) / 8;
+            break;
+        }
+    }
+    uint64_t header = d.opts.framed ? headerSize(d.opts.method, d.opts.hsPairs) : 0;
+    return bytes > header ? bytes - header : 0;
+}
+
+Status BandEmbedder::prepare(int width, int height) {
+    Impl& d = *impl_;
+    if (width <= 0 || height <= 0)
+        return Status::ImageLoadError;
+    if (!validEmbedOptions(d.opts))
+        return Status::InvalidParameter;
+    if (d.packFailed)
+        return Status::PayloadError;
+    PhaseTimer timer(Phase::Payload);
+    uint64_t samples = static_cast<uint64_t>(width) * height * 3;
+    if (d.opts.method == Method::HS) {
+        uint64_t peakCount[3];
+        chooseHSPairs(d.hist, d.opts.hsPairs, d.key, peakCount);
+        if (d.reservedPixels() > samples / 3)
+            return Status::MessageTooLong;
+        uint64_t total_bits = (d.reservedLsb.size() + d.messageSize) * 8;
+        if (total_bits > peakCount[0] + peakCount[1] + peakCount[2])
+            return Status::MessageTooLong;
+        if (d.opts.framed) {
+            PayloadHeader header;
+            header.method = Method::HS;
+            header.length = d.messageSize;
+            header.hs = d.key;
+            header.codec = d.opts.codec;
+            d.header = encodeHeader(header);
+        }
+        // The channels take consecutive parts of the payload, so it is read whole; it is no
+        // larger than the peak count, a small part of the image
+        d.payload = d.reservedLsb;
+        d.payload.resize(d.reservedLsb.size() + d.messageSize);
+        if (d.source->read(reinterpret_cast<uint8_t*>(&d.payload[0]) + d.reservedLsb.size(), d.messageSize) != d.messageSize)
+            return Status::PayloadError;
+        d.hs = std::make_unique<HSBandEmbedder>(d.key, peakCount, reinterpret_cast<const uint8_t*>(d.payload.data()), total_bits);
+    } else if (d.opts.method == Method::QIM) {
+        if (d.head.size() * 8 > samples)
+            return Status::MessageTooLong;
+        if (!d.opts.framed && d.messageSize > kQimRawMaxLength)
+            return Status::MessageTooLong;
+        buildQimTable(d.opts.q, d.qim);
+    } else {
+        if (d.messageSize > capacityBytes(width, height))
+            return Status::MessageTooLong;
+        if (d.opts.matrixBits > 0) {
+            int k = d.opts.matrixBits;
+            buildMatrixCode(k, d.matrix);
+            d.layout = matrixRows(d.head.size() * 8, static_cast<uint64_t>(width) * 3, k);
+            d.groups = (d.messageSize * 8 + k - 1) / k;
+            d.bodySamples = d.layout.samplesFor(d.groups) - d.layout.start;
+        } else if (d.opts.bitsPerChannel > 1) {
+            d.bodySamples = (d.messageSize * 8 + d.opts.bitsPerChannel - 1) / d.opts.bitsPerChannel;
+        }
+    }
+    d.width = width;
+    d.prepared = true;
+    return Status::Ok;
+}
+
+void BandEmbedder::embedBand(cv::Mat& band) {
+    Impl& d = *impl_;
+    CV_Assert(d.prepared && band.type() == CV_8UC3 && band.cols == d.width);
+    PhaseTimer timer(Phase::Kernel);
+    size_t rowSamples = static_cast<size_t>(band.cols) * 3;
+    uint64_t bandStart = d.embedded;
+    d.embedded += rowSamples * band.rows;
+    if (activeStats()) {
+        uint64_t left = d.opts.method == Method::HS ? rowSamples * band.rows
+                                                    : payloadSamples() - std::min(bandStart, payloadSamples());
+        countSamplesTouched(std::min<uint64_t>(left, rowSamples * band.rows));
+    }
+    switch (d.opts.method) {
+        case Method::LSB:
+        case Method::PM1:
+            d.embedBits(band, bandStart);
+            break;
+        case Method::HS: {
+            forEachPartFrom(band, bandStart / 3, d.reservedPixels(), [&](cv::Mat& part) { d.hs->process(part, part); });
+            uint64_t headerBits = static_cast<uint64_t>(d.header.size()) * 8;
+            uint64_t off = bandStart;
+            if (off < headerBits) {
+                const uint8_t* header = reinterpret_cast<const uint8_t*>(d.header.data());
+                forEachSpan(band, [&](uchar* samples, size_t count) {
+                    size_t n = static_cast<size_t>(std::min<uint64_t>(count, headerBits - off));
+                    lsbEmbedSpan(samples, n, header, off);
+                    off += n;
+                    return off < headerBits;
+                });
+            }
+            break;
+        }
+        case Method::QIM: {
+            uint64_t total_bits = d.head.size() * 8;
+            if (d.pos >= total_bits)
+                return;
+            uint64_t first = d.pos / 8;
+            const uint8_t* payload = d.head.bytes(first, (std::min(total_bits, d.pos + rowSamples * band.rows) + 7) / 8);
+            forEachSpan(band, [&](uchar* samples, size_t count) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(count, total_bits - d.pos));
+                qimEmbedSpan(samples, n, d.qim, payload, d.pos - first * 8);
+                d.pos += n;
+                return d.pos < total_bits;
+            });
+            break;
+        }
+    }
+}
+
+const HSKey& BandEmbedder::hsKey() const {
+    return impl_->key;
+}
+
+uint64_t BandEmbedder::payloadSamples() const {
+    const Impl& d = *impl_;
+    if (d.opts.method == Method::HS)
+        return std::numeric_limits<uint64_t>::max();
+    return d.head.size() * 8 + d.bodySamples;
+}
+
+bool BandEmbedder::payloadFailed() const {
+    return impl_->packFailed || impl_->head.failed() || impl_->body.failed();
+}
+
+struct BandExtractor::Impl {
+    Impl(const ExtractOptions& o, int width, int height, PayloadSink* out)
+        : opts(o), samples(static_cast<uint64_t>(std::max(width, 0)) * std::max(height, 0) * 3),
+          rowSamples(static_cast<uint64_t>(std::max(width, 0)) * 3), out(out), sink(out), qim(o.q, o.framed, samples, o.method == Method::HS ? nullptr : out),
+          channel{BitWriter(channelBits[0]), BitWriter(channelBits[1]), BitWriter(channelBits[2])} {}
+
+    // Reads sample LSBs into data until total_bits, then the multi-bit body if there is one;
+    // used by LSB, PM1 and the HS header
+    void lsbStage(const cv::Mat& band) {
+        forEachSpan(band, [&](const uchar* s, size_t count) {
+            while (count > 0 && !done) {
+                size_t n;
+                if (inBody && matrixOn) {
+                    n = matrixSpan(s, count);
+                    if (n == 0) {
+                        flushBody();
+                        continue;
+                    }
+                    bodyRead += n;
+                    done = bodyRead == bodySamples;
+                } else if (inBody) {
+                    uint64_t offset = bodyRead * bits - bodyBase * 8;
+                    n = static_cast<size_t>(std::min<uint64_t>(count, bodySamples - bodyRead));
+                    if (sink)
+                        n = static_cast<size_t>(std::min<uint64_t>(n, (body.size() * 8 - offset) / bits));
+                    if (n == 0) {
+                        flushBody();
+                        continue;
+                    }
+                    bodyKernel(s, n, reinterpret_cast<uint8_t*>(&body[0]), offset);
+                    bodyRead += n;
+                    done = bodyRead == bodySamples;
+                } else {
+                    if (pos >= total_bits)
+                        break;   // HS: the header is complete, the rest of the band is shifted samples
+                    uint64_t end = streaming() ? std::min(total_bits, (dataBase + data.size()) * 8) : total_bits;
+                    n = static_cast<size_t>(std::min<uint64_t>(count, end - pos));
+                    lsbExtractSpan(s, n, reinterpret_cast<uint8_t*>(&data[0]), pos - dataBase * 8);
+                    pos += n;
+                    if (pos == total_bits)
+                        lsbComplete();
+                    else if (pos == end)
+                        flushData();
+                }
+                s += n;
+                count -= n;
+            }
+            return !done && (inBody || pos < total_bits);
+        });
+    }
+
+    // Switches to reading msgBits of message at k bits per sample
+    void startBody(int k, uint64_t messageBits) {
+        inBody = true;
+        bits = k;
+        bodyKernel = lsbExtractKernel(k);
+        msgBits = messageBits;
+        bodySamples = (messageBits + k - 1) / k;
+        // One spare byte holds the bits of a sample that straddles the end of the window
+        body.assign((sink ? std::min<uint64_t>(kSinkChunk, messageBits / 8) : messageBits / 8) + 1, '\0');
+        done = bodySamples == 0;
+    }
+
+    // Switches to reading msgBits of message, k bits per matrix group from image sample `start` on
+    void startMatrix(int k, uint64_t messageBits, uint64_t start) {
+        inBody = matrixOn = true;
+        bits = k;
+        buildMatrixCode(k, matrix);
+        layout = matrixRows(start, rowSamples, k);
+        msgBits = messageBits;
+        groups = (messageBits + k - 1) / k;
+        bodySamples = layout.samplesFor(groups) - start;
+        // A window holds at least the groups of a whole row
+        uint64_t rowBytes = layout.rowSamples / layout.n * k / 8 + 1;
+        body.assign((sink ? std::min(std::max<uint64_t>(kSinkChunk, rowBytes), messageBits / 8) : messageBits / 8) + 1, '\0');
+        done = groups == 0;
+    }
+
+    // Matrix embedding: reads the groups of the rest of the current row; a span never ends inside
+    // a row before the last group, as bands are whole rows. Returns the samples consumed, or 0 when
+    // the body window must be flushed first
+    size_t matrixSpan(const uchar* s, size_t count) {
+        uint64_t a = layout.start + bodyRead;
+        uint64_t y = a / rowSamples;
+        size_t n = static_cast<size_t>(std::min<uint64_t>({count, (y + 1) * rowSamples - a, bodySamples - bodyRead}));
+        uint64_t gEnd = std::min(groups, layout.groupsBefore(y + 1));
+        if (gEnd > groupsRead) {
+            uint64_t offset = bodyBits() - bodyBase * 8;
+            if (offset + (gEnd - groupsRead) * bits > body.size() * 8)
+                return 0;
+            uint64_t at = layout.groupSample(groupsRead);
+            matrixExtractSpan(s + (at - a), gEnd - groupsRead, matrix, reinterpret_cast<uint8_t*>(&body[0]), offset);
+            groupsRead = gEnd;
+        }
+        return n;
+    }
+
+    // Message bits read so far by the body
+    uint64_t bodyBits() const {
+        return matrixOn ? groupsRead * bits : bodyRead * bits;
+    }
+
+    // With a sink, the one-bit message after the header is collected a chunk at a time
+    bool streaming() const {
+        return sink && haveHeader && opts.method != Method::HS;
+    }
+
+    bool writeSink(const std::string& bytes, size_t n) {
+        if (n > 0 && status == Status::Ok && !sink->write(reinterpret_cast<const uint8_t*>(bytes.data()), n)) {
+            status = unpack && unpack->corrupt() ? Status::MessageNotFound : Status::PayloadError;
+            done = true;
+        }
+        return status == Status::Ok;
+    }
+
+    // A packed message goes to the caller's sink through an UnpackSink, or is unpacked in finish()
+    void useCodec(Codec c) {
+        codec = c;
+        if (sink && codec != Codec::None) {
+            unpack = std::make_unique<UnpackSink>(*sink, codec);
+            sink = unpack.get();
+        }
+    }
+
+    // Writes the full data window and starts the next one
+    void flushData() {
+        writeSink(data, data.size());
+        dataBase += data.size();
+        data.assign(static_cast<size_t>(std::min<uint64_t>(kSinkChunk, total_bits / 8 - dataBase)), '\0');
+    }
+
+    // Writes the complete bytes of the body window and moves the partial one to its front
+    void flushBody() {
+        size_t whole = static_cast<size_t>((bodyBits() - bodyBase * 8) / 8);
+        writeSink(body, whole);
+        bodyBase += whole;
+        char partial = body[whole];
+        std::fill(body.begin(), body.end(), '\0');
+        body[0] = partial;
+    }
+
+    void lsbComplete() {
+        if (haveHeader) {
+            done = true;
+            return;
+        }
+        if (opts.method == Method::HS && data.size() >= kHeaderBase) {
+            // The flags byte gives the number of pairs and with it the header size
+            size_t need = headerSize(Method::HS, (data[4] & 3) + 1);
+            if (data.size() < need) {
+                total_bits = need * 8;
+                data.resize(need);
+                return;
+            }
+        }
+        PayloadHeader header;
+        if (decodeHeader(reinterpret_cast<const uint8_t*>(data.data()), data.size(), header) != Status::Ok ||
+            header.method != opts.method) {
+            status = Status::MessageNotFound;
+            done = true;
+            return;
+        }
+        haveHeader = true;
+        headerBytes = data.size();
+        useCodec(header.codec);
+        if (opts.method == Method::HS) {
+            key = header.hs;
+            if (header.length > samples / 8) {
+                status = Status::MessageNotFound;
+                done = true;
+            }
+            hsFrom = hsHeaderPixels(data.size());
+            hsBits = (data.size() + header.length) * 8;
+            return;
+        }
+        uint64_t room = header.matrixBits > 0
+                            ? matrixRows(pos, rowSamples, header.matrixBits).groupsBefore(samples / std::max<uint64_t>(rowSamples, 1)) * header.matrixBits
+                            : (samples - pos) * header.bitsPerChannel;
+        if (header.length > room / 8) {
+            status = Status::MessageNotFound;
+            done = true;
+            return;
+        }
+        if (header.matrixBits > 0) {
+            startMatrix(header.matrixBits, header.length * 8, pos);
+            return;
+        }
+        if (header.bitsPerChannel > 1) {
+            startBody(header.bitsPerChannel, header.length * 8);
+            return;
+        }
+        total_bits += header.length * 8;
+        if (sink) {
+            dataBase = data.size();
+            data.assign(static_cast<size_t>(std::min<uint64_t>(kSinkChunk, header.length)), '\0');
+        } else {
+            data.resize(total_bits / 8);
+        }
+        if (header.length == 0)
+            done = true;
+    }
+
+    // Collects the Histogram Shifting candidates of every channel that still needs bits
+    void hsStage(const cv::Mat& band, uint64_t bandStart) {
+        uint8_t code[3][256];
+        bool active[3];
+        hsCarrierCodes(key, code, active);
+        uint64_t from = opts.framed ? hsFrom : 0;
+        uint64_t limit[3];
+        for (int c = 0; c < 3; ++c)
+            limit[c] = active[c] ? hsBits : 0;
+        BitWriter* out[3] = {&channel[0], &channel[1], &channel[2]};
+        forEachPartFrom(band, bandStart, from, [&](const cv::Mat& part) { readHSBits(part, code, limit, out); });
+        // Later channels only matter once the earlier ones are known to be complete
+        for (int c = 0; c < 3; ++c) {
+            if (!active[c])
+                continue;
+            done = channel[c].bitCount() >= hsBits;
+            break;
+        }
+    }
+
+    ExtractOptions opts;
+    uint64_t samples;
+    uint64_t rowSamples;
+    uint64_t seen = 0;           // samples passed to extractBand
+    Status status = Status::Ok;
+    bool done = false;
+    PayloadSink* out;            // the caller's sink
+    PayloadSink* sink;           // where the message goes: out, or unpack in front of it
+    std::unique_ptr<UnpackSink> unpack;
+    Codec codec = Codec::None;
+    // LSB, PM1 and the HS header: bytes read from the sample LSBs
+    std::string data;
+    uint64_t dataBase = 0;       // with a sink: stream byte index of data[0]
+    uint64_t pos = 0;
+    uint64_t total_bits = 0;
+    size_t headerBytes = 0;      // bytes of data in front of the message
+    bool haveHeader = false;
+    // LSB and PM1 with several bits per sample: the message after the one-bit header
+    bool inBody = false;
+    int bits = 1;
+    LsbBitsExtract bodyKernel = nullptr;
+    std::string body;
+    uint64_t bodyBase = 0;       // with a sink: message byte index of body[0]
+    uint64_t msgBits = 0;
+    uint64_t bodySamples = 0;
+    uint64_t bodyRead = 0;
+    // Matrix embedding: the body is k bits per group of the layout
+    bool matrixOn = false;
+    MatrixCode matrix;
+    MatrixRows layout;
+    uint64_t groups = 0;
+    uint64_t groupsRead = 0;
+    QIMDecoder qim;
+    // Histogram Shifting: each channel's bits are collected separately and joined in finish()
+    HSKey key;
+    uint64_t hsBits = 0;
+    uint64_t hsFrom = 0;         // first pixel after the framed header
+    std::string channelBits[3];
+    BitWriter channel[3];
+};
+
+BandExtractor::BandExtractor(const ExtractOptions& opts, int width, int height, PayloadSink* sink)
+    : impl_(std::make_unique<Impl>(opts, width, height, sink)) {
+    Impl& d = *impl_;
+    switch (opts.method) {
+        case Method::LSB:
+        case Method::PM1:
+            d.haveHeader = !opts.framed;
+            if (!opts.framed && (!validBits(opts.method, opts.bitsPerChannel) ||
+                                 !validMatrix(opts.method, opts.bitsPerChannel, opts.matrixBits))) {
+                d.status = Status::InvalidParameter;
+                d.done = true;
+            } else if (!opts.framed && opts.matrixBits > 0) {
+                uint64_t fit = matrixRows(0, d.rowSamples, opts.matrixBits).groupsBefore(std::max(height, 0)) * opts.matrixBits / 8 * 8;
+                d.startMatrix(opts.matrixBits, std::min<uint64_t>(static_cast<uint64_t>(opts.msgLen) * 8, fit), 0);
+            } else if (!opts.framed && opts.bitsPerChannel > 1) {
+                // Like the one-bit layout, a short image yields only the complete bytes it holds
+                uint64_t fit = d.samples * opts.bitsPerChannel / 8 * 8;
+                d.startBody(opts.bitsPerChannel, std::min<uint64_t>(static_cast<uint64_t>(opts.msgLen) * 8, fit));
+            } else {
+                d.total_bits = opts.framed ? kHeaderBase * 8 : std::min<uint64_t>(static_cast<uint64_t>(opts.msgLen) * 8, d.samples / 8 * 8);
+                d.data.assign(static_cast<size_t>(d.streaming() ? std::min<uint64_t>(kSinkChunk, d.total_bits / 8) : d.total_bits / 8), '\0');
+                d.done = d.total_bits == 0;
+            }
+            break;
+        case Method::HS:
+            d.haveHeader = !opts.framed;
+            if (opts.framed) {
+                d.total_bits = kHeaderBase * 8;
+                d.data.assign(kHeaderBase, '\0');
+            } else {
+                d.key = opts.hs;
+                d.hsBits = static_cast<uint64_t>(opts.msgLen) * 8;
+                d.done = d.hsBits == 0;
+            }
+            break;
+        case Method::QIM:
+            if (!validQ(opts.q)) {
+                d.status = Status::InvalidParameter;
+                d.done = true;
+            }
+            break;
+    }
+}
+
+BandExtractor::~BandExtractor() = default;
+
+bool BandExtractor::extractBand(const cv::Mat& band) {
+    Impl& d = *impl_;
+    CV_Assert(band.type() == CV_8UC3);
+    if (d.done)
+        return false;
+    PhaseTimer timer(Phase::Kernel);
+    size_t rowSamples = static_cast<size_t>(band.cols) * 3;
+    uint64_t bandStart = d.seen;
+    d.seen += rowSamples * band.rows;
+    uint64_t bitsBefore = d.pos + d.bodyRead + d.qim.bitsRead();
+    switch (d.opts.method) {
+        case Method::LSB:
+        case Method::PM1:
+            d.lsbStage(band);
+            break;
+        case Method::QIM:
+            forEachSpan(band, [&](const uchar* samples, size_t count) {
+                return !(d.done = d.qim.pushRow(samples, count));
+            });
+            if (d.qim.sinkFailed())
+                d.status = d.qim.corrupt() ? Status::MessageNotFound : Status::PayloadError;
+            break;
+        case Method::HS:
+            if (!d.haveHeader)
+                d.lsbStage(band);
+            if (!d.done && d.haveHeader)
+                d.hsStage(band, bandStart / 3);
+            break;
+    }
+    countSamplesTouched(d.opts.method == Method::HS ? rowSamples * band.rows : d.pos + d.bodyRead + d.qim.bitsRead() - bitsBefore);
+    return !d.done;
+}
+
+ExtractResult BandExtractor::finish() {
+    Impl& d = *impl_;
+    PhaseTimer timer(Phase::Payload);
+    ExtractResult res;
+    if ((res.status = d.status) != Status::Ok)
+        return res;
+    // With a sink, the bytes still held are written out instead of being returned
+    auto deliver = [&](std::string& bytes, size_t n) {
+        if (!d.sink) {
+            bytes.resize(n);
+            res.message = std::move(bytes);
+        } else if (!d.writeSink(bytes, n)) {
+            res.status = d.status;
+        }
+    };
+    switch (d.opts.method) {
+        case Method::LSB:
+        case Method::PM1:
+            if (d.inBody) {
+                if (d.opts.framed && d.bodyRead < d.bodySamples) {
+                    res.status = Status::MessageNotFound;
+                    break;
+                }
+                deliver(d.body, static_cast<size_t>(std::min(d.msgBits, d.bodyBits()) / 8 - d.bodyBase));
+            } else if (!d.opts.framed) {
+                // Like extractLSB: a short image yields only the complete bytes it holds
+                deliver(d.data, static_cast<size_t>(d.pos / 8 - d.dataBase));
+            } else if (!d.haveHeader || d.pos < d.total_bits) {
+                res.status = Status::MessageNotFound;
+            } else if (d.sink) {
+                deliver(d.data, static_cast<size_t>(d.total_bits / 8 - d.dataBase));
+            } else {
+                res.message = d.data.substr(d.headerBytes);
+            }
+            break;
+        case Method::QIM:
+            if (!d.qim.found())
+                res.status = Status::MessageNotFound;
+            else if (!d.sink)
+                res.message = d.qim.message();
+            else if (!d.qim.finishSink())
+                res.status = d.qim.corrupt() ? Status::MessageNotFound : Status::PayloadError;
+            break;
+        case Method::HS: {
+            if (!d.haveHeader) {
+                res.status = Status::MessageNotFound;
+                break;
+            }
+            std::string payload;
+            joinHSChannels(d.channelBits, d.channel, d.hsBits, payload);
+            if (payload.size() * 8 < d.hsBits) {
+                res.status = d.opts.framed ? Status::MessageNotFound : Status::MessageTooLong;
+                break;
+            }
+            if (d.opts.framed)
+                payload.erase(0, d.headerBytes);
+            deliver(payload, payload.size());
+            break;
+        }
+    }
+    if (d.sink && res.status == Status::Ok && d.unpack && !d.unpack->finish())
+        res.status = Status::MessageNotFound;
+    if (d.out && res.status == Status::Ok && !d.out->finish())
+        res.status = Status::PayloadError;
+    Codec codec = d.opts.method == Method::QIM ? d.qim.codec() : d.codec;
+    if (!d.out && res.status == Status::Ok && codec != Codec::None) {
+        std::string packed = std::move(res.message);
+        res.message.clear();
+        if (!unpackPayload(packed, codec, res.message)) {
+            res.message.clear();
+            res.status = Status::MessageNotFound;
+        }
+    }
+    return res;
+}
+
+}  // namespace steg
@@ -0,0 +1,715 @@
+#ifndef STEGO_API_HPP
+#define STEGO_API_HPP
+
+#include "payload_codec.hpp"
+#include "payload_stream.hpp"
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file stego_api.hpp
+ * \brief In-memory steganography library API (cv::Mat and encoded byte buffers, no disk or console I/O)
+ */
+
+
+
+/**
+ * \brief Enumeration of available steganography methods
+ */
+enum class Method { LSB = 1, HS = 2, QIM = 3, PM1 = 4 };
+
+/**
+ * \brief Converts a string message into a vector of bits
+ * \param message The input string message to convert
+ * \return Vector of boolean values representing the message in binary form
+ */
+std::vector<bool> messageToBits(const std::string& message);
+
+/**
+ * \brief Converts a vector of bits back into a string message
+ * \param bits Vector of boolean values representing the message in binary form
+ * \return The reconstructed string message
+ */
+std::string bitsToMessage(const std::vector<bool>& bits);
+
+/**
+ * \brief Finds P (peak) and Z (zero) points in a channel's histogram
+ * \param channel Input image channel
+ * \param P Reference to store the peak point
+ * \param Z Reference to store the zero point
+ * \return false if the channel is empty; P and Z are then 0
+ */
+bool findPZ(const cv::Mat& channel, int& P, int& Z);
+
+/**
+ * \brief Shifts the histogram of a channel for embedding
+ * \param channel Image channel to modify
+ * \param P Peak point
+ * \param Z Zero point
+ */
+void shiftHistogram(cv::Mat& channel, int P, int Z);
+
+/**
+ * \brief Reverses the histogram shift for extraction
+ * \param channel Image channel to modify
+ * \param P Peak point
+ * \param Z Zero point
+ */
+void unshiftHistogram(cv::Mat& channel, int P, int Z);
+
+
+namespace steg {
+
+/**
+ * \brief Result status of a library call
+ */
+enum class Status {
+    Ok,                 ///< Operation succeeded
+    ImageLoadError,     ///< Image is empty or could not be decoded
+    InvalidImage,       ///< Image is not an 8-bit 3-channel image
+    MessageTooLong,     ///< Message does not fit into the cover
+    InvalidParameter,   ///< Method parameter is out of range (e.g. odd QIM step)
+    EncodeError,        ///< Image could not be encoded
+    MessageNotFound,    ///< No message could be recovered from the image
+    LossyFormat,        ///< Output format would destroy the payload (e.g. JPEG)
+    PayloadError        ///< The payload source or sink failed
+};
+
+/**
+ * \brief Returns a human-readable description of a status
+ * \param status Status to describe
+ * \return Static null-terminated string
+ */
+const char* statusMessage(Status status);
+
+/**
+ * \brief Returns a stable machine-readable name of a status (e.g. "ok", "message_too_long")
+ * \param status Status to name
+ * \return Static null-terminated string
+ */
+const char* statusName(Status status);
+
+/**
+ * \brief Returns the short lowercase name of a method ("lsb", "hs", "qim", "pm1")
+ * \param method Method to name
+ * \return Static null-terminated string
+ */
+const char* methodName(Method method);
+
+/**
+ * \brief Parses a method name as returned by methodName (case-insensitive)
+ * \param name Method name
+ * \param method Output method
+ * \return true if the name is known
+ */
+bool parseMethod(const std::string& name, Method& method);
+
+/**
+ * \brief Largest number of peak/zero pairs per channel in multi-pair Histogram Shifting
+ */
+constexpr int kMaxHSPairs = 4;
+
+/**
+ * \brief Histogram Shifting key: peak and zero points per channel in B, G, R order
+ *
+ * P and Z hold the first pair of each channel. Multi-pair keys (pairs > 1) keep the others in
+ * moreP/moreZ; a pair with P == Z is unused. The shift ranges [min(P, Z), max(P, Z)] of the
+ * pairs of a channel never overlap, so all of them are embedded and extracted in one pass.
+ */
+struct HSKey {
+    int P[3] = {0, 0, 0};
+    int Z[3] = {0, 0, 0};
+    int pairs = 1;                          ///< Pairs per channel, 1..kMaxHSPairs
+    int moreP[3][kMaxHSPairs - 1] = {};     ///< Peaks of pairs 2..pairs
+    int moreZ[3][kMaxHSPairs - 1] = {};     ///< Zero points of pairs 2..pairs
+};
+
+/**
+ * \brief Parses a key written as Pr/Zr,Pg/Zg,Pb/Zb (channels R, G, B)
+ *
+ * A multi-pair channel lists its pairs as P/Z+P/Z+..., every channel with the same count.
+ * \param text Key text
+ * \param key Output key, unchanged on failure
+ * \return true if the text is a valid key
+ */
+bool parseHSKey(const std::string& text, HSKey& key);
+
+/**
+ * \brief Formats a key as parseHSKey reads it
+ * \param key Peak/zero points
+ * \return Key text
+ */
+std::string formatHSKey(const HSKey& key);
+
+/**
+ * \brief Version of the self-describing payload header
+ */
+constexpr uint8_t kHeaderVersion = 1;
+
+/**
+ * \brief Self-describing header written in front of every framed payload
+ *
+ * Layout (bytes, embedded MSB-first like the message): 'S' 'G', version, method id, flags,
+ * 64-bit big-endian payload length and, for Histogram Shifting only, P and Z of every pair of the
+ * B, G and R channels (channel by channel). Flags bits 0-1 hold bitsPerChannel - 1 (LSB, PM1) or
+ * hs.pairs - 1 (HS), bits 2-4 hold matrixBits (LSB, PM1), bits 5-6 hold the codec the message
+ * was packed with (payload_codec.hpp; the length is then the packed length); bit 7 is zero.
+ * LSB, QIM and PM1 embed the header with the method itself in front of the message, always one
+ * bit per sample, so it can be read before bitsPerChannel is known. Histogram
+ * Shifting cannot read its own key, so its header sits in the LSBs of the first samples, which are
+ * excluded from shifting, and their original LSBs are carried at the start of the shifted payload.
+ * With matrixBits k the message after the header is carried k bits per group of 2^k - 1 samples
+ * (matrix_kernels.hpp). Groups never straddle rows, so rows stay independent: each row holds the
+ * whole groups that fit in it after the header, and the samples left at its end are unchanged.
+ */
+struct PayloadHeader {
+    Method method = Method::LSB;
+    uint64_t length = 0;   ///< Message length in bytes
+    int bitsPerChannel = 1;   ///< Message bits per sample, 1-4 (LSB and PM1 only)
+    int matrixBits = 0;    ///< Matrix embedding code size k, 0 for none (LSB and PM1 only)
+    Codec codec = Codec::None;   ///< Codec the message is packed with
+    HSKey hs;              ///< Histogram Shifting key with its pair count (HS only)
+};
+
+/**
+ * \brief Size of the encoded header for a method
+ * \param method Steganography method
+ * \param hsPairs Peak/zero pairs per channel (Histogram Shifting only)
+ * \return 13 bytes, or 13 + 6 per pair for Histogram Shifting (19 with one pair)
+ */
+size_t headerSize(Method method, int hsPairs = 1);
+
+/**
+ * \brief Serialises a header
+ * \param header Header to encode
+ * \return headerSize(header.method) bytes
+ */
+std::string encodeHeader(const PayloadHeader& header);
+
+/**
+ * \brief Parses a header
+ * \param data Encoded bytes, at least headerSize(Method::LSB) of them (headerSize(HS, pairs) for HS)
+ * \param size Number of bytes available
+ * \param header Output header
+ * \return Status::Ok, or Status::MessageNotFound if the magic, version, method or flags are wrong
+ */
+Status decodeHeader(const uint8_t* data, size_t size, PayloadHeader& header);
+
+/**
+ * \brief Result of an embedding call
+ */
+struct EmbedResult {
+    Status status = Status::Ok;
+    cv::Mat stego;   ///< Stego image (CV_8UC3), empty on failure
+    HSKey hs;        ///< Peak/zero points chosen by Histogram Shifting (unused by other methods)
+};
+
+/**
+ * \brief Result of an extraction call
+ */
+struct ExtractResult {
+    Status status = Status::Ok;
+    std::string message;   ///< Extracted message, empty on failure or when it went to a sink
+};
+
+/**
+ * \brief Result of a capacity query
+ */
+struct CapacityResult {
+    Status status = Status::Ok;
+    uint64_t maxBytes = 0;   ///< Maximum message length in bytes
+};
+
+/**
+ * \brief zlib strategy for PNG output (same values as cv::IMWRITE_PNG_STRATEGY_*)
+ */
+enum class PngStrategy { Default = 0, Filtered = 1, HuffmanOnly = 2, Rle = 3, Fixed = 4 };
+
+/**
+ * \brief Settings of the stego image encoder
+ */
+struct EncodeOptions {
+    int pngCompression = -1;                          ///< zlib level 0-9 (0 stores uncompressed), -1 for the codec default
+    PngStrategy pngStrategy = PngStrategy::Default;   ///< zlib strategy; Rle and HuffmanOnly are much faster than Default
+    bool tiffCompression = true;                      ///< false writes uncompressed TIFF
+};
+
+/**
+ * \brief Embedding parameters for the generic and encoded-buffer entry points
+ */
+struct EmbedOptions {
+    Method method = Method::LSB;
+    int q = 4;                     ///< QIM quantization step
+    std::string ext = ".png";      ///< Output container for embedEncoded
+    bool framed = true;            ///< Write the self-describing header (false: raw per-method layout)
+    EncodeOptions encode;          ///< Encoder settings for embedEncoded and embedFile
+    std::optional<uint64_t> seed;  ///< PM1 random stream seed; a fresh one per call when unset
+    std::optional<uint64_t> scatterKey;  ///< Scatter the payload over the image in a keyed order (LSB, QIM, PM1)
+    int bitsPerChannel = 1;        ///< Message bits per sample, 1-4; above 1 only for LSB and PM1
+    int matrixBits = 0;            ///< Matrix embedding (LSB, PM1, one bit per sample): k message bits per group of 2^k - 1 samples, 2..7; 0 for none
+    int hsPairs = 1;               ///< Histogram Shifting peak/zero pairs per channel, 1..kMaxHSPairs
+    Codec codec = Codec::None;     ///< Pack the message before embedding (framed only); a message that does not shrink is embedded as is. Capacities count packed bytes
+    std::optional<std::string> coverCache;  ///< embedFile and capacityFile (HS): cover statistics cache directory, "" for sidecar files
+};
+
+/**
+ * \brief Extraction parameters for the generic and encoded-buffer entry points
+ */
+struct ExtractOptions {
+    Method method = Method::LSB;
+    int q = 4;             ///< QIM quantization step
+    size_t msgLen = 0;     ///< Message length in bytes (raw LSB, HS, PM1 only)
+    HSKey hs;              ///< Histogram Shifting key (raw HS only)
+    bool framed = true;    ///< Read the self-describing header; msgLen and hs are then ignored
+    std::optional<uint64_t> scatterKey;  ///< Key the payload was scattered with, if any
+    int bitsPerChannel = 1;   ///< Message bits per sample (raw LSB and PM1 only; framed reads it from the header)
+    int matrixBits = 0;       ///< Matrix embedding code size (raw LSB and PM1 only; framed reads it from the header)
+};
+
+/**
+ * \brief Result of embedding into an encoded image buffer
+ */
+struct EncodedEmbedResult {
+    Status status = Status::Ok;
+    std::vector<uchar> bytes;   ///< Encoded stego image
+    HSKey hs;                   ///< Peak/zero points chosen by Histogram Shifting
+};
+
+/**
+ * \brief Decodes an encoded image (PNG, BMP, ...) held in memory into a 3-channel image
+ * \param data Pointer to the encoded bytes
+ * \param size Number of encoded bytes
+ * \param image Output image
+ * \return Status::Ok or Status::ImageLoadError
+ */
+Status decodeImage(const uchar* data, size_t size, cv::Mat& image);
+
+/**
+ * \brief Decodes an encoded image held in memory into a 3-channel image
+ * \param bytes Encoded bytes
+ * \param image Output image
+ * \return Status::Ok or Status::ImageLoadError
+ */
+Status decodeImage(const std::vector<uchar>& bytes, cv::Mat& image);
+
+/**
+ * \brief decodeImage that decodes into the memory image already holds when the size matches
+ *
+ * A caller decoding many images of one size keeps a single buffer this way. The memory is
+ * overwritten, so nothing else may refer to it.
+ * \param bytes Encoded bytes
+ * \param image Output image
+ * \return Status::Ok or Status::ImageLoadError
+ */
+Status decodeImageInto(const std::vector<uchar>& bytes, cv::Mat& image);
+
+/**
+ * \brief Whether a container keeps every sample of a 3-channel 8-bit image bit-exact
+ * \param ext Extension with the leading dot, case-insensitive: .png, .bmp, .dib, .ppm, .pnm, .pam, .tif, .tiff
+ */
+bool isLosslessFormat(const std::string& ext);
+
+/**
+ * \brief Encodes an image into memory
+ * \param image Image to encode
+ * \param ext Container extension, e.g. ".png"; lossy containers are refused
+ * \param bytes Output buffer
+ * \param opts Encoder settings
+ * \return Status::Ok, Status::LossyFormat or Status::EncodeError
+ */
+Status encodeImage(const cv::Mat& image, const std::string& ext, std::vector<uchar>& bytes, const EncodeOptions& opts = EncodeOptions());
+
+/**
+ * \brief Embeds a message using LSB method
+ * \param cover Cover image (CV_8UC3), left unchanged
+ * \param message The message to embed
+ * \return Stego image and status
+ */
+EmbedResult embedLSB(const cv::Mat& cover, const std::string& message);
+
+/**
+ * \brief Extracts a message using LSB method
+ * \param stego Stego image (CV_8UC3)
+ * \param msgLen Length of the embedded message in bytes
+ * \return Extracted message and status
+ */
+ExtractResult extractLSB(const cv::Mat& stego, size_t msgLen);
+
+/**
+ * \brief Maximum message length for LSB method
+ * \param cover Cover image (CV_8UC3)
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityLSB(const cv::Mat& cover);
+
+/**
+ * \brief Embeds a message using QIM method (16-bit length header followed by the message)
+ *
+ * Messages longer than 65535 bytes do not fit the 16-bit length and give MessageTooLong;
+ * the framed layout of embed() carries a 64-bit length instead.
+ * \param cover Cover image (CV_8UC3), left unchanged
+ * \param message The message to embed
+ * \param q Quantization step size (even, >= 2)
+ * \return Stego image and status
+ */
+EmbedResult embedQIM(const cv::Mat& cover, const std::string& message, int q);
+
+/**
+ * \brief Extracts a message using QIM method
+ * \param stego Stego image (CV_8UC3)
+ * \param q Quantization step size used during embedding
+ * \return Extracted message and status
+ */
+ExtractResult extractQIM(const cv::Mat& stego, int q);
+
+/**
+ * \brief Maximum message length for QIM method (at most 65535 bytes in this raw layout)
+ * \param cover Cover image (CV_8UC3)
+ * \param q Quantization step size
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityQIM(const cv::Mat& cover, int q);
+
+/**
+ * \brief Embeds a message using Histogram Shifting method
+ * \param cover Cover image (CV_8UC3), left unchanged
+ * \param message The message to embed
+ * \return Stego image, chosen peak/zero points and status
+ */
+EmbedResult embedHS(const cv::Mat& cover, const std::string& message);
+
+/**
+ * \brief Extracts a message using Histogram Shifting method
+ * \param stego Stego image (CV_8UC3)
+ * \param key Peak/zero points reported by embedHS (or a multi-pair key)
+ * \param msgLen Length of the embedded message in bytes
+ * \return Extracted message and status
+ */
+ExtractResult extractHS(const cv::Mat& stego, const HSKey& key, size_t msgLen);
+
+/**
+ * \brief Counts the bits a Histogram Shifting stego image can carry for a given key
+ * \param stego Stego image (CV_8UC3)
+ * \param key Peak/zero points reported by embedHS
+ * \return Number of candidate bits
+ */
+uint64_t embeddedBitsHS(const cv::Mat& stego, const HSKey& key);
+
+/**
+ * \brief Maximum message length for Histogram Shifting method
+ * \param cover Cover image (CV_8UC3)
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityHS(const cv::Mat& cover);
+
+/**
+ * \brief One layer of multi-layer Histogram Shifting
+ */
+struct HSLayer {
+    HSKey key;                  ///< Pairs chosen for this layer
+    uint64_t bits[3] = {0, 0, 0};   ///< Message bits carried by each channel
+};
+
+/**
+ * \brief Result of multi-layer Histogram Shifting
+ */
+struct HSLayersResult {
+    Status status = Status::Ok;
+    cv::Mat stego;                 ///< Stego image (CV_8UC3), empty on failure
+    std::vector<HSLayer> layers;   ///< Layers in embedding order; needed for extraction
+};
+
+/**
+ * \brief Embeds a message with several Histogram Shifting layers, each with up to `pairs` pairs per channel
+ *
+ * Each layer embeds into the result of the previous one, continuing the message where it stopped,
+ * until the message fits or maxLayers is reached. The cover histogram is built once; after each
+ * layer it is updated from the shift tables and the count of peaks that took a 1, so choosing the
+ * next layer's pairs needs no pass over the image.
+ * \param cover Cover image (CV_8UC3), left unchanged
+ * \param message The message to embed
+ * \param pairs Peak/zero pairs per channel and layer, 1..kMaxHSPairs
+ * \param maxLayers Largest number of layers
+ * \return Stego image, the layers and status (MessageTooLong if maxLayers do not hold the message)
+ */
+HSLayersResult embedHSLayers(const cv::Mat& cover, const std::string& message, int pairs, int maxLayers);
+
+/**
+ * \brief Extracts a multi-layer Histogram Shifting message, undoing the layers from the last one
+ * \param stego Stego image (CV_8UC3)
+ * \param layers Layers reported by embedHSLayers
+ * \param cover If not null, receives the restored cover image
+ * \return Extracted message and status
+ */
+ExtractResult extractHSLayers(const cv::Mat& stego, const std::vector<HSLayer>& layers, cv::Mat* cover = nullptr);
+
+/**
+ * \brief Embeds a message using PM1 method
+ *
+ * The ±1 directions come from a counter-based stream (see pm1_kernels.hpp), so a given seed
+ * gives the same stego image for any thread count.
+ * \param cover Cover image (CV_8UC3), left unchanged
+ * \param message The message to embed
+ * \param seed Random stream seed; drawn from std::random_device when unset
+ * \return Stego image and status
+ */
+EmbedResult embedPM1(const cv::Mat& cover, const std::string& message, std::optional<uint64_t> seed = std::nullopt);
+
+/**
+ * \brief Extracts a message using PM1 method
+ * \param stego Stego image (CV_8UC3)
+ * \param msgLen Length of the embedded message in bytes
+ * \return Extracted message and status
+ */
+ExtractResult extractPM1(const cv::Mat& stego, size_t msgLen);
+
+/**
+ * \brief Maximum message length for PM1 method
+ * \param cover Cover image (CV_8UC3)
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacityPM1(const cv::Mat& cover);
+
+/**
+ * \brief Number of pixels that differ between two images of the same size and type
+ * \param a First image
+ * \param b Second image
+ * \return Count of pixels with at least one differing channel, 0 if the images are not comparable
+ */
+uint64_t changedPixels(const cv::Mat& a, const cv::Mat& b);
+
+/**
+ * \brief Embeds a message with the method selected in options, framed by the header unless opts.framed is off
+ *
+ * With opts.scatterKey the payload bits go to the samples in the keyed order of scatter.hpp
+ * instead of raster order; Histogram Shifting cannot be scattered (InvalidParameter).
+ * \param cover Cover image (CV_8UC3)
+ * \param message The message to embed
+ * \param opts Method and its parameters
+ * \return Stego image and status
+ */
+EmbedResult embed(const cv::Mat& cover, const std::string& message, const EmbedOptions& opts);
+
+/**
+ * \brief embed() that writes the stego image over the cover instead of into a copy
+ *
+ * Every layout changes the samples in place, so image keeps its buffer; the result is the
+ * same as that of embed().
+ * \param image Cover image (CV_8UC3), the stego image on return; left unchanged on failure
+ * \param message The message to embed
+ * \param opts Method and its parameters
+ * \return Status and HS key; stego refers to image
+ */
+EmbedResult embedInPlace(cv::Mat& image, const std::string& message, const EmbedOptions& opts);
+
+/**
+ * \brief Extracts a message with the method selected in options
+ *
+ * A framed extraction reads the header first and stops as soon as the message is complete;
+ * a packed message is unpacked with the codec the header names.
+ * A scattered payload is read in the order given by opts.scatterKey.
+ * \param stego Stego image (CV_8UC3)
+ * \param opts Method and its parameters
+ * \return Extracted message and status
+ */
+ExtractResult extract(const cv::Mat& stego, const ExtractOptions& opts);
+
+/**
+ * \brief Whether embedding options describe a layout the library supports
+ *
+ * The check embed(), capacity() and their file forms make before touching an image: an even
+ * QIM step of at least 2, bits, matrix embedding and pair counts within range for the method,
+ * and a codec only with the framed layout.
+ * \param opts Embedding options
+ * \return false if embedding with them fails with Status::InvalidParameter
+ */
+bool validEmbedOptions(const EmbedOptions& opts);
+
+/**
+ * \brief Maximum framed message length for the given method (the header is already subtracted)
+ * \param cover Cover image (CV_8UC3)
+ * \param method Steganography method
+ * \param q Quantization step size (QIM only)
+ * \param bitsPerChannel Message bits per sample (LSB and PM1 only)
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacity(const cv::Mat& cover, Method method, int q = 4, int bitsPerChannel = 1);
+
+/**
+ * \brief Maximum message length for the layout selected by embedding options (method, q, framed, bits, pairs)
+ * \param cover Cover image (CV_8UC3)
+ * \param opts Embedding options; the message-independent ones are used
+ * \return Capacity in bytes and status
+ */
+CapacityResult capacity(const cv::Mat& cover, const EmbedOptions& opts);
+
+/**
+ * \brief Decodes an encoded cover, embeds a message and encodes the stego image, all in memory
+ * \param cover Encoded cover image bytes
+ * \param message The message to embed
+ * \param opts Method, its parameters and output container
+ * \return Encoded stego image and status
+ */
+EncodedEmbedResult embedEncoded(const std::vector<uchar>& cover, const std::string& message, const EmbedOptions& opts);
+
+/**
+ * \brief Decodes an encoded stego image and extracts a message, all in memory
+ * \param stego Encoded stego image bytes
+ * \param opts Method and its parameters
+ * \return Extracted message and status
+ */
+ExtractResult extractEncoded(const std::vector<uchar>& stego, const ExtractOptions& opts);
+
+/**
+ * \brief Number of leading cover samples BandEmbedder::setStats needs, enough for the largest framed Histogram Shifting header
+ */
+size_t coverHeadSamples();
+
+/**
+ * \brief Embeds a message into an image that is delivered as consecutive row bands
+ *
+ * Lets a caller decode, embed and encode an image band by band with bounded memory.
+ * Call order: scanBand() on every band if needsScan() (Histogram Shifting only), then
+ * prepare(), then embedBand() on every band top to bottom. The result is identical to
+ * embedding the whole image at once (for PM1, given the same seed). Bands are used in the
+ * order given: scatterKey is applied by embed(), which passes the samples in keyed order.
+ */
+class BandEmbedder {
+public:
+    /**
+     * \brief Creates the embedder
+     * \param message The message to embed (copied)
+     * \param opts Method and its parameters
+     */
+    BandEmbedder(const std::string& message, const EmbedOptions& opts);
+
+    /**
+     * \brief Creates an embedder that reads the message from a source as the bands need it
+     *
+     * Only the bytes of the band being embedded are held in memory (Histogram Shifting, whose
+     * channels take consecutive parts of the message, reads it whole in prepare()). With
+     * opts.codec the source is read to its end here and packed into a temporary file (packSource).
+     * \param source Message source; it must outlive the embedder
+     * \param opts Method and its parameters
+     */
+    BandEmbedder(PayloadSource& source, const EmbedOptions& opts);
+    ~BandEmbedder();
+
+    BandEmbedder(const BandEmbedder&) = delete;
+    BandEmbedder& operator=(const BandEmbedder&) = delete;
+
+    /**
+     * \brief Whether the method needs a statistics pass over all bands before prepare()
+     */
+    bool needsScan() const;
+
+    /**
+     * \brief Accumulates the statistics of the next band (first pass)
+     * \param band Cover rows (CV_8UC3)
+     */
+    void scanBand(const cv::Mat& band);
+
+    /**
+     * \brief Takes the statistics of the whole cover at once, instead of scanBand() on every band
+     *
+     * Lets a caller with cached statistics skip the first pass.
+     * \param hist B, G and R histograms of every sample of the cover
+     * \param head The first samples of the cover in raster order: all of them, or at least the
+     *             pixels that carry the framed Histogram Shifting header (coverHeadSamples())
+     * \param headSamples Number of samples in head
+     */
+    void setStats(const uint64_t hist[3][256], const uint8_t* head, size_t headSamples);
+
+    /**
+     * \brief Maximum message length for the scanned image, in the layout selected by the options
+     * \param width Image width in pixels
+     * \param height Image height in pixels
+     */
+    uint64_t capacityBytes(int width, int height) const;
+
+    /**
+     * \brief Checks the capacity and fixes the embedding parameters
+     * \param width Image width in pixels
+     * \param height Image height in pixels
+     * \return Status::Ok, Status::MessageTooLong or Status::InvalidParameter
+     */
+    Status prepare(int width, int height);
+
+    /**
+     * \brief Embeds into the next band in place (second pass)
+     * \param band Cover rows (CV_8UC3) of the width given to prepare()
+     */
+    void embedBand(cv::Mat& band);
+
+    /**
+     * \brief Peak/zero points chosen by Histogram Shifting, valid after prepare()
+     */
+    const HSKey& hsKey() const;
+
+    /**
+     * \brief Number of leading samples the payload occupies, valid after prepare()
+     *
+     * Samples past it are left unchanged; Histogram Shifting may change any sample, so it
+     * reports all of them.
+     */
+    uint64_t payloadSamples() const;
+
+    /**
+     * \brief Whether the source ended early or failed while embedding
+     */
+    bool payloadFailed() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * \brief Extracts a message from an image that is delivered as consecutive row bands
+ *
+ * Like BandEmbedder, it takes the bands in the order given and ignores scatterKey.
+ */
+class BandExtractor {
+public:
+    /**
+     * \brief Creates the extractor
+     * \param opts Method and its parameters
+     * \param width Image width in pixels
+     * \param height Image height in pixels
+     * \param sink Optional destination of the message: LSB, PM1 and QIM write each chunk as
+     *             soon as it is complete instead of keeping the message, Histogram Shifting
+     *             writes it in finish(); a packed message is unpacked on the way (UnpackSink).
+     *             It must outlive the extractor
+     */
+    BandExtractor(const ExtractOptions& opts, int width, int height, PayloadSink* sink = nullptr);
+    ~BandExtractor();
+
+    BandExtractor(const BandExtractor&) = delete;
+    BandExtractor& operator=(const BandExtractor&) = delete;
+
+    /**
+     * \brief Reads the next band
+     * \param band Stego rows (CV_8UC3)
+     * \return true while more bands are needed, false once the message is complete
+     */
+    bool extractBand(const cv::Mat& band);
+
+    /**
+     * \brief Returns the message after the last band
+     * \return Extracted message and status
+     */
+    ExtractResult finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace steg
+
+#endif
@@ -0,0 +1,62 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+/**
+ * \file
+ * \brief File, where the bounded worker pool is realised
+ */
+
+
+
+ThreadPool::ThreadPool(int threads, size_t maxQueue) : maxQueue_(std::max<size_t>(1, maxQueue)) {
+    threads = std::max(1, threads);
+    workers_.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    notEmpty_.notify_all();
+    for (std::thread& t : workers_)
+        t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this] { return queue_.size() < maxQueue_; });
+    queue_.push_back(std::move(task));
+    lock.unlock();
+    notEmpty_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && running_ == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notEmpty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;   // stopping and drained
+            task = std::move(queue_.front());
+            queue_.pop_front();
+            ++running_;
+        }
+        notFull_.notify_one();
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --running_;
+            if (queue_.empty() && running_ == 0)
+                idle_.notify_all();
+        }
+    }
+}
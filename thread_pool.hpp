@@ -0,0 +1,72 @@
+#ifndef STEGO_THREAD_POOL_HPP
+#define STEGO_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \file thread_pool.hpp
+ * \brief Fixed-size worker pool with a bounded task queue
+ */
+
+
+
+/**
+ * \brief Fixed set of worker threads fed from a bounded FIFO queue
+ *
+ * submit() blocks while the queue is full, so a producer walking thousands of files
+ * never holds more than maxQueue pending tasks in memory.
+ */
+class ThreadPool {
+public:
+    /**
+     * \brief Starts the workers
+     * \param threads Number of worker threads (at least 1)
+     * \param maxQueue Maximum number of queued, not yet running tasks (at least 1)
+     */
+    ThreadPool(int threads, size_t maxQueue);
+
+    /**
+     * \brief Waits for all queued tasks and stops the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * \brief Queues a task, blocking while the queue is full
+     * \param task Task to run on a worker; it must not throw
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * \brief Blocks until the queue is empty and no task is running
+     */
+    void wait();
+
+    /**
+     * \brief Number of worker threads
+     */
+    int size() const { return static_cast<int>(workers_.size()); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    size_t maxQueue_;
+    size_t running_ = 0;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::condition_variable idle_;
+};
+
+#endif